@@ -0,0 +1,56 @@
+global _start
+section .text
+sum:
+	push rbp
+	mov rbp, rsp
+	sub rsp, 16
+	push rbx
+	push r12
+	push r13
+	push r14
+	push r15
+	mov rax, 1
+	mov rcx, 2
+	mov rdx, 3
+	mov r8, 4
+	mov r9, 5
+	mov r10, 6
+	mov r11, 7
+	mov rsi, 8
+	mov rdi, 9
+	mov rbx, 10
+	mov r12, 11
+	mov r13, 12
+	mov r14, 13
+	mov r15, 14
+	mov qword [rbp-8], 15
+	mov qword [rbp-16], 16
+	mov rax, rax
+	add rax, rcx
+	add rax, rdx
+	add rax, r8
+	add rax, r9
+	add rax, r10
+	add rax, r11
+	add rax, rsi
+	add rax, rdi
+	add rax, rbx
+	add rax, r12
+	add rax, r13
+	add rax, r14
+	add rax, r15
+	add rax, qword [rbp-8]
+	add rax, qword [rbp-16]
+	pop r15
+	pop r14
+	pop r13
+	pop r12
+	pop rbx
+	leave
+ret
+_start:
+	call sum
+	mov rdi, rax
+	mov rax, 60
+	syscall
+ret
@@ -0,0 +1,36 @@
+global _start
+extern printf
+section .text
+count_upper:
+	xor eax, eax
+	cmp byte[rdi], 0
+	je endwhile0
+	startwhile0:
+		xor ecx, ecx
+		mov cl, byte[rdi]
+		inc rdi
+		cmp rcx, 65
+		jl endif1
+		cmp rcx, 90
+		jg endif0
+		inc rax
+		endif0:
+		endif1:
+		cmp byte[rdi], 0
+		jne startwhile0
+	endwhile0:
+ret
+_start:
+	mov rdi, teststr
+	call count_upper
+	test rax, rax
+	je endif2
+	mov rdi, fmt
+	mov rsi, rax
+	call printf
+	endif2:
+	mov rax, 60
+	syscall
+section .data
+teststr: db "HeLlO WoRlD", 0
+fmt: db "%d", 10, 0
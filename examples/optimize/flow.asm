@@ -0,0 +1,38 @@
+global _start
+section .text
+sign:
+	mov rax, 1
+	test rdi, rdi
+	jle endif0
+	ret
+	endif0:
+	xor eax, eax
+	test rdi, rdi
+	jne endif1
+	ret
+	endif1:
+	mov rax, -1
+	done:
+	ret
+print_sign:
+	call sign
+	add rax, 49
+	mov byte[digit], al
+	mov rdi, 1
+	mov rsi, digit
+	mov rdx, 2
+	mov rax, 1
+	syscall
+ret
+_start:
+	mov rdi, 5
+	call print_sign
+	mov rdi, 0
+	call print_sign
+	mov rdi, -3
+	call print_sign
+	mov rdi, 0
+	mov rax, 60
+	syscall
+section .data
+digit: db "0", 10
@@ -0,0 +1,24 @@
+global _start
+section .text
+check:
+	cmp rdi, 3
+	jne endif0
+	jmp endif9
+	endif0:
+	mov rdi, 1
+	mov rax, 60
+	syscall
+finish:
+	jmp endwhile9
+_start:
+	mov rdi, 3
+	call check
+	endif9:
+	call finish
+	mov rdi, 1
+	mov rax, 60
+	syscall
+	endwhile9:
+	mov rdi, 0
+	mov rax, 60
+	syscall
@@ -0,0 +1,17 @@
+strlwr:
+	strlwr.startwhile0:
+		cmp byte[rdi], 0
+		je strlwr.endwhile0
+		cmp byte[rdi], 65
+		jl strlwr.endif1
+		cmp byte[rdi], 90
+		jg strlwr.endif0
+		mov sil, byte[rdi]
+		add sil, 32
+		mov byte[rdi], sil
+		strlwr.endif0:
+		strlwr.endif1:
+		inc rdi
+		jmp strlwr.startwhile0
+	strlwr.endwhile0:
+ret
@@ -0,0 +1,9 @@
+_start:
+	mov rdi, teststr
+	call strlwr
+	mov rdi, fmt
+	mov rsi, teststr
+	call printf
+	mov rax, 60
+	syscall
+ret
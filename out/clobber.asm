@@ -0,0 +1,26 @@
+global _start
+section .text
+clobber:
+	mov rbx, 7
+ret
+keep:
+	mov rax, 1
+ret
+_start:
+	push rbp
+	mov rbp, rsp
+	sub rsp, 16
+	push r12
+	mov r12, 42
+	call clobber
+	call keep
+	mov qword [rbp-8], r12
+	lea rax, [rel keep]
+	call rax
+	sub qword [rbp-8], 42
+	mov rdi, qword [rbp-8]
+	mov rax, 60
+	syscall
+	pop r12
+	leave
+ret
@@ -0,0 +1,39 @@
+global _start
+section .text
+print_number:
+	mov rdi, rdi
+	lea rsi, [buffer+31]
+	mov byte [rsi], 10
+	startwhile0:
+		cmp rdi, 0
+		je endwhile0
+		mov rax, rdi
+		xor edx, edx
+		mov rcx, 10
+		div rcx
+		mov rdi, rax
+		mov cl, dl
+		add cl, '0'
+		dec rsi
+		mov [rsi], cl
+		jmp startwhile0
+	endwhile0:
+	lea rdx, [buffer+32]
+	sub rdx, rsi
+	mov rdi, 1
+	mov rsi, rsi
+	mov rdx, rdx
+	mov rax, 1
+	syscall
+ret
+_start:
+	mov rdi, 1234
+	call print_number
+	mov rdi, 907
+	call print_number
+	mov rdi, 0
+	mov rax, 60
+	syscall
+ret
+section .bss
+buffer: resb 32
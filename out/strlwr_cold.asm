@@ -0,0 +1,32 @@
+global _start
+extern printf
+section .text
+strlwr:
+	strlwr.startwhile0:
+		cmp byte[rdi], 0
+		je strlwr.endwhile0
+		cmp byte[rdi], 65
+		jl strlwr.endif1
+		cmp byte[rdi], 90
+		jg strlwr.endif0
+		mov sil, byte[rdi]
+		add sil, 32
+		mov byte[rdi], sil
+		strlwr.endif0:
+		strlwr.endif1:
+		inc rdi
+		jmp strlwr.startwhile0
+	strlwr.endwhile0:
+ret
+_start:
+	mov rdi, teststr
+	call strlwr
+	mov rdi, fmt
+	mov rsi, teststr
+	call printf
+	mov rax, 60
+	syscall
+ret
+section .data
+teststr: db "HeLlO WoRlD", 0
+fmt: db "%s", 10, 0
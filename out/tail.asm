@@ -0,0 +1,45 @@
+global _start
+section .text
+print:
+	mov rax, 1
+	syscall
+ret
+say:
+jmp print
+classify:
+	mov r12, rdi
+	cmp r12, 9
+	jle endif0
+	mov rdi, 1
+	mov rsi, big
+	mov rdx, 4
+	call say
+	endif0:
+	cmp r12, 9
+	jg endif1
+	mov rdi, 1
+	mov rsi, small
+	mov rdx, 6
+	jmp say
+	endif1:
+ret
+dispatch:
+	mov rbx, rdi
+	mov rdi, rbx
+	call classify
+	mov rdi, 1
+	mov rsi, done
+	mov rdx, 5
+jmp say
+_start:
+	mov rdi, 5
+	call dispatch
+	mov rdi, 12
+	call dispatch
+	mov rdi, 0
+	mov rax, 60
+	syscall
+section .data
+big: db "big", 10
+small: db "small", 10
+done: db "done", 10
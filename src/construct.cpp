@@ -1,61 +1,88 @@
 #include <string>
 #include <vector>
+#include <set>
+#include <chrono>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include "construct_types.h"
-#include "deconstruct.h"
-#include "reconstruct.h"
+#include "construct_cache.h"
+#include "construct_compile.h"
+#include "construct_threads.h"
 #include "construct_flags.h"
+#include "construct_module.h"
+#include "construct_server.h"
+#include "construct_stats.h"
+#include "construct_stream.h"
 
 int main(int argc, char** argv) {
-  std::string path;
-  std::string outpath;
-  if (handle_flags(argc, argv, &path, &outpath) != 0) {
+  con_options options;
+  if (handle_flags(argc, argv, &options) != 0) {
     std::cout << "Some flag(s) not set" << std::endl;
     return 0;
   }
-  if (path.empty()) {
-    std::cout << "No input file specified" << std::endl;
-    return 0;
+  if (!options.socket_path.empty()) {
+    return run_server(options.socket_path) == 0 ? 0 : 1;
   }
 
-  std::ifstream inpfile(path);
-  std::stringstream buffer;
-  buffer << inpfile.rdbuf();
-  std::vector<con_token*> tokens = parse_construct(buffer.str());
-
-  // Make _start global
-  con_token* glob_tok = new con_token(CMD);
-  glob_tok->tok_cmd->command = "global _start";
-  glob_tok->indentation = 0;
-  tokens.insert(tokens.begin(), glob_tok);
-  glob_tok = nullptr;
-
-  tokens = delinearize_tokens(tokens);
-
-  // Order dependant: some tokens are replaced with macros, so apply_macro() must be at the end.
-  apply_functions(tokens);
-  apply_ifs(tokens);
-  apply_whiles(tokens);
-  apply_funcalls(tokens);
-  apply_syscalls(tokens);
-  std::vector<con_macro*> empty_macros; // pointer to con_macros in tokens, not a copy
-  apply_macros(tokens, empty_macros);
-  empty_macros.clear(); // remove the pointers to con_macro, not the con_macro objects themselves
+  // A single input is written to -o, several inputs are written to <-o>/<input name>.asm
+  std::vector<std::string> outpaths;
+  if (options.paths.size() == 1) {
+    outpaths.push_back(options.outpath);
+  } else {
+    std::set<std::string> seen;
+    for (size_t i = 0; i < options.paths.size(); ++i) {
+      outpaths.push_back(batch_outpath(options.paths[i], options.outpath, output_extension(options)));
+      if (!seen.insert(outpaths.back()).second) {
+        std::cout << "Several inputs would be written to \"" << outpaths.back() << "\"" << std::endl;
+        return 0;
+      }
+    }
+  }
 
-  set_indentation(tokens);
-  linearize_tokens(tokens);
+  con_cache cache(options.cache_dir);
+  if (!options.cache_dir.empty() && cache.open() != 0) {
+    std::cout << "Could not create cache directory \"" << options.cache_dir << "\"" << std::endl;
+    return 0;
+  }
 
-  std::ofstream outfile;
-  outfile.open(outpath);
-  outfile << tokens_to_nasm(tokens);
-  outfile.close();
+  // Several files are compiled in parallel, a single one is split up by its top-level tokens.
+  // Errors are reported in input order once all are done
+  const unsigned jobs = options.jobs == 0 ? con_default_jobs() : options.jobs;
+  const unsigned file_jobs = options.paths.size() == 1 ? jobs : 1;
+  const bool report = options.time_passes || options.stats || options.json;
+  std::vector<int> results(options.paths.size(), 0);
+  std::vector<std::string> errors(options.paths.size());
+  std::vector<con_stats> stats(report ? options.paths.size() : 0);
+  con_modules modules; // an imported file is parsed once, however many inputs import it
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  con_parallel_for(options.paths.size(), jobs, [&](size_t i) {
+    const con_cache* file_cache = options.cache_dir.empty() ? nullptr : &cache;
+    if (options.stream && !options.write_ast && !options.write_object) {
+      results[i] = stream_file(options.paths[i], outpaths[i], options, file_jobs, file_cache, &errors[i],
+                               report ? &stats[i] : nullptr);
+    } else {
+      results[i] = compile_file(options.paths[i], outpaths[i], options, file_jobs, file_cache, &errors[i],
+                                report ? &stats[i] : nullptr, &modules);
+    }
+  });
+  const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  int result = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (results[i] != 0) {
+      std::cout << errors[i] << std::endl;
+      result = 1;
+    }
+  }
 
-  for (std::vector<con_token*>::reverse_iterator r_it = tokens.rbegin(); r_it != tokens.rend(); ++r_it) {
-    delete *r_it;
-    *r_it = nullptr;
+  if (report) {
+    con_stats total;
+    for (size_t i = 0; i < stats.size(); ++i) {
+      total.add(stats[i]);
+    }
+    if (options.json) {
+      print_stats_json(total, wall_seconds, options.stats, std::cout);
+    } else {
+      print_stats(total, wall_seconds, options.stats, std::cout);
+    }
   }
-  tokens.clear();
-  return 0;
+  return result;
 }
@@ -0,0 +1,45 @@
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include "construct_arena.h"
+
+con_arena::con_arena(size_t block_size) : block_size_(block_size) {}
+
+con_arena::~con_arena() {
+  while (head_ != nullptr) {
+    block* prev = head_->prev;
+    free(head_);
+    head_ = prev;
+  }
+}
+
+void* con_arena::allocate(size_t size, size_t align) {
+  ++allocations_;
+  uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor_) + align-1) & ~(uintptr_t)(align-1);
+  if (cursor_ == nullptr || aligned + size > reinterpret_cast<uintptr_t>(end_)) {
+    // Big requests get a block of their own so the current block is not wasted
+    if (size + align > block_size_/4) {
+      char* data = new_block(size + align);
+      bytes_used_ += size;
+      return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(data) + align-1) & ~(uintptr_t)(align-1));
+    }
+    cursor_ = new_block(block_size_);
+    end_ = cursor_ + block_size_;
+    aligned = (reinterpret_cast<uintptr_t>(cursor_) + align-1) & ~(uintptr_t)(align-1);
+  }
+  cursor_ = reinterpret_cast<char*>(aligned + size);
+  bytes_used_ += size;
+  return reinterpret_cast<void*>(aligned);
+}
+
+char* con_arena::new_block(size_t size) {
+  const size_t header = (sizeof(block) + alignof(std::max_align_t)-1) & ~(alignof(std::max_align_t)-1);
+  block* blk = static_cast<block*>(malloc(header + size));
+  if (blk == nullptr) {
+    throw std::bad_alloc();
+  }
+  blk->prev = head_;
+  head_ = blk;
+  bytes_reserved_ += header + size;
+  return reinterpret_cast<char*>(blk) + header;
+}
@@ -0,0 +1,45 @@
+#ifndef CONSTRUCT_ARENA_H_
+#define CONSTRUCT_ARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Bump allocator that owns everything built during one compilation: tokens, their payloads
+// and their strings. Nothing allocated from it is freed (or destructed) individually,
+// all blocks are released together when the arena is destroyed.
+class con_arena {
+ public:
+  explicit con_arena(size_t block_size = 1 << 16);
+  con_arena(const con_arena&) = delete;
+  con_arena& operator=(const con_arena&) = delete;
+  ~con_arena();
+
+  void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+  template <typename T, typename... Args>
+  T* make(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  size_t allocations() const { return allocations_; }
+  size_t bytes_used() const { return bytes_used_; }
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+ private:
+  struct block {
+    block* prev;
+  };
+
+  char* new_block(size_t size);
+
+  char* cursor_ = nullptr;
+  char* end_ = nullptr;
+  block* head_ = nullptr;
+  size_t block_size_;
+  size_t allocations_ = 0;
+  size_t bytes_used_ = 0;
+  size_t bytes_reserved_ = 0;
+};
+
+#endif // CONSTRUCT_ARENA_H_
@@ -0,0 +1,408 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "construct_ast.h"
+#include "construct_emitter.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000 // Linux 4.17, older kernels take the address as a hint
+#endif
+
+using namespace std;
+
+namespace {
+
+// An image being laid out. Objects (header, tokens, lists) come first, strings follow them, so a
+// pointer to an object gets its final value right away and a pointer to a string once the size of
+// the objects is known
+struct ast_image {
+  string objects;
+  string strings;
+  vector<uint64_t> string_relocs; // pointers that still hold an offset into strings
+  unordered_map<string, uint64_t> interned;
+};
+
+// Where a mapped image lies and where its pointers were written for
+struct ast_mapping {
+  uintptr_t base;
+  uintptr_t data;
+  uint64_t size;
+};
+
+}  // namespace
+
+static const char ast_magic[8] = {'C', 'O', 'N', 'A', 'S', 'T', '\0', '\n'};
+static const uint32_t ast_byte_order = 0x01020304;
+// Away from the heap, the binary and the libraries of a 64 bit process
+static const uint64_t ast_base = sizeof(void*) == 8 ? 0x5c0000000000ull : 0x50000000ull;
+
+static uint64_t add_object(const size_t& size, const size_t& align, ast_image* image);
+static uint64_t add_tokens(const con_token_list& tokens, ast_image* image);
+static uint64_t add_token(const con_token* token, ast_image* image);
+static void set_string(con_strview* field, const con_strview& str, const void* object, const uint64_t& at,
+                       ast_image* image);
+template <typename T>
+static void set_list(con_list<T>* field, const uint64_t& target, const uint32_t& size);
+static void set_pointer(const uint64_t& at, const uint64_t& target, ast_image* image);
+static bool valid_header(const con_ast_header& header, const size_t& size);
+static bool move_tokens(con_token_list* tokens, const ast_mapping& mapping, uint64_t* next);
+static bool move_token(con_token* token, const ast_mapping& mapping, uint64_t* next);
+template <typename T>
+static bool move_list(con_list<T>* list, const ast_mapping& mapping, uint64_t* next = nullptr);
+static bool move_pointer(void* field, const uint64_t& bytes, const size_t& align, const ast_mapping& mapping,
+                         uint64_t* next = nullptr);
+template <typename E>
+static bool valid_enum(const E& value, const E& last);
+
+bool con_is_ast(con_strview data) {
+  return data.size >= sizeof(ast_magic) && memcmp(data.data, ast_magic, sizeof(ast_magic)) == 0;
+}
+
+void write_ast(const con_token_list& tokens, const uint64_t& lines, con_emitter* emitter) {
+  ast_image image;
+  add_object(sizeof(con_ast_header), alignof(con_ast_header), &image);
+  const uint64_t root = add_object(sizeof(con_token_list), alignof(con_token_list), &image);
+  con_token_list root_list;
+  set_list(&root_list, add_tokens(tokens, &image), tokens.size());
+  memcpy(&image.objects[root], &root_list, sizeof(root_list));
+
+  const uint64_t strings = add_object(image.strings.size(), 1, &image);
+  for (vector<uint64_t>::const_iterator it = image.string_relocs.cbegin(); it != image.string_relocs.cend(); ++it) {
+    uintptr_t value;
+    memcpy(&value, &image.objects[*it], sizeof(value));
+    value += ast_base+strings;
+    memcpy(&image.objects[*it], &value, sizeof(value));
+  }
+  memcpy(&image.objects[strings], image.strings.data(), image.strings.size());
+
+  con_ast_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ast_magic, sizeof(ast_magic));
+  header.version = CON_AST_VERSION;
+  header.pointer_size = sizeof(void*);
+  header.token_size = sizeof(con_token);
+  header.byte_order = ast_byte_order;
+  header.lines = lines;
+  header.base = ast_base;
+  header.root = root;
+  header.size = image.objects.size();
+  memcpy(&image.objects[0], &header, sizeof(header));
+  emitter->write(con_strview(image.objects));
+}
+
+con_ast::~con_ast() {
+  close();
+}
+
+int con_ast::open(const std::string& path, const bool& populate) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  con_ast_header header;
+  if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+      || !valid_header(header, st.st_size)) {
+    ::close(fd);
+    return -1;
+  }
+  const int flags = MAP_PRIVATE | (populate ? MAP_POPULATE : 0);
+  void* mapping = mmap(reinterpret_cast<void*>(header.base), st.st_size, PROT_READ | PROT_WRITE,
+                       flags | MAP_FIXED_NOREPLACE, fd, 0);
+  if (mapping == MAP_FAILED) {
+    mapping = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+  }
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return -1;
+  }
+  data_ = static_cast<char*>(mapping);
+  size_ = st.st_size;
+  root_ = reinterpret_cast<con_token_list*>(data_+header.root);
+  const ast_mapping moved = {static_cast<uintptr_t>(header.base), reinterpret_cast<uintptr_t>(data_), header.size};
+  uint64_t next = header.root+sizeof(con_token_list);
+  if (!move_tokens(root_, moved, &next)) {
+    close();
+    return -1;
+  }
+  lines_ = header.lines;
+  return 0;
+}
+
+void con_ast::close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  root_ = nullptr;
+  lines_ = 0;
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+// Appends size zero bytes at the next multiple of align and returns their offset
+uint64_t add_object(const size_t& size, const size_t& align, ast_image* image) {
+  const uint64_t at = (image->objects.size()+align-1)/align*align;
+  image->objects.resize(at+size, '\0');
+  return at;
+}
+
+// Adds the array of token pointers and the tokens, returns the offset of the array
+uint64_t add_tokens(const con_token_list& tokens, ast_image* image) {
+  if (tokens.empty()) {
+    return 0;
+  }
+  const uint64_t array = add_object(tokens.size()*sizeof(con_token*), alignof(con_token*), image);
+  for (uint32_t i = 0; i < tokens.size(); ++i) {
+    const uint64_t token = add_token(tokens[i], image);
+    set_pointer(array+i*sizeof(con_token*), token, image);
+  }
+  return array;
+}
+
+// The token is built field by field in a zeroed copy, so no padding or stale union bytes reach the file
+uint64_t add_token(const con_token* token, ast_image* image) {
+  const uint64_t at = add_object(sizeof(con_token), alignof(con_token), image);
+  alignas(con_token) char buffer[sizeof(con_token)];
+  memset(buffer, 0, sizeof(buffer));
+  con_token* copy = reinterpret_cast<con_token*>(buffer);
+  copy->tok_type = token->tok_type;
+  copy->indentation = token->indentation;
+  const uint64_t children = add_tokens(token->tokens, image);
+  set_list(&copy->tokens, children, token->tokens.size());
+
+  switch (token->tok_type) {
+    case SECTION:
+      set_string(&copy->tok_section.name, token->tok_section.name, copy, at, image);
+      break;
+    case TAG:
+      set_string(&copy->tok_tag.name, token->tok_tag.name, copy, at, image);
+      break;
+    case WHILE:
+    case IF: {
+      const _con_condition& condition = token->tok_type == WHILE ? token->tok_while.condition
+                                                                 : token->tok_if.condition;
+      _con_condition& copy_condition = token->tok_type == WHILE ? copy->tok_while.condition
+                                                                : copy->tok_if.condition;
+      copy_condition.op = condition.op;
+      set_string(&copy_condition.arg1, condition.arg1, copy, at, image);
+      set_string(&copy_condition.arg2, condition.arg2, copy, at, image);
+      break;
+    }
+    case FUNCTION: {
+      const con_list<_con_arg>& args = token->tok_function.arguments;
+      set_string(&copy->tok_function.name, token->tok_function.name, copy, at, image);
+      uint64_t array = 0;
+      if (!args.empty()) {
+        array = add_object(args.size()*sizeof(_con_arg), alignof(_con_arg), image);
+        for (uint32_t i = 0; i < args.size(); ++i) {
+          alignas(_con_arg) char arg_buffer[sizeof(_con_arg)];
+          memset(arg_buffer, 0, sizeof(arg_buffer));
+          _con_arg* arg = reinterpret_cast<_con_arg*>(arg_buffer);
+          const uint64_t arg_at = array+i*sizeof(_con_arg);
+          arg->length = args[i].length;
+          set_string(&arg->name, args[i].name, arg, arg_at, image);
+          memcpy(&image->objects[arg_at], arg_buffer, sizeof(arg_buffer));
+        }
+      }
+      set_list(&copy->tok_function.arguments, array, args.size());
+      break;
+    }
+    case CMD:
+      set_string(&copy->tok_cmd.command, token->tok_cmd.command, copy, at, image);
+      set_string(&copy->tok_cmd.arg1, token->tok_cmd.arg1, copy, at, image);
+      set_string(&copy->tok_cmd.arg2, token->tok_cmd.arg2, copy, at, image);
+      break;
+    case MACRO:
+      set_string(&copy->tok_macro.value, token->tok_macro.value, copy, at, image);
+      set_string(&copy->tok_macro.macro, token->tok_macro.macro, copy, at, image);
+      break;
+    case FUNCALL:
+    case SYSCALL: {
+      const con_list<con_strview>& args = token->tok_type == FUNCALL ? token->tok_funcall.arguments
+                                                                     : token->tok_syscall.arguments;
+      if (token->tok_type == FUNCALL) {
+        set_string(&copy->tok_funcall.funcname, token->tok_funcall.funcname, copy, at, image);
+      } else {
+        copy->tok_syscall.number = token->tok_syscall.number;
+      }
+      uint64_t array = 0;
+      if (!args.empty()) {
+        array = add_object(args.size()*sizeof(con_strview), alignof(con_strview), image);
+        for (uint32_t i = 0; i < args.size(); ++i) {
+          con_strview arg;
+          const uint64_t arg_at = array+i*sizeof(con_strview);
+          set_string(&arg, args[i], &arg, arg_at, image);
+          memcpy(&image->objects[arg_at], &arg, sizeof(arg));
+        }
+      }
+      set_list(token->tok_type == FUNCALL ? &copy->tok_funcall.arguments : &copy->tok_syscall.arguments,
+               array, args.size());
+      break;
+    }
+    case DATA:
+      set_string(&copy->tok_data.line, token->tok_data.line, copy, at, image);
+      break;
+  }
+  memcpy(&image->objects[at], buffer, sizeof(buffer));
+  return at;
+}
+
+// field lies in object, a local copy of what is written at offset at. The pointer is the first
+// member of con_strview and con_list
+void set_string(con_strview* field, const con_strview& str, const void* object, const uint64_t& at,
+                ast_image* image) {
+  if (str.empty()) {
+    *field = con_strview();
+    return;
+  }
+  const string key = str.str();
+  unordered_map<string, uint64_t>::const_iterator found = image->interned.find(key);
+  uint64_t offset;
+  if (found != image->interned.cend()) {
+    offset = found->second;
+  } else {
+    offset = image->strings.size();
+    image->strings += str;
+    image->interned.emplace(key, offset);
+  }
+  *field = con_strview(reinterpret_cast<const char*>(static_cast<uintptr_t>(offset)), str.size);
+  image->string_relocs.push_back(at+(reinterpret_cast<const char*>(field)-static_cast<const char*>(object)));
+}
+template <typename T>
+void set_list(con_list<T>* field, const uint64_t& target, const uint32_t& size) {
+  if (size == 0) {
+    *field = con_list<T>();
+    return;
+  }
+  *field = con_list<T>(reinterpret_cast<T*>(static_cast<uintptr_t>(ast_base+target)), size);
+}
+void set_pointer(const uint64_t& at, const uint64_t& target, ast_image* image) {
+  const uintptr_t value = ast_base+target;
+  memcpy(&image->objects[at], &value, sizeof(value));
+}
+
+bool valid_header(const con_ast_header& header, const size_t& size) {
+  return memcmp(header.magic, ast_magic, sizeof(ast_magic)) == 0 && header.version == CON_AST_VERSION
+         && header.pointer_size == sizeof(void*) && header.token_size == sizeof(con_token)
+         && header.byte_order == ast_byte_order && header.base % 4096 == 0
+         && header.root % alignof(con_token_list) == 0 && header.root >= sizeof(header)
+         && header.size <= size && header.root+sizeof(con_token_list) <= header.size;
+}
+
+// The moves below check every pointer against the image and every enum while they walk it. The
+// token arrays and tokens have to come in the order write_ast lays them out, each one after the
+// ones before it in a walk of the tree, so no token is reached twice and no list loops back. next
+// is the offset the next one may start at
+bool move_tokens(con_token_list* tokens, const ast_mapping& mapping, uint64_t* next) {
+  if (!move_list(tokens, mapping, next)) {
+    return false;
+  }
+  for (con_token_list::iterator it = tokens->begin(); it != tokens->end(); ++it) {
+    if (!move_pointer(&*it, sizeof(con_token), alignof(con_token), mapping, next)
+        || !move_token(*it, mapping, next)) {
+      return false;
+    }
+  }
+  return true;
+}
+bool move_token(con_token* token, const ast_mapping& mapping, uint64_t* next) {
+  if (!move_tokens(&token->tokens, mapping, next)) {
+    return false;
+  }
+  switch (token->tok_type) {
+    case SECTION:
+      return move_pointer(&token->tok_section.name, token->tok_section.name.size, 1, mapping);
+    case TAG:
+      return move_pointer(&token->tok_tag.name, token->tok_tag.name.size, 1, mapping);
+    case WHILE:
+    case IF: {
+      _con_condition& condition = token->tok_type == WHILE ? token->tok_while.condition : token->tok_if.condition;
+      return valid_enum(condition.op, GE) && move_pointer(&condition.arg1, condition.arg1.size, 1, mapping)
+             && move_pointer(&condition.arg2, condition.arg2.size, 1, mapping);
+    }
+    case FUNCTION: {
+      con_list<_con_arg>& args = token->tok_function.arguments;
+      if (!move_pointer(&token->tok_function.name, token->tok_function.name.size, 1, mapping)
+          || !move_list(&args, mapping)) {
+        return false;
+      }
+      for (con_list<_con_arg>::iterator it = args.begin(); it != args.end(); ++it) {
+        if (!valid_enum(it->length, BIT64) || !move_pointer(&it->name, it->name.size, 1, mapping)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case CMD:
+      return move_pointer(&token->tok_cmd.command, token->tok_cmd.command.size, 1, mapping)
+             && move_pointer(&token->tok_cmd.arg1, token->tok_cmd.arg1.size, 1, mapping)
+             && move_pointer(&token->tok_cmd.arg2, token->tok_cmd.arg2.size, 1, mapping);
+    case MACRO:
+      return move_pointer(&token->tok_macro.value, token->tok_macro.value.size, 1, mapping)
+             && move_pointer(&token->tok_macro.macro, token->tok_macro.macro.size, 1, mapping);
+    case FUNCALL:
+    case SYSCALL: {
+      con_list<con_strview>& args = token->tok_type == FUNCALL ? token->tok_funcall.arguments
+                                                               : token->tok_syscall.arguments;
+      if ((token->tok_type == FUNCALL
+           && !move_pointer(&token->tok_funcall.funcname, token->tok_funcall.funcname.size, 1, mapping))
+          || !move_list(&args, mapping)) {
+        return false;
+      }
+      for (con_list<con_strview>::iterator it = args.begin(); it != args.end(); ++it) {
+        if (!move_pointer(&*it, it->size, 1, mapping)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case DATA:
+      return move_pointer(&token->tok_data.line, token->tok_data.line.size, 1, mapping);
+  }
+  return false; // not a token type
+}
+// A list with room left would let an insert write past it into the image
+template <typename T>
+bool move_list(con_list<T>* list, const ast_mapping& mapping, uint64_t* next) {
+  return list->capacity() == list->size() && move_pointer(list, list->size()*sizeof(T), alignof(T), mapping, next);
+}
+// field is a con_strview or con_list, whose first member is the pointer to bytes bytes aligned to
+// align. Only empty ones may be null. With next they may not start before it, and it moves past them
+bool move_pointer(void* field, const uint64_t& bytes, const size_t& align, const ast_mapping& mapping,
+                  uint64_t* next) {
+  uintptr_t value;
+  memcpy(&value, field, sizeof(value));
+  if (value == 0) {
+    return bytes == 0;
+  }
+  if (value < mapping.base || value-mapping.base > mapping.size || bytes > mapping.size-(value-mapping.base)
+      || (value-mapping.base) % align != 0) {
+    return false;
+  }
+  if (next != nullptr) {
+    if (value-mapping.base < *next) {
+      return false;
+    }
+    *next = value-mapping.base+bytes;
+  }
+  if (mapping.data != mapping.base) { // a write copies the page
+    value += mapping.data-mapping.base;
+    memcpy(field, &value, sizeof(value));
+  }
+  return true;
+}
+// Reads the bytes, as a value out of range must not be loaded as an E
+template <typename E>
+bool valid_enum(const E& value, const E& last) {
+  uint32_t raw;
+  static_assert(sizeof(E) == sizeof(raw), "enum of unexpected size");
+  memcpy(&raw, &value, sizeof(raw));
+  return raw <= static_cast<uint32_t>(last);
+}
@@ -0,0 +1,60 @@
+#ifndef CONSTRUCT_AST_H_
+#define CONSTRUCT_AST_H_
+
+#include <cstdint>
+#include <string>
+#include "construct_types.h"
+
+class con_emitter;
+
+// Bump it whenever the token structs or what the parser produces change
+#define CON_AST_VERSION 1
+
+// Pre-parsed token tree. The file is an image of the tokens, lists and strings as they lie in memory,
+// with the pointers written for a fixed address. It is mapped copy-on-write at that address and used
+// as it is, after one walk over the tree that checks its pointers. When the address is taken, the walk
+// also moves them by the difference. Images are only read by builds with the same version, pointer
+// size, token layout and byte order.
+struct con_ast_header {
+  char magic[8];
+  uint32_t version;
+  uint16_t pointer_size;
+  uint16_t token_size;  // sizeof(con_token), with pointer_size a check of the layout
+  uint32_t byte_order;  // 0x01020304 as written
+  uint32_t reserved;
+  uint64_t lines;       // of the source
+  uint64_t base;        // address the pointers were written for
+  uint64_t root;        // offset of the top-level con_token_list
+  uint64_t size;        // of the image, pointers stay below base+size
+};
+
+// Whether data starts like a pre-parsed tree
+bool con_is_ast(con_strview data);
+
+// Writes tokens and everything they point to as an image to emitter. lines is the length of the source
+void write_ast(const con_token_list& tokens, const uint64_t& lines, con_emitter* emitter);
+
+// A mapped image. The tokens are private to this mapping and may be changed, as lowering does
+class con_ast {
+ public:
+  con_ast() = default;
+  con_ast(const con_ast&) = delete;
+  con_ast& operator=(const con_ast&) = delete;
+  ~con_ast();
+
+  // -1 when path can't be read or is no image this build can use. populate faults in the whole
+  // image at once, which is cheaper than page by page for callers that go on to change all of it
+  int open(const std::string& path, const bool& populate = false);
+  void close();
+
+  con_token_list& tokens() { return *root_; }
+  uint64_t lines() const { return lines_; }
+
+ private:
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  con_token_list* root_ = nullptr;
+  uint64_t lines_ = 0;
+};
+
+#endif // CONSTRUCT_AST_H_
@@ -0,0 +1,125 @@
+#include <string>
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+#include "construct_cache.h"
+#include "construct_emitter.h"
+#include "construct_hash.h"
+#include "construct_input.h"
+
+using namespace std;
+
+static uint64_t hash_token(const con_token& token, uint64_t hash);
+static uint64_t hash_args(const con_list<con_strview>& args, uint64_t hash);
+
+uint64_t con_cache_key(const con_token& token, const CON_BITWIDTH& bitwidth, const bool& optimize,
+                       const uint64_t& macro_hash, const uint64_t& function_hash) {
+  // optimize shares the word of bitwidth, so keys without it stay what they were
+  const uint64_t target = static_cast<uint64_t>(bitwidth) | static_cast<uint64_t>(optimize) << 8;
+  const uint64_t header[3] = {CON_CACHE_VERSION, target, macro_hash};
+  uint64_t hash = con_hash64(header, sizeof(header));
+  if (function_hash != 0) { // the same way, only for the functions that depend on it
+    hash = con_hash64(&function_hash, sizeof(function_hash), hash);
+  }
+  return hash_token(token, hash);
+}
+
+con_cache::con_cache(const std::string& dir) : dir_(dir) {}
+
+int con_cache::open() {
+  if (mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  return 0;
+}
+
+int con_cache::load(const uint64_t& key, std::string* text) const {
+  con_input entry;
+  if (entry.open(entry_path(key)) != 0) {
+    return -1;
+  }
+  con_strview view = entry.view();
+  text->assign(view.data, view.size);
+  return 0;
+}
+
+int con_cache::store(const uint64_t& key, const std::string& text) const {
+  con_emitter entry(0);
+  if (entry.open_replacing(entry_path(key)) != 0) {
+    return -1;
+  }
+  entry.write(con_strview(text));
+  return entry.close();
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+std::string con_cache::entry_path(const uint64_t& key) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+  return dir_+"/"+name+".asm";
+}
+
+uint64_t hash_token(const con_token& token, uint64_t hash) {
+  const int32_t header[2] = {token.tok_type, token.indentation};
+  hash = con_hash64(header, sizeof(header), hash);
+  switch (token.tok_type) {
+    case SECTION:
+      hash = con_hash64(token.tok_section.name, hash);
+      break;
+    case TAG:
+      hash = con_hash64(token.tok_tag.name, hash);
+      break;
+    case WHILE:
+    case IF: {
+      const _con_condition& condition = token.tok_type == WHILE ? token.tok_while.condition
+                                                                : token.tok_if.condition;
+      const int32_t op = condition.op;
+      hash = con_hash64(&op, sizeof(op), hash);
+      hash = con_hash64(condition.arg1, hash);
+      hash = con_hash64(condition.arg2, hash);
+      break;
+    }
+    case FUNCTION:
+      hash = con_hash64(token.tok_function.name, hash);
+      for (con_list<_con_arg>::const_iterator c_it = token.tok_function.arguments.cbegin();
+           c_it != token.tok_function.arguments.cend(); ++c_it) {
+        const int32_t length = c_it->length;
+        hash = con_hash64(&length, sizeof(length), con_hash64(c_it->name, hash));
+      }
+      break;
+    case CMD:
+      hash = con_hash64(token.tok_cmd.command, hash);
+      hash = con_hash64(token.tok_cmd.arg1, hash);
+      hash = con_hash64(token.tok_cmd.arg2, hash);
+      break;
+    case MACRO:
+      hash = con_hash64(token.tok_macro.macro, hash);
+      hash = con_hash64(token.tok_macro.value, hash);
+      break;
+    case FUNCALL:
+      hash = hash_args(token.tok_funcall.arguments, con_hash64(token.tok_funcall.funcname, hash));
+      break;
+    case SYSCALL:
+      hash = hash_args(token.tok_syscall.arguments,
+                       con_hash64(&token.tok_syscall.number, sizeof(token.tok_syscall.number), hash));
+      break;
+    case DATA:
+      hash = con_hash64(token.tok_data.line, hash);
+      break;
+  }
+  const uint64_t children = token.tokens.size();
+  hash = con_hash64(&children, sizeof(children), hash);
+  for (con_token_list::const_iterator c_it = token.tokens.cbegin(); c_it != token.tokens.cend(); ++c_it) {
+    hash = hash_token(**c_it, hash);
+  }
+  return hash;
+}
+uint64_t hash_args(const con_list<con_strview>& args, uint64_t hash) {
+  const uint64_t amnt = args.size();
+  hash = con_hash64(&amnt, sizeof(amnt), hash);
+  for (con_list<con_strview>::const_iterator c_it = args.cbegin(); c_it != args.cend(); ++c_it) {
+    hash = con_hash64(*c_it, hash);
+  }
+  return hash;
+}
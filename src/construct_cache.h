@@ -0,0 +1,33 @@
+#ifndef CONSTRUCT_CACHE_H_
+#define CONSTRUCT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include "construct_types.h"
+
+// Part of every cache key, bump it whenever lowering changes its output
+#define CON_CACHE_VERSION 1
+
+// Identifies the lowered text of a top-level function: its whole subtree, the target, whether it
+// was optimized, the version, the top-level macros it can see (macro_hash, see con_token_start) and
+// for functions with auto macros, the functions they can call (function_hash of con_context, 0 otherwise)
+uint64_t con_cache_key(const con_token& token, const CON_BITWIDTH& bitwidth, const bool& optimize,
+                       const uint64_t& macro_hash, const uint64_t& function_hash = 0);
+
+// Directory of lowered function texts, one file per key. Entries are written to a temporary file
+// and renamed into place, so concurrent compilations never see a partial entry.
+class con_cache {
+ public:
+  explicit con_cache(const std::string& dir);
+
+  int open();
+  int load(const uint64_t& key, std::string* text) const;
+  int store(const uint64_t& key, const std::string& text) const;
+
+ private:
+  std::string entry_path(const uint64_t& key) const;
+
+  std::string dir_;
+};
+
+#endif // CONSTRUCT_CACHE_H_
@@ -0,0 +1,257 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "construct_cfg.h"
+#include "construct_elf.h"
+#include "construct_stats.h"
+
+using namespace std;
+
+static bool ends_block(const vector<con_token*>& code, const uint32_t& begin, const uint32_t& i);
+static bool is_exit_syscall(const vector<con_token*>& code, const uint32_t& begin, uint32_t i);
+static void mark_referenced_labels(con_cfg* cfg);
+static uint32_t last_token(const con_cfg& cfg, const con_block& block);
+static bool is_identifier_char(const char& c);
+
+void build_cfg(const con_token_list& tokens, con_cfg* cfg) {
+  cfg->code.clear();
+  cfg->code.reserve(tokens.size());
+  for (con_token_list::const_iterator c_it = tokens.cbegin(); c_it != tokens.cend(); ++c_it) {
+    const CON_TOKENTYPE type = (*c_it)->tok_type;
+    if (type == SECTION || type == TAG || type == CMD || type == DATA) {
+      cfg->code.push_back(*c_it);
+    }
+  }
+  build_blocks(cfg);
+}
+
+void build_blocks(con_cfg* cfg) {
+  const vector<con_token*>& code = cfg->code;
+  cfg->blocks.clear();
+  cfg->labels.clear();
+  // A block starts at a label or section and ends after a jump, ret or exit
+  bool open = false;
+  for (uint32_t i = 0; i < code.size(); ++i) {
+    const con_token* token = code[i];
+    if (token == nullptr) {
+      continue;
+    }
+    if (open && (token->tok_type == TAG || token->tok_type == SECTION)) {
+      cfg->blocks.back().end = i;
+      open = false;
+    }
+    if (!open) {
+      cfg->blocks.push_back(con_block());
+      cfg->blocks.back().begin = i;
+      cfg->blocks.back().entry = cfg->blocks.size() == 1 || token->tok_type == SECTION;
+      open = true;
+    }
+    con_block& block = cfg->blocks.back();
+    if (token->tok_type == TAG) {
+      cfg->labels[token->tok_tag.name] = cfg->blocks.size()-1;
+      block.entry = block.entry || !token->tok_tag.generated;
+    } else if (token->tok_type == DATA) {
+      block.entry = true;
+    } else if (token->tok_type == CMD && ends_block(code, block.begin, i)) {
+      block.end = i+1;
+      open = false;
+    }
+  }
+  if (open) {
+    cfg->blocks.back().end = code.size();
+  }
+  mark_referenced_labels(cfg);
+
+  for (uint32_t b = 0; b < cfg->blocks.size(); ++b) {
+    con_block& block = cfg->blocks[b];
+    const uint32_t last = last_token(*cfg, block);
+    const con_token* token = last == code.size() ? nullptr : code[last];
+    const bool jump = token != nullptr && is_jump(token);
+    const bool falls_through = token == nullptr || token->tok_type != CMD
+                               || !(token->tok_cmd.command == "jmp" || token->tok_cmd.command == "ret"
+                                    || is_exit_syscall(code, block.begin, last));
+    if (falls_through && b+1 < cfg->blocks.size()) {
+      block.successors.push_back(b+1);
+    }
+    if (jump) {
+      unordered_map<con_strview, uint32_t, con_strview_hash>::const_iterator target =
+          cfg->labels.find(token->tok_cmd.arg1);
+      if (target != cfg->labels.end() && (block.successors.empty() || block.successors[0] != target->second)) {
+        block.successors.push_back(target->second);
+      }
+    }
+    for (vector<uint32_t>::const_iterator s_it = block.successors.cbegin(); s_it != block.successors.cend(); ++s_it) {
+      cfg->blocks[*s_it].predecessors.push_back(b);
+    }
+  }
+}
+
+void cfg_to_tokens(const con_cfg& cfg, con_token_list* tokens, con_arena* arena) {
+  tokens->clear();
+  for (vector<con_token*>::const_iterator c_it = cfg.code.cbegin(); c_it != cfg.code.cend(); ++c_it) {
+    if (*c_it != nullptr) {
+      tokens->push_back(arena, *c_it);
+    }
+  }
+}
+
+bool remove_unreachable(con_cfg* cfg, con_counters* counters) {
+  vector<bool> reached(cfg->blocks.size(), false);
+  vector<uint32_t> pending;
+  for (uint32_t b = 0; b < cfg->blocks.size(); ++b) {
+    if (cfg->blocks[b].entry) {
+      reached[b] = true;
+      pending.push_back(b);
+    }
+  }
+  while (!pending.empty()) {
+    const con_block& block = cfg->blocks[pending.back()];
+    pending.pop_back();
+    for (vector<uint32_t>::const_iterator s_it = block.successors.cbegin(); s_it != block.successors.cend(); ++s_it) {
+      if (!reached[*s_it]) {
+        reached[*s_it] = true;
+        pending.push_back(*s_it);
+      }
+    }
+  }
+
+  bool changed = false;
+  for (uint32_t b = 0; b < cfg->blocks.size(); ++b) {
+    if (reached[b]) {
+      continue;
+    }
+    for (uint32_t i = cfg->blocks[b].begin; i < cfg->blocks[b].end; ++i) {
+      con_token*& token = cfg->code[i];
+      if (token == nullptr) {
+        continue;
+      }
+      if (token->tok_type == CMD && counters != nullptr) {
+        ++counters->peephole_unreachable;
+        const int size = x86_insn_size(token->tok_cmd);
+        counters->peephole_unreachable_bytes += size > 0 ? size : 0;
+        counters->peephole_rets_removed += token->tok_cmd.command == "ret";
+      }
+      token = nullptr; // only construct's labels, the others make blocks entries
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool chain_branches(con_cfg* cfg, con_counters* counters) {
+  bool changed = false;
+  for (uint32_t b = 0; b < cfg->blocks.size(); ++b) {
+    const uint32_t last = last_token(*cfg, cfg->blocks[b]);
+    if (last == cfg->code.size() || !is_jump(cfg->code[last])) {
+      continue;
+    }
+    con_cmd& jump = cfg->code[last]->tok_cmd;
+    // Follow labels that lead to a jmp, a few hops at most so that cycles end
+    const con_strview first_target = jump.arg1;
+    for (int hops = 0; hops < 8; ++hops) {
+      unordered_map<con_strview, uint32_t, con_strview_hash>::const_iterator target = cfg->labels.find(jump.arg1);
+      if (target == cfg->labels.end()) {
+        break;
+      }
+      const uint32_t next = first_instruction(*cfg, target->second);
+      if (next == cfg->code.size() || next == last) {
+        break;
+      }
+      const con_cmd& next_cmd = cfg->code[next]->tok_cmd;
+      if (next_cmd.command == "ret" && jump.command == "jmp") {
+        jump = next_cmd;
+        changed = true;
+        if (counters != nullptr) {
+          ++counters->peephole_jumps_to_ret;
+        }
+        break;
+      }
+      if (next_cmd.command != "jmp" || next_cmd.arg1 == jump.arg1 || cfg->labels.count(next_cmd.arg1) == 0) {
+        break;
+      }
+      jump.arg1 = next_cmd.arg1;
+    }
+    if (jump.command != "ret" && jump.arg1 != first_target) {
+      changed = true;
+      if (counters != nullptr) {
+        ++counters->peephole_jumps_threaded;
+      }
+    }
+  }
+  return changed;
+}
+
+uint32_t first_instruction(const con_cfg& cfg, uint32_t block) {
+  for (; block < cfg.blocks.size(); ++block) {
+    for (uint32_t i = cfg.blocks[block].begin; i < cfg.blocks[block].end; ++i) {
+      const con_token* token = cfg.code[i];
+      if (token == nullptr || token->tok_type == TAG) {
+        continue;
+      }
+      return token->tok_type == CMD ? i : cfg.code.size();
+    }
+    // Only labels, it falls through to the next block
+  }
+  return cfg.code.size();
+}
+
+bool is_jump(const con_token* token) {
+  return token->tok_type == CMD && token->tok_cmd.command.size >= 2 && token->tok_cmd.command[0] == 'j'
+         && !token->tok_cmd.arg1.empty() && token->tok_cmd.arg2.empty();
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+bool ends_block(const vector<con_token*>& code, const uint32_t& begin, const uint32_t& i) {
+  const con_token* token = code[i];
+  return is_jump(token) || token->tok_cmd.command == "ret" || is_exit_syscall(code, begin, i);
+}
+// syscall right after mov rax, 60 or 231, as syscall exit() and exit_group() are lowered
+bool is_exit_syscall(const vector<con_token*>& code, const uint32_t& begin, uint32_t i) {
+  if (code[i]->tok_type != CMD || code[i]->tok_cmd.command != "syscall") {
+    return false;
+  }
+  while (i > begin && code[i-1] == nullptr) {
+    --i;
+  }
+  if (i == begin || code[i-1]->tok_type != CMD) {
+    return false;
+  }
+  const con_cmd& mov = code[i-1]->tok_cmd;
+  return mov.command == "mov" && (mov.arg1 == "rax" || mov.arg1 == "eax") && (mov.arg2 == "60" || mov.arg2 == "231");
+}
+// A label used other than as a jump target, say its address loaded, can be reached from anywhere
+void mark_referenced_labels(con_cfg* cfg) {
+  for (vector<con_token*>::const_iterator c_it = cfg->code.cbegin(); c_it != cfg->code.cend(); ++c_it) {
+    if (*c_it == nullptr || (*c_it)->tok_type != CMD || is_jump(*c_it)) {
+      continue;
+    }
+    const con_strview args[2] = {(*c_it)->tok_cmd.arg1, (*c_it)->tok_cmd.arg2};
+    for (int a = 0; a < 2; ++a) {
+      for (size_t pos = 0; pos < args[a].size;) {
+        size_t end = pos;
+        while (end < args[a].size && is_identifier_char(args[a][end])) {
+          ++end;
+        }
+        unordered_map<con_strview, uint32_t, con_strview_hash>::const_iterator label =
+            cfg->labels.find(args[a].substr(pos, end-pos));
+        if (end > pos && label != cfg->labels.end()) {
+          cfg->blocks[label->second].entry = true;
+        }
+        pos = end+1;
+      }
+    }
+  }
+}
+uint32_t last_token(const con_cfg& cfg, const con_block& block) {
+  for (uint32_t i = block.end; i > block.begin; --i) {
+    if (cfg.code[i-1] != nullptr) {
+      return i-1;
+    }
+  }
+  return cfg.code.size();
+}
+bool is_identifier_char(const char& c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.'
+         || c == '$' || c == '@' || c == '?';
+}
@@ -0,0 +1,50 @@
+#ifndef CONSTRUCT_CFG_H_
+#define CONSTRUCT_CFG_H_
+
+#include <vector>
+#include <unordered_map>
+#include "construct_types.h"
+#include "construct_hash.h"
+
+struct con_counters;
+
+// A run of tokens that is only entered at its start and only left after its last instruction
+struct con_block {
+  uint32_t begin = 0; // index of its first token in con_cfg::code
+  uint32_t end = 0;   // one past its last token
+  std::vector<uint32_t> successors;   // blocks, the one it falls through to first
+  std::vector<uint32_t> predecessors;
+  bool entry = false; // reachable from outside the tokens: the first block, sections, data and
+                      // labels lowering did not generate (function names, labels in the source)
+};
+
+// Control flow graph of the lowered, linearized nasm of one top-level token. Jumps to labels that
+// are not in the tokens, calls and syscalls continue with the next block, except for the exit
+// syscalls. The passes below set the tokens they remove to null, build_blocks has to be called
+// again afterwards
+struct con_cfg {
+  std::vector<con_token*> code; // the tokens nasm is written from, in order
+  std::vector<con_block> blocks;
+  std::unordered_map<con_strview, uint32_t, con_strview_hash> labels; // block starting at a label
+};
+
+// Takes the SECTION, TAG, CMD and DATA tokens, the others are not written out, and builds the blocks
+void build_cfg(const con_token_list& tokens, con_cfg* cfg);
+void build_blocks(con_cfg* cfg);
+// Writes the tokens that were not removed back to tokens
+void cfg_to_tokens(const con_cfg& cfg, con_token_list* tokens, con_arena* arena);
+
+// Blocks no entry block leads to, which only the labels of ifs and whiles start, are removed.
+// Returns whether anything was
+bool remove_unreachable(con_cfg* cfg, con_counters* counters = nullptr);
+// Jumps to a jmp go to its target, jmps to a ret become that ret. Returns whether anything changed
+bool chain_branches(con_cfg* cfg, con_counters* counters = nullptr);
+
+// Index of the first instruction running at the start of block, past labels and empty blocks.
+// code.size() when a section, data or the end of the code comes first
+uint32_t first_instruction(const con_cfg& cfg, uint32_t block);
+
+// jmp, jcc and the like with a label, the only operand they can have here
+bool is_jump(const con_token* token);
+
+#endif // CONSTRUCT_CFG_H_
@@ -0,0 +1,83 @@
+#include <string>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Sends its arguments to a construct server (construct -s SOCKET) and prints the reply:
+//   construct_client SOCKET -f elf64 -i file.con -o file.asm
+//   construct_client SOCKET stop
+
+static int connect_server(const char* socket_path);
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cout << "usage: " << argv[0] << " SOCKET (construct flags | stop)" << std::endl;
+    return 1;
+  }
+  int fd = connect_server(argv[1]);
+  if (fd < 0) {
+    std::cout << "Could not connect to \"" << argv[1] << "\"" << std::endl;
+    return 1;
+  }
+  std::string request;
+  for (int i = 2; i < argc; ++i) {
+    request.append(argv[i], strlen(argv[i])+1);
+  }
+  for (size_t written = 0; written < request.size(); ) {
+    ssize_t amnt = write(fd, request.data()+written, request.size()-written);
+    if (amnt < 0 && errno != EINTR) {
+      std::cout << "Could not send request" << std::endl;
+      close(fd);
+      return 1;
+    }
+    written += amnt < 0 ? 0 : amnt;
+  }
+  shutdown(fd, SHUT_WR);
+
+  std::string reply;
+  char buffer[4096];
+  for (;;) {
+    ssize_t amnt = read(fd, buffer, sizeof(buffer));
+    if (amnt < 0 && errno == EINTR) continue;
+    if (amnt <= 0) break;
+    reply.append(buffer, amnt);
+  }
+  close(fd);
+  if (reply.empty()) {
+    std::cout << "No reply from server" << std::endl;
+    return 1;
+  }
+  std::cout << reply.substr(1) << std::flush;
+  return reply[0] == '0' ? 0 : 1;
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+// Retries for a second, so a client can be started right after the server
+int connect_server(const char* socket_path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_path);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+      return fd;
+    }
+    close(fd);
+    if (errno != ENOENT && errno != ECONNREFUSED) {
+      return -1;
+    }
+    usleep(10000);
+  }
+  return -1;
+}
@@ -0,0 +1,286 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include "construct_compile.h"
+#include "construct_arena.h"
+#include "construct_ast.h"
+#include "construct_cache.h"
+#include "construct_elf.h"
+#include "construct_emitter.h"
+#include "construct_input.h"
+#include "construct_module.h"
+#include "construct_peephole.h"
+#include "construct_regalloc.h"
+#include "construct_threads.h"
+#include "deconstruct.h"
+#include "reconstruct.h"
+
+static void emit_token(con_token* token, const con_context& globals, const con_token_start& start,
+                       const con_cache* cache, std::string* text, con_stats* stats);
+static double seconds_since(const std::chrono::steady_clock::time_point& start);
+static uint64_t count_lines(con_strview code);
+
+int compile_file(const std::string& path, const std::string& outpath, const con_options& options,
+                 const unsigned& jobs, const con_cache* cache, std::string* error, con_stats* stats,
+                 con_modules* modules) {
+  con_input input;
+  if (input.open(path) != 0) {
+    *error = "Could not read input file \""+path+"\"";
+    return -1;
+  }
+  con_emitter outfile;
+  if (outfile.open_replacing(outpath) != 0) {
+    *error = "Could not open output file \""+outpath+"\"";
+    return -1;
+  }
+  con_modules file_modules;
+  std::vector<const con_module*> imported;
+  try {
+    // Owns the tokens parsed or added by lowering, released once the file is written
+    con_arena arena;
+    con_ast ast;
+    con_token_list tokens;
+    uint64_t lines;
+    if (con_is_ast(input.view())) {
+      input.close();
+      con_stage_timer timer(arena, stats);
+      if (ast.open(path, !options.write_ast) != 0) { // lowering writes to every token
+        *error = "Could not read pre-parsed input file \""+path+"\"";
+        return -1;
+      }
+      tokens = ast.tokens();
+      lines = ast.lines();
+      timer.done(STAGE_PARSE, 0); // mapping the tree replaces parsing it
+    } else {
+      tokens = parse_tree(input.view(), &arena, stats);
+      lines = count_lines(input.view());
+    }
+    if (!options.write_ast) { // the tree keeps its imports, they are resolved when it is compiled
+      std::vector<con_strview> imports = take_imports(&tokens);
+      if (!imports.empty()) {
+        con_stage_timer timer(arena, stats);
+        imported = (modules == nullptr ? &file_modules : modules)->load(path, imports, jobs);
+        prepend_modules(imported, &tokens, &arena);
+        timer.done(STAGE_PARSE, 0);
+        for (std::vector<const con_module*>::const_iterator it = imported.cbegin(); it != imported.cend(); ++it) {
+          lines += (*it)->lines;
+        }
+      }
+    }
+    if (options.write_ast) {
+      write_ast(tokens, lines, &outfile);
+    } else if (options.write_object) {
+      std::string nasm;
+      con_emitter text;
+      text.open_text(&nasm);
+      compile_tree(tokens, &arena, options.bitwidth, options.optimize, jobs, cache, &text, stats);
+      text.close();
+      con_stage_timer timer(arena, stats);
+      assemble_elf64(con_strview(nasm), &outfile);
+      timer.done(STAGE_ASSEMBLE, 0);
+    } else {
+      compile_tree(tokens, &arena, options.bitwidth, options.optimize, jobs, cache, &outfile, stats);
+    }
+    if (stats != nullptr) {
+      ++stats->inputs;
+      stats->lines += lines;
+    }
+  }
+  catch (const std::exception& e) {
+    *error = path+": "+e.what();
+    return -1;
+  }
+  if (outfile.close() != 0) {
+    *error = "Could not write output file \""+outpath+"\"";
+    return -1;
+  }
+  if (options.write_depfile) {
+    con_emitter depfile(1 << 12);
+    if (depfile.open_replacing(outpath+".d") != 0) {
+      *error = "Could not open dependency file \""+outpath+".d\"";
+      return -1;
+    }
+    write_depfile(outpath, path, imported, &depfile);
+    if (depfile.close() != 0) {
+      *error = "Could not write dependency file \""+outpath+".d\"";
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void compile_code(con_strview code, const CON_BITWIDTH& bitwidth, const bool& optimize, const unsigned& jobs,
+                  const con_cache* cache, con_emitter* emitter, con_stats* stats) {
+  // Owns every token, payload and string of this compilation, released at once when it returns
+  con_arena arena;
+  con_token_list tokens = parse_tree(code, &arena, stats);
+  if (!take_imports(&tokens).empty()) {
+    throw std::invalid_argument("Imports can only be resolved when compiling files");
+  }
+  compile_tree(tokens, &arena, bitwidth, optimize, jobs, cache, emitter, stats);
+  if (stats != nullptr) {
+    ++stats->inputs;
+    stats->lines += count_lines(code);
+  }
+}
+
+con_token_list parse_tree(con_strview code, con_arena* arena, con_stats* stats) {
+  con_stage_timer timer(*arena, stats);
+  con_token_list tokens = parse_construct(code, arena);
+  timer.done(STAGE_PARSE, tokens.size());
+
+  tokens.insert(arena, tokens.begin(), make_global_start(arena));
+  tokens = delinearize_tokens(tokens, arena);
+  timer.done(STAGE_DELINEARIZE, tokens.size());
+  return tokens;
+}
+
+void compile_tree(con_token_list& tokens, con_arena* arena, const CON_BITWIDTH& bitwidth, const bool& optimize,
+                  const unsigned& jobs, const con_cache* cache, con_emitter* emitter, con_stats* stats) {
+  con_stage_timer timer(*arena, stats);
+  con_context globals;
+  globals.bitwidth = bitwidth;
+  globals.optimize = optimize;
+  globals.local_labels = cache != nullptr; // cached functions can't depend on the labels before them
+  std::vector<con_token_start> starts = plan_tokens(tokens, &globals, arena);
+  timer.done(STAGE_PLAN, starts.size());
+
+  emit_tokens(tokens, globals, starts, jobs, cache, emitter, stats);
+  if (stats != nullptr) {
+    stats->counters.add(globals.counters);
+  }
+}
+
+std::string batch_outpath(const std::string& path, const std::string& outdir, const std::string& extension) {
+  size_t name_start = path.find_last_of('/');
+  name_start = name_start == std::string::npos ? 0 : name_start+1;
+  size_t name_end = path.find_last_of('.');
+  if (name_end == std::string::npos || name_end < name_start) {
+    name_end = path.size();
+  }
+  return outdir+"/"+path.substr(name_start, name_end-name_start)+extension;
+}
+
+con_token* make_global_start(con_arena* arena) {
+  con_token* glob_tok = arena->make<con_token>(CMD);
+  glob_tok->tok_cmd.command = "global _start";
+  glob_tok->indentation = 0;
+  return glob_tok;
+}
+
+void emit_tokens(const con_token_list& tokens, const con_context& globals,
+                 const std::vector<con_token_start>& starts, const unsigned& jobs, const con_cache* cache,
+                 con_emitter* emitter, con_stats* stats) {
+  // A window is written out before the next one starts, so the output does not depend on jobs
+  const size_t window = std::min<size_t>(64*jobs, tokens.size());
+  std::vector<std::string> texts(window);
+  std::vector<std::exception_ptr> exceptions(window);
+  std::vector<con_stats> token_stats(stats == nullptr ? 0 : window); // summed up after each window
+  for (size_t first = 0; first < tokens.size(); first += window) {
+    const size_t amnt = std::min(window, tokens.size()-first);
+    con_parallel_for(amnt, jobs, [&](size_t i) {
+      try {
+        emit_token(tokens[first+i], globals, starts[first+i], cache, &texts[i],
+                   stats == nullptr ? nullptr : &token_stats[i]);
+      }
+      catch (...) {
+        exceptions[i] = std::current_exception();
+      }
+    });
+    for (size_t i = 0; i < amnt; ++i) {
+      if (exceptions[i]) {
+        std::rethrow_exception(exceptions[i]);
+      }
+      emitter->write(con_strview(texts[i]));
+      if (stats != nullptr) {
+        stats->add(token_stats[i]);
+        token_stats[i] = con_stats();
+      }
+    }
+  }
+}
+
+con_stage_timer::con_stage_timer(const con_arena& arena, con_stats* stats)
+    : arena_(arena), stats_(stats), start_(std::chrono::steady_clock::now()), allocations_(arena.allocations()),
+      bytes_(arena.bytes_used()) {}
+
+void con_stage_timer::done(const CON_STAGE& stage, const size_t& tokens) {
+  if (stats_ == nullptr) return;
+  stats_->stages[stage].seconds += seconds_since(start_);
+  stats_->stages[stage].tokens += tokens;
+  stats_->stages[stage].allocations += arena_.allocations()-allocations_;
+  stats_->stages[stage].bytes += arena_.bytes_used()-bytes_;
+  allocations_ = arena_.allocations();
+  bytes_ = arena_.bytes_used();
+  start_ = std::chrono::steady_clock::now();
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+void emit_token(con_token* token, const con_context& globals, const con_token_start& start,
+                const con_cache* cache, std::string* text, con_stats* stats) {
+  std::chrono::steady_clock::time_point lower_start;
+  if (stats != nullptr) {
+    lower_start = std::chrono::steady_clock::now();
+  }
+  const bool cached = cache != nullptr && token->tok_type == FUNCTION;
+  uint64_t key = 0;
+  if (cached) {
+    key = con_cache_key(*token, globals.bitwidth, globals.optimize, start.macro_hash,
+                        declares_auto_register(token) ? globals.function_hash : 0);
+    if (cache->load(key, text) == 0) {
+      if (stats != nullptr) {
+        ++stats->counters.cache_hits;
+        stats->stages[STAGE_LOWER].seconds += seconds_since(lower_start);
+        stats->stages[STAGE_EMIT].bytes += text->size();
+      }
+      return;
+    }
+  }
+
+  // Whatever lowering allocates is released with the token's text written, the token itself is
+  // left pointing into the released arena and must not be used again
+  con_arena arena(1 << 12);
+  con_token_list nasm_tokens;
+  reconstruct_token(token, globals, start, &nasm_tokens, &arena, stats == nullptr ? nullptr : &stats->counters);
+  if (globals.optimize) {
+    peephole_tokens(nasm_tokens, globals.bitwidth, &arena, stats == nullptr ? nullptr : &stats->counters);
+  }
+  std::chrono::steady_clock::time_point emit_start;
+  if (stats != nullptr) {
+    stats->stages[STAGE_LOWER].seconds += seconds_since(lower_start);
+    stats->stages[STAGE_LOWER].tokens += nasm_tokens.size();
+    stats->stages[STAGE_LOWER].allocations += arena.allocations();
+    stats->stages[STAGE_LOWER].bytes += arena.bytes_used();
+    emit_start = std::chrono::steady_clock::now();
+  }
+  text->clear();
+  con_emitter emitter(1 << 12);
+  emitter.open_text(text);
+  tokens_to_nasm(nasm_tokens, &emitter);
+  emitter.close();
+  if (stats != nullptr) {
+    stats->stages[STAGE_EMIT].seconds += seconds_since(emit_start);
+    stats->stages[STAGE_EMIT].tokens += nasm_tokens.size();
+    stats->stages[STAGE_EMIT].bytes += text->size();
+  }
+  if (cached) {
+    cache->store(key, *text); // a failed store only costs the next build the lowering
+    if (stats != nullptr) {
+      ++stats->counters.cache_misses;
+    }
+  }
+}
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+uint64_t count_lines(con_strview code) {
+  uint64_t lines = 0;
+  for (size_t pos = code.find('\n'); pos != con_strview::npos; pos = code.find('\n', pos+1)) {
+    ++lines;
+  }
+  return lines;
+}
@@ -0,0 +1,68 @@
+#ifndef CONSTRUCT_COMPILE_H_
+#define CONSTRUCT_COMPILE_H_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include "construct_types.h"
+#include "construct_context.h"
+#include "construct_flags.h"
+#include "construct_stats.h"
+
+class con_cache;
+class con_emitter;
+class con_modules;
+
+// Compiles the construct file (or pre-parsed tree, see construct_ast.h) at path to nasm at outpath,
+// splitting it up over jobs threads. With options.write_ast the tree is written instead, with
+// options.write_object the nasm is assembled to an ELF64 object. Imported files are taken from
+// modules, which the inputs of a build share, or parsed for this file alone when it is null.
+// cache and stats may be null. Returns 0, or -1 with the reason in error
+int compile_file(const std::string& path, const std::string& outpath, const con_options& options,
+                 const unsigned& jobs, const con_cache* cache, std::string* error, con_stats* stats = nullptr,
+                 con_modules* modules = nullptr);
+
+// Compiles code to nasm written to emitter, throws on errors and on imports, code has no path
+// they could be relative to. code is only read while parsing. optimize runs the peephole pass.
+// When stats is given, the time, tokens and allocations of every stage are added to it
+void compile_code(con_strview code, const CON_BITWIDTH& bitwidth, const bool& optimize, const unsigned& jobs,
+                  const con_cache* cache, con_emitter* emitter, con_stats* stats = nullptr);
+
+// Parses code to the tree compile_tree takes: the top-level tokens after the global _start line.
+// When stats is given, parse and delinearize are added to it
+con_token_list parse_tree(con_strview code, con_arena* arena, con_stats* stats = nullptr);
+
+// compile_code for a tree from parse_tree, which it changes. New tokens are allocated in arena
+void compile_tree(con_token_list& tokens, con_arena* arena, const CON_BITWIDTH& bitwidth, const bool& optimize,
+                  const unsigned& jobs, const con_cache* cache, con_emitter* emitter, con_stats* stats = nullptr);
+
+// Where batch mode writes input path: <outdir>/<input name><extension>
+std::string batch_outpath(const std::string& path, const std::string& outdir,
+                          const std::string& extension = ".asm");
+
+// The "global _start" line every output starts with
+con_token* make_global_start(con_arena* arena);
+
+// Lowers the planned top-level tokens in windows, the tokens of a window in parallel, and writes
+// them to emitter in source order. The tokens must not be used afterwards
+void emit_tokens(const con_token_list& tokens, const con_context& globals,
+                 const std::vector<con_token_start>& starts, const unsigned& jobs, const con_cache* cache,
+                 con_emitter* emitter, con_stats* stats = nullptr);
+
+// Adds the time since the previous stage and what arena allocated during it to a stage of stats,
+// nothing when stats is null
+class con_stage_timer {
+ public:
+  con_stage_timer(const con_arena& arena, con_stats* stats);
+
+  void done(const CON_STAGE& stage, const size_t& tokens);
+
+ private:
+  const con_arena& arena_;
+  con_stats* stats_;
+  std::chrono::steady_clock::time_point start_;
+  size_t allocations_;
+  size_t bytes_;
+};
+
+#endif // CONSTRUCT_COMPILE_H_
@@ -0,0 +1,39 @@
+#ifndef CONSTRUCT_CONTEXT_H_
+#define CONSTRUCT_CONTEXT_H_
+
+#include <vector>
+#include "construct_types.h"
+#include "construct_symtab.h"
+#include "construct_hash.h"
+#include "construct_stats.h"
+#include "construct_regalloc.h"
+
+// State of a single compilation. Compilations share nothing, so any number of them can run on
+// different threads at once.
+struct con_context {
+  CON_BITWIDTH bitwidth = BIT64;
+  int if_amnt = 0;    // next endif label number
+  int while_amnt = 0; // next startwhile/endwhile label number
+  bool local_labels = false; // number labels per top-level function and prefix them with its name
+  bool optimize = false;     // -O: rotate whiles and run the peephole pass over every top-level token
+  con_strview label_prefix;  // name of the function being lowered with local_labels
+  std::vector<con_auto_register>* auto_registers = nullptr; // of the top-level function being lowered
+  con_symtab symbols; // points to con_macros in the tokens, not copies
+  uint64_t macro_hash = CON_HASH64_INIT; // hash of the top-level macros declared so far
+  bool callee_saved_macros = false; // one of them names rbx or r12-r15
+  con_functions functions; // top-level functions declared so far, for the registers calls to them clobber
+  uint64_t function_hash = CON_HASH64_INIT; // hash of them
+  const con_functions* global_functions = nullptr; // the functions of globals, while lowering a token
+  con_counters counters;
+};
+
+// Where a top-level token starts in the serial order of its compilation: the first label numbers
+// it uses and the amount of top-level macros declared before it, along with their hash
+struct con_token_start {
+  int if_amnt;
+  int while_amnt;
+  size_t macro_amnt;
+  uint64_t macro_hash;
+};
+
+#endif // CONSTRUCT_CONTEXT_H_
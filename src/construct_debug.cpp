@@ -2,6 +2,7 @@
 #include <vector>
 #include <stdexcept>
 #include "construct_debug.h"
+#include "construct_cfg.h"
 #include "construct_types.h"
 #include "reconstruct.h"     // comparison_to_string()
 
@@ -31,66 +32,66 @@ std::string tokentype_to_string(CON_TOKENTYPE type) {
   throw std::invalid_argument("Invalid token type: "+std::to_string(static_cast<int>(type)));
 }
 
-std::string token_to_string(con_token token) {
+std::string token_to_string(const con_token& token) {
   std::string tokstring = "type: " + tokentype_to_string(token.tok_type);
   switch (token.tok_type) {
     case SECTION:
-      tokstring += ", name: " + token.tok_section->name;
+      tokstring += ", name: " + token.tok_section.name;
       break;
     case TAG:
-      tokstring += ", name: " + token.tok_tag->name;
+      tokstring += ", name: " + token.tok_tag.name;
       break;
     case WHILE:
-      tokstring += ", condition: " + token.tok_while->condition.arg1 + " "
-        + comparison_to_string(token.tok_while->condition.op) + " " + token.tok_while->condition.arg2;
+      tokstring += ", condition: " + token.tok_while.condition.arg1 + " "
+        + comparison_to_string(token.tok_while.condition.op) + " " + token.tok_while.condition.arg2;
       break;
     case IF:
-      tokstring += ", condition: " + token.tok_if->condition.arg1 + " "
-        + comparison_to_string(token.tok_if->condition.op) + " " + token.tok_if->condition.arg2;
+      tokstring += ", condition: " + token.tok_if.condition.arg1 + " "
+        + comparison_to_string(token.tok_if.condition.op) + " " + token.tok_if.condition.arg2;
       break;
     case FUNCTION:
-      tokstring += ", function: " + token.tok_function->name + ", arguments: ";
-      for (size_t i = 0; i < token.tok_function->arguments.size(); ++i) {
+      tokstring += ", function: " + token.tok_function.name + ", arguments: ";
+      for (size_t i = 0; i < token.tok_function.arguments.size(); ++i) {
         if (i != 0) {
           tokstring += ", ";
         }
-        tokstring += token.tok_function->arguments[i].name + "(" + std::to_string((int(token.tok_function->arguments[i].length)+1)*8) + ")";
+        tokstring += token.tok_function.arguments[i].name + "(" + std::to_string((int(token.tok_function.arguments[i].length)+1)*8) + ")";
       }
       break;
     case CMD:
-      if (!token.tok_cmd->arg1.empty() && !token.tok_cmd->arg2.empty()) {
-        tokstring += ", cmd: " + token.tok_cmd->command + " " + token.tok_cmd->arg1 + ", " + token.tok_cmd->arg2;
+      if (!token.tok_cmd.arg1.empty() && !token.tok_cmd.arg2.empty()) {
+        tokstring += ", cmd: " + token.tok_cmd.command + " " + token.tok_cmd.arg1 + ", " + token.tok_cmd.arg2;
         break;
       }
-      if (!token.tok_cmd->arg1.empty()) {
-        tokstring += ", cmd: " + token.tok_cmd->command + " " + token.tok_cmd->arg1;
+      if (!token.tok_cmd.arg1.empty()) {
+        tokstring += ", cmd: " + token.tok_cmd.command + " " + token.tok_cmd.arg1;
         break;
       }
-      tokstring += ", cmd: " + token.tok_cmd->command;
+      tokstring += ", cmd: " + token.tok_cmd.command;
       break;
     case MACRO:
-      tokstring += ", macro: " + token.tok_macro->macro + ", value: " + token.tok_macro->value;
+      tokstring += ", macro: " + token.tok_macro.macro + ", value: " + token.tok_macro.value;
       break;
     case FUNCALL:
-      tokstring += ", funcname: "+token.tok_funcall->funcname+", arguments: ";
-      for (size_t i = 0; i < token.tok_funcall->arguments.size(); ++i) {
+      tokstring += ", funcname: "+token.tok_funcall.funcname+", arguments: ";
+      for (size_t i = 0; i < token.tok_funcall.arguments.size(); ++i) {
         if (i != 0) {
           tokstring += ", ";
         }
-        tokstring += token.tok_funcall->arguments[i];
+        tokstring += token.tok_funcall.arguments[i];
       }
       break;
     case SYSCALL:
-      tokstring += ", number: "+std::to_string(token.tok_syscall->number)+", arguments: ";
-      for (size_t i = 0; i < token.tok_syscall->arguments.size(); ++i) {
+      tokstring += ", number: "+std::to_string(token.tok_syscall.number)+", arguments: ";
+      for (size_t i = 0; i < token.tok_syscall.arguments.size(); ++i) {
         if (i != 0) {
           tokstring += ", ";
         }
-        tokstring += token.tok_syscall->arguments[i];
+        tokstring += token.tok_syscall.arguments[i];
       }
       break;
     case DATA:
-      tokstring += ", line: "+token.tok_data->line;
+      tokstring += ", line: "+token.tok_data.line;
       break;
   }
   if (token.tokens.size() > 0) {
@@ -103,3 +104,24 @@ std::string token_to_string(con_token token) {
   return tokstring;
 }
 
+std::string cfg_to_string(const con_cfg& cfg) {
+  std::string cfgstring;
+  for (size_t b = 0; b < cfg.blocks.size(); ++b) {
+    const con_block& block = cfg.blocks[b];
+    cfgstring += "block " + std::to_string(b) + (block.entry ? " (entry)" : "") + ", from:";
+    for (size_t i = 0; i < block.predecessors.size(); ++i) {
+      cfgstring += " " + std::to_string(block.predecessors[i]);
+    }
+    cfgstring += ", to:";
+    for (size_t i = 0; i < block.successors.size(); ++i) {
+      cfgstring += " " + std::to_string(block.successors[i]);
+    }
+    cfgstring += "\n";
+    for (uint32_t i = block.begin; i < block.end; ++i) {
+      if (cfg.code[i] != nullptr) {
+        cfgstring += "  " + token_to_string(*cfg.code[i]) + "\n";
+      }
+    }
+  }
+  return cfgstring;
+}
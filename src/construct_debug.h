@@ -4,8 +4,13 @@
 #include <string>
 #include "construct_types.h"
 
+struct con_cfg;
+
 std::string tokentype_to_string(CON_TOKENTYPE type);
 
-std::string token_to_string(con_token token);
+std::string token_to_string(const con_token& token);
+
+// Every block with its edges, then its tokens as token_to_string writes them
+std::string cfg_to_string(const con_cfg& cfg);
 
 #endif // CONSTRUCT_DEBUG_H_
@@ -0,0 +1,1623 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <elf.h>
+#include "construct_elf.h"
+#include "construct_arena.h"
+#include "construct_emitter.h"
+#include "construct_hash.h"
+
+using namespace std;
+
+namespace {
+
+enum { REG_REX = 1, REG_HIGH = 2 };
+
+struct x86_insn {
+  CON_INSN_KIND kind;
+  uint32_t arg;
+};
+
+struct x86_register {
+  int number;
+  int size;
+  int flags;
+};
+
+// A number plus an optional symbol, the value of an immediate, displacement or data item
+struct elf_value {
+  int64_t number = 0;
+  con_strview symbol;
+};
+
+enum CON_OPERAND {
+  OPERAND_REG,
+  OPERAND_MEM,
+  OPERAND_IMM
+};
+
+struct elf_operand {
+  CON_OPERAND kind = OPERAND_IMM;
+  int size = 0;         // in bytes, 0 when neither given nor implied by a register
+  x86_register reg;     // OPERAND_REG
+  int base = -1;        // OPERAND_MEM registers, -1 when missing
+  int index = -1;
+  int scale = 1;
+  int address_size = 8;
+  bool rip = false;     // [rel disp]
+  elf_value value;      // immediate or displacement
+};
+
+// Everything that goes around the opcode of one instruction
+struct x86_encoding {
+  bool operand16 = false;
+  bool rex_w = false;
+  bool rex = false;     // a byte register that needs a REX prefix is used
+  bool no_rex = false;  // ah, ch, dh or bh is used
+  uint8_t opcode[3];
+  int opcode_size = 0;
+  int opcode_reg = -1;  // register added to the last opcode byte
+  int reg = 0;          // register or opcode extension of the ModRM reg field
+  const elf_operand* rm = nullptr; // no ModRM byte when null
+  int imm_size = 0;
+  uint32_t imm_reloc = R_X86_64_NONE;
+  elf_value imm;
+};
+
+// A relocation, placed before the jumps of its section are laid out
+struct elf_fixup {
+  size_t offset;
+  uint32_t type;
+  uint32_t symbol;
+  int64_t addend;
+};
+
+// jmp or jcc to a label, short as long as the label is in reach
+struct elf_branch {
+  size_t offset;  // of the two bytes of the short jump
+  uint32_t symbol;
+  int64_t addend;
+  int condition;  // -1 for jmp
+  bool is_long;
+};
+
+struct elf_section {
+  con_strview name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t align;
+  string data;            // with every jump to a label short
+  size_t bss_size = 0;
+  vector<elf_fixup> fixups;
+  vector<elf_branch> branches;
+  vector<size_t> growth;  // what the long jumps before branches[i] add to the offsets after them
+  string final_data;
+  vector<Elf64_Rela> relocs;
+  uint32_t symbol = 0;    // index of the section symbol
+};
+
+struct elf_symbol {
+  con_strview name;
+  int section = -1; // -1 while undefined
+  size_t offset = 0;
+  bool global = false;
+  bool external = false;
+  uint32_t index = 0;
+};
+
+struct elf_name_hash {
+  size_t operator()(const con_strview& name) const { return con_hash(name); }
+};
+
+struct elf_object {
+  con_arena arena; // names of local labels
+  vector<elf_section> sections;
+  vector<elf_symbol> symbols;
+  unordered_map<con_strview, uint32_t, elf_name_hash> symbol_map;
+  int section = -1;
+  con_strview last_label; // local labels (.name) belong to it
+  bool default_rel = false;
+  uint32_t symtab_size = 0;
+  uint32_t first_global = 0;
+};
+
+// Reads one operand or argument
+struct elf_reader {
+  con_strview text;
+  size_t pos;
+
+  void skip() {
+    while (pos < text.size && (text[pos] == ' ' || text[pos] == '\t')) ++pos;
+  }
+  char peek() {
+    skip();
+    return pos < text.size ? text[pos] : '\0';
+  }
+  bool eat(const char& c) {
+    if (peek() != c) return false;
+    ++pos;
+    return true;
+  }
+  bool done() {
+    skip();
+    return pos >= text.size;
+  }
+};
+
+enum CON_DIRECTIVE {
+  DIRECTIVE_NONE,
+  DIRECTIVE_GLOBAL,
+  DIRECTIVE_EXTERN,
+  DIRECTIVE_SECTION,
+  DIRECTIVE_DEFAULT,
+  DIRECTIVE_BITS,
+  DIRECTIVE_DATA,    // db, dw, dd, dq
+  DIRECTIVE_RESERVE  // resb, resw, resd, resq
+};
+
+}  // namespace
+
+static void assemble_line(con_strview line, elf_object* object);
+static void assemble_directive(const CON_DIRECTIVE& directive, const int& unit, con_strview args,
+                               elf_object* object);
+static void assemble_insn(const x86_insn& insn, con_strview args, elf_object* object);
+static void encode(const x86_encoding& encoding, elf_object* object);
+static void encode_rm(x86_encoding* encoding, const int& size, const uint8_t& opcode, const elf_operand& rm);
+static void encode_imm(x86_encoding* encoding, const int& size, const elf_value& imm, const bool& sign_extended);
+static void encode_branch(const int& condition, const elf_operand& target, elf_object* object);
+static void use_register(x86_encoding* encoding, const x86_register& reg);
+static int operation_size(const elf_operand& first, const elf_operand& second);
+static bool fits_int8(const elf_value& value);
+static elf_operand parse_operand(con_strview text, elf_object* object);
+static void parse_memory(elf_reader* reader, elf_operand* operand, elf_object* object);
+static elf_value parse_expression(elf_reader* reader, elf_object* object);
+static elf_value parse_term(elf_reader* reader, elf_object* object);
+static elf_value parse_factor(elf_reader* reader, elf_object* object);
+static con_strview read_identifier(elf_reader* reader);
+static uint64_t parse_number(con_strview digits);
+static string parse_string(elf_reader* reader);
+static bool next_operand(con_strview args, size_t* pos, con_strview* operand);
+static con_strview strip_comment(con_strview line);
+static con_strview trim(con_strview text);
+static bool is_identifier_start(const char& c);
+static bool is_identifier_char(const char& c);
+static bool lookup_register(con_strview name, x86_register* reg);
+static bool lookup_insn(con_strview name, x86_insn* insn);
+static CON_DIRECTIVE lookup_directive(con_strview name, int* unit);
+static int lookup_size(con_strview name);
+static con_strview lower(con_strview name, char* buffer, const size_t& capacity);
+static uint32_t symbol_index(con_strview name, elf_object* object);
+static void define_label(con_strview name, elf_object* object);
+static elf_section& current_section(elf_object* object);
+static void switch_section(con_strview name, elf_object* object);
+static size_t final_offset(const elf_section& section, const size_t& offset);
+static void lay_out(elf_section* section, elf_object* object);
+static void number_symbols(elf_object* object);
+static void resolve(elf_section* section, elf_object* object);
+static void add_reloc(elf_section* section, const size_t& offset, uint32_t type, const uint32_t& symbol,
+                      int64_t addend, const elf_object& object);
+static void put(string* data, const uint64_t& value, const int& size);
+static void write_object(elf_object* object, con_emitter* emitter);
+
+void assemble_elf64(con_strview nasm, con_emitter* emitter) {
+  elf_object object;
+  object.symbol_map.reserve(nasm.size/64); // about a label every few lines
+  size_t line_num = 1;
+  for (size_t start = 0; start < nasm.size; ++line_num) {
+    size_t end = nasm.find('\n', start);
+    if (end == con_strview::npos) {
+      end = nasm.size;
+    }
+    const con_strview line = nasm.substr(start, end-start);
+    try {
+      assemble_line(line, &object);
+    }
+    catch (const std::exception& e) {
+      throw std::runtime_error("Line "+to_string(line_num)+" of the nasm ["+trim(line).str()+"]: "+e.what());
+    }
+    start = end+1;
+  }
+
+  for (vector<elf_symbol>::const_iterator it = object.symbols.cbegin(); it != object.symbols.cend(); ++it) {
+    if (it->section < 0 && !it->external && !it->global) {
+      throw std::runtime_error("Symbol \""+it->name.str()+"\" is not defined");
+    }
+  }
+  for (size_t i = 0; i < object.sections.size(); ++i) {
+    lay_out(&object.sections[i], &object);
+  }
+  for (vector<elf_symbol>::iterator it = object.symbols.begin(); it != object.symbols.end(); ++it) {
+    if (it->section >= 0) {
+      it->offset = final_offset(object.sections[it->section], it->offset);
+    }
+  }
+  number_symbols(&object);
+  for (size_t i = 0; i < object.sections.size(); ++i) {
+    resolve(&object.sections[i], &object);
+  }
+  write_object(&object, emitter);
+}
+
+int x86_insn_size(con_strview line) {
+  elf_object object;
+  try {
+    assemble_line(line, &object);
+  }
+  catch (const std::exception&) {
+    return -1;
+  }
+  return object.section < 0 ? 0 : object.sections[object.section].data.size();
+}
+int x86_insn_size(const con_cmd& cmd) {
+  string line = cmd.command.str();
+  if (!cmd.arg1.empty()) {
+    line += ' ';
+    line += cmd.arg1;
+  }
+  if (!cmd.arg2.empty()) {
+    line += ", ";
+    line += cmd.arg2;
+  }
+  return x86_insn_size(con_strview(line));
+}
+bool x86_insn_kind(con_strview name, CON_INSN_KIND* kind, uint32_t* arg) {
+  x86_insn insn;
+  if (!lookup_insn(name, &insn)) {
+    return false;
+  }
+  *kind = insn.kind;
+  *arg = insn.arg;
+  return true;
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+void assemble_line(con_strview line, elf_object* object) {
+  line = trim(strip_comment(line));
+  if (line.empty()) {
+    return;
+  }
+  elf_reader reader = {line, 0};
+  con_strview word = read_identifier(&reader);
+  if (word.empty()) {
+    throw invalid_argument("Expected a label, directive or instruction");
+  }
+  int unit = 0;
+  CON_DIRECTIVE directive = lookup_directive(word, &unit);
+  x86_insn insn;
+  if (directive == DIRECTIVE_NONE && !lookup_insn(word, &insn)) {
+    // A label, followed by ':' or by data
+    if (reader.eat(':')) {
+      define_label(word, object);
+      if (reader.done()) {
+        return;
+      }
+      word = read_identifier(&reader);
+    } else {
+      elf_reader next = reader;
+      next.skip();
+      const con_strview data = read_identifier(&next);
+      const CON_DIRECTIVE data_directive = lookup_directive(data, &unit);
+      if (data_directive != DIRECTIVE_DATA && data_directive != DIRECTIVE_RESERVE) {
+        throw invalid_argument("Unknown instruction: "+word.str());
+      }
+      define_label(word, object);
+      word = data;
+      reader = next;
+    }
+    directive = lookup_directive(word, &unit);
+    if (directive != DIRECTIVE_DATA && directive != DIRECTIVE_RESERVE && !lookup_insn(word, &insn)) {
+      throw invalid_argument("Unknown instruction: "+word.str());
+    }
+  }
+  const con_strview args = trim(line.substr(reader.pos));
+  if (directive == DIRECTIVE_NONE) {
+    assemble_insn(insn, args, object);
+  } else {
+    assemble_directive(directive, unit, args, object);
+  }
+}
+
+void assemble_directive(const CON_DIRECTIVE& directive, const int& unit, con_strview args, elf_object* object) {
+  switch (directive) {
+    case DIRECTIVE_GLOBAL:
+    case DIRECTIVE_EXTERN: {
+      con_strview operand;
+      for (size_t pos = 0; next_operand(args, &pos, &operand);) {
+        const con_strview name = trim(operand.substr(0, operand.find(':'))); // global name:function
+        if (name.empty() || !is_identifier_start(name[0])) {
+          throw invalid_argument("Expected a symbol name");
+        }
+        elf_symbol& symbol = object->symbols[symbol_index(name, object)];
+        (directive == DIRECTIVE_GLOBAL ? symbol.global : symbol.external) = true;
+      }
+      break;
+    }
+    case DIRECTIVE_SECTION: {
+      size_t end = 0;
+      while (end < args.size && args[end] != ' ' && args[end] != '\t') ++end;
+      switch_section(args.substr(0, end), object);
+      break;
+    }
+    case DIRECTIVE_DEFAULT:
+      if (args != "rel" && args != "abs") {
+        throw invalid_argument("Expected default rel or default abs");
+      }
+      object->default_rel = args == "rel";
+      break;
+    case DIRECTIVE_BITS:
+      if (args != "64") {
+        throw invalid_argument("Only 64 bit code can be written as an object");
+      }
+      break;
+    case DIRECTIVE_DATA: {
+      elf_section& section = current_section(object);
+      if (section.type == SHT_NOBITS) {
+        throw invalid_argument("Data in a section without contents");
+      }
+      if (args.empty()) {
+        throw invalid_argument("Expected data");
+      }
+      con_strview item;
+      for (size_t pos = 0; next_operand(args, &pos, &item);) {
+        elf_reader reader = {item, 0};
+        const char first = reader.peek();
+        if (first == '\'' || first == '"' || first == '`') {
+          elf_reader string_reader = reader;
+          string bytes = parse_string(&string_reader);
+          if (string_reader.done()) { // a string on its own, padded to whole units
+            bytes.resize((bytes.size()+unit-1)/unit*unit, '\0');
+            section.data += bytes;
+            continue;
+          }
+        }
+        const elf_value value = parse_expression(&reader, object);
+        if (!reader.done()) {
+          throw invalid_argument("Unexpected characters in data");
+        }
+        if (!value.symbol.empty()) {
+          static const uint32_t types[] = {R_X86_64_8, R_X86_64_16, R_X86_64_NONE, R_X86_64_32,
+                                           R_X86_64_NONE, R_X86_64_NONE, R_X86_64_NONE, R_X86_64_64};
+          section.fixups.push_back({section.data.size(), types[unit-1], symbol_index(value.symbol, object),
+                                    value.number});
+          put(&section.data, 0, unit);
+        } else {
+          put(&section.data, value.number, unit);
+        }
+      }
+      break;
+    }
+    case DIRECTIVE_RESERVE: {
+      elf_reader reader = {args, 0};
+      const elf_value amnt = parse_expression(&reader, object);
+      if (!reader.done() || !amnt.symbol.empty() || amnt.number < 0) {
+        throw invalid_argument("Expected the amount to reserve");
+      }
+      elf_section& section = current_section(object);
+      if (section.type == SHT_NOBITS) {
+        section.bss_size += amnt.number*unit;
+      } else {
+        section.data.append(amnt.number*unit, '\0');
+      }
+      break;
+    }
+    case DIRECTIVE_NONE:
+      break;
+  }
+}
+
+void assemble_insn(const x86_insn& insn, con_strview args, elf_object* object) {
+  if (current_section(object).type == SHT_NOBITS) {
+    throw invalid_argument("Code in a section without contents");
+  }
+  static const size_t max_operands[] = {2, 2, 2, 2, 2, 1, 1, 3, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 0};
+  static const size_t min_operands[] = {2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 0, 1, 1, 1, 2, 0};
+  elf_operand ops[3];
+  size_t amnt = 0;
+  con_strview operand;
+  for (size_t pos = 0; next_operand(args, &pos, &operand); ++amnt) {
+    if (amnt == max_operands[insn.kind]) {
+      throw invalid_argument("Too many operands");
+    }
+    ops[amnt] = parse_operand(operand, object);
+  }
+  if (amnt < min_operands[insn.kind]) {
+    throw invalid_argument("Too few operands");
+  }
+
+  x86_encoding encoding;
+  const uint8_t ext = insn.arg;
+  switch (insn.kind) {
+    case INSN_ALU:
+    case INSN_MOV:
+    case INSN_TEST:
+    case INSN_XCHG: {
+      elf_operand* dst = &ops[0];
+      elf_operand* src = &ops[1];
+      if (dst->kind == OPERAND_IMM) {
+        throw invalid_argument("Can't write to an immediate");
+      }
+      if ((insn.kind == INSN_TEST || insn.kind == INSN_XCHG) && dst->kind == OPERAND_REG
+          && src->kind == OPERAND_MEM) {
+        swap(dst, src); // both orders have the same encoding
+      }
+      const int size = operation_size(*dst, *src);
+      if (src->kind == OPERAND_IMM) {
+        if (insn.kind == INSN_XCHG) {
+          throw invalid_argument("Can't exchange with an immediate");
+        }
+        if (insn.kind == INSN_MOV && dst->kind == OPERAND_REG) {
+          use_register(&encoding, dst->reg);
+          encoding.opcode_reg = dst->reg.number;
+          encoding.opcode[0] = size == 1 ? 0xB0 : 0xB8;
+          encoding.opcode_size = 1;
+          if (size != 8) {
+            encoding.operand16 = size == 2;
+            encode_imm(&encoding, size, src->value, false);
+          } else if (src->value.symbol.empty() && src->value.number >= 0 && src->value.number <= 0xFFFFFFFFll) {
+            encode_imm(&encoding, 4, src->value, false); // mov r32 clears the upper half
+          } else if (src->value.symbol.empty() && src->value.number == static_cast<int32_t>(src->value.number)) {
+            encoding.opcode_reg = -1;
+            encode_rm(&encoding, size, 0xC7, *dst);
+            encode_imm(&encoding, 4, src->value, true);
+          } else {
+            encoding.rex_w = true;
+            encode_imm(&encoding, 8, src->value, false);
+          }
+          break;
+        }
+        if (insn.kind == INSN_ALU && size != 1 && fits_int8(src->value)) {
+          encode_rm(&encoding, size, 0x83, *dst);
+          encoding.reg = ext;
+          encode_imm(&encoding, 1, src->value, false);
+          break;
+        }
+        static const uint8_t imm_opcodes[] = {0x80, 0xC6, 0xF6};
+        const uint8_t opcode = imm_opcodes[insn.kind == INSN_ALU ? 0 : insn.kind == INSN_MOV ? 1 : 2];
+        encode_rm(&encoding, size, size == 1 ? opcode : opcode+1, *dst);
+        encoding.reg = insn.kind == INSN_ALU ? ext : 0;
+        encode_imm(&encoding, size == 8 ? 4 : size, src->value, size == 8);
+        break;
+      }
+      static const uint8_t rm_reg_opcodes[] = {0x00, 0x88, 0x84, 0x86}; // by kind, op r/m, reg
+      const uint8_t opcode = insn.kind == INSN_ALU ? ext*8 : rm_reg_opcodes[insn.kind];
+      if (src->kind == OPERAND_REG) {
+        encode_rm(&encoding, size, size == 1 ? opcode : opcode+1, *dst);
+        use_register(&encoding, src->reg);
+        encoding.reg = src->reg.number;
+      } else if (dst->kind == OPERAND_REG && (insn.kind == INSN_ALU || insn.kind == INSN_MOV)) {
+        encode_rm(&encoding, size, size == 1 ? opcode+2 : opcode+3, *src);
+        use_register(&encoding, dst->reg);
+        encoding.reg = dst->reg.number;
+      } else {
+        throw invalid_argument("Invalid combination of operands");
+      }
+      break;
+    }
+    case INSN_LEA:
+      if (ops[0].kind != OPERAND_REG || ops[0].reg.size == 1 || ops[1].kind != OPERAND_MEM) {
+        throw invalid_argument("lea takes a register and a memory operand");
+      }
+      encode_rm(&encoding, ops[0].reg.size, 0x8D, ops[1]);
+      use_register(&encoding, ops[0].reg);
+      encoding.reg = ops[0].reg.number;
+      break;
+    case INSN_INCDEC:
+    case INSN_UNARY: {
+      const elf_operand& op = ops[0];
+      if (op.kind == OPERAND_IMM) {
+        throw invalid_argument("Expected a register or memory operand");
+      }
+      const int size = operation_size(op, op);
+      const uint8_t opcode = insn.kind == INSN_INCDEC ? 0xFE : 0xF6;
+      encode_rm(&encoding, size, size == 1 ? opcode : opcode+1, op);
+      encoding.reg = ext;
+      break;
+    }
+    case INSN_IMUL: {
+      if (amnt == 1) {
+        if (ops[0].kind == OPERAND_IMM) {
+          throw invalid_argument("Expected a register or memory operand");
+        }
+        const int size = operation_size(ops[0], ops[0]);
+        encode_rm(&encoding, size, size == 1 ? 0xF6 : 0xF7, ops[0]);
+        encoding.reg = ext;
+        break;
+      }
+      if (amnt == 2 && ops[1].kind == OPERAND_IMM) { // imul r, imm is imul r, r, imm
+        ops[2] = ops[1];
+        ops[1] = ops[0];
+        amnt = 3;
+      }
+      if (ops[0].kind != OPERAND_REG || ops[0].reg.size == 1 || ops[1].kind == OPERAND_IMM) {
+        throw invalid_argument("Invalid combination of operands");
+      }
+      const int size = operation_size(ops[0], ops[1]);
+      if (amnt == 2) {
+        encode_rm(&encoding, size, 0xAF, ops[1]);
+        encoding.opcode[0] = 0x0F;
+        encoding.opcode[1] = 0xAF;
+        encoding.opcode_size = 2;
+      } else if (ops[2].kind != OPERAND_IMM) {
+        throw invalid_argument("Expected an immediate");
+      } else if (fits_int8(ops[2].value)) {
+        encode_rm(&encoding, size, 0x6B, ops[1]);
+        encode_imm(&encoding, 1, ops[2].value, false);
+      } else {
+        encode_rm(&encoding, size, 0x69, ops[1]);
+        encode_imm(&encoding, size == 8 ? 4 : size, ops[2].value, size == 8);
+      }
+      use_register(&encoding, ops[0].reg);
+      encoding.reg = ops[0].reg.number;
+      break;
+    }
+    case INSN_SHIFT: {
+      if (ops[0].kind == OPERAND_IMM) {
+        throw invalid_argument("Expected a register or memory operand");
+      }
+      const int size = operation_size(ops[0], ops[0]);
+      const elf_operand& amnt = ops[1];
+      if (amnt.kind == OPERAND_REG && amnt.reg.number == 1 && amnt.reg.size == 1) {
+        encode_rm(&encoding, size, size == 1 ? 0xD2 : 0xD3, ops[0]);
+      } else if (amnt.kind != OPERAND_IMM || !amnt.value.symbol.empty()) {
+        throw invalid_argument("Shifts take an immediate or cl");
+      } else if (amnt.value.number == 1) {
+        encode_rm(&encoding, size, size == 1 ? 0xD0 : 0xD1, ops[0]);
+      } else {
+        encode_rm(&encoding, size, size == 1 ? 0xC0 : 0xC1, ops[0]);
+        encode_imm(&encoding, 1, amnt.value, false);
+      }
+      encoding.reg = ext;
+      break;
+    }
+    case INSN_MOVX:
+    case INSN_MOVSXD: {
+      if (ops[0].kind != OPERAND_REG || ops[1].kind == OPERAND_IMM) {
+        throw invalid_argument("Invalid combination of operands");
+      }
+      const int size = ops[0].reg.size;
+      const int src_size = ops[1].kind == OPERAND_REG ? ops[1].reg.size : ops[1].size;
+      if (insn.kind == INSN_MOVSXD) {
+        if (size != 8 || (src_size != 4 && src_size != 0)) {
+          throw invalid_argument("movsxd takes a 64 and a 32 bit operand");
+        }
+        encode_rm(&encoding, size, 0x63, ops[1]);
+      } else {
+        if (src_size == 0) {
+          throw invalid_argument("Operation size not specified");
+        }
+        if (src_size >= size || src_size > 2) {
+          throw invalid_argument("Invalid combination of operand sizes");
+        }
+        encode_rm(&encoding, size, ext+(src_size == 2), ops[1]);
+        encoding.opcode[1] = encoding.opcode[0];
+        encoding.opcode[0] = 0x0F;
+        encoding.opcode_size = 2;
+      }
+      if (ops[1].kind == OPERAND_REG) {
+        use_register(&encoding, ops[1].reg);
+      }
+      use_register(&encoding, ops[0].reg);
+      encoding.reg = ops[0].reg.number;
+      break;
+    }
+    case INSN_PUSH:
+    case INSN_POP: {
+      const elf_operand& op = ops[0];
+      const bool push = insn.kind == INSN_PUSH;
+      if (op.kind == OPERAND_IMM) {
+        if (!push) {
+          throw invalid_argument("Can't pop to an immediate");
+        }
+        encoding.opcode[0] = fits_int8(op.value) ? 0x6A : 0x68;
+        encoding.opcode_size = 1;
+        encode_imm(&encoding, fits_int8(op.value) ? 1 : 4, op.value, !fits_int8(op.value));
+        break;
+      }
+      const int size = op.kind == OPERAND_REG ? op.reg.size : op.size == 0 ? 8 : op.size;
+      if (size != 8 && size != 2) {
+        throw invalid_argument("Only 64 and 16 bit operands can be pushed and popped");
+      }
+      if (op.kind == OPERAND_REG) {
+        encoding.opcode[0] = push ? 0x50 : 0x58;
+        encoding.opcode_size = 1;
+        encoding.opcode_reg = op.reg.number;
+      } else {
+        encode_rm(&encoding, 4, push ? 0xFF : 0x8F, op);
+        encoding.reg = push ? 6 : 0;
+      }
+      encoding.operand16 = size == 2;
+      break;
+    }
+    case INSN_CALL:
+    case INSN_JMP: {
+      const elf_operand& op = ops[0];
+      if (op.kind == OPERAND_IMM) {
+        if (op.value.symbol.empty()) {
+          throw invalid_argument("Jumps to absolute addresses are not supported");
+        }
+        if (insn.kind == INSN_JMP) {
+          encode_branch(-1, op, object);
+          return;
+        }
+        encoding.opcode[0] = 0xE8;
+        encoding.opcode_size = 1;
+        encoding.imm_size = 4;
+        encoding.imm_reloc = R_X86_64_PLT32;
+        encoding.imm = op.value;
+        encoding.imm.number -= 4;
+        break;
+      }
+      if ((op.kind == OPERAND_REG && op.reg.size != 8) || (op.kind == OPERAND_MEM && op.size != 0 && op.size != 8)) {
+        throw invalid_argument("Expected a 64 bit operand");
+      }
+      encode_rm(&encoding, 4, 0xFF, op);
+      encoding.reg = insn.kind == INSN_CALL ? 2 : 4;
+      break;
+    }
+    case INSN_JCC:
+      if (ops[0].kind != OPERAND_IMM || ops[0].value.symbol.empty()) {
+        throw invalid_argument("Expected a label");
+      }
+      encode_branch(ext, ops[0], object);
+      return;
+    case INSN_SETCC:
+      if (ops[0].kind == OPERAND_IMM || operation_size(ops[0], ops[0]) != 1) {
+        throw invalid_argument("Expected a byte register or memory operand");
+      }
+      encode_rm(&encoding, 1, 0x90+ext, ops[0]);
+      encoding.opcode[1] = encoding.opcode[0];
+      encoding.opcode[0] = 0x0F;
+      encoding.opcode_size = 2;
+      break;
+    case INSN_CMOVCC: {
+      if (ops[0].kind != OPERAND_REG || ops[0].reg.size == 1 || ops[1].kind == OPERAND_IMM) {
+        throw invalid_argument("Invalid combination of operands");
+      }
+      const int size = operation_size(ops[0], ops[1]);
+      encode_rm(&encoding, size, 0x40+ext, ops[1]);
+      encoding.opcode[1] = encoding.opcode[0];
+      encoding.opcode[0] = 0x0F;
+      encoding.opcode_size = 2;
+      use_register(&encoding, ops[0].reg);
+      encoding.reg = ops[0].reg.number;
+      break;
+    }
+    case INSN_RET:
+      encoding.opcode[0] = amnt == 0 ? 0xC3 : 0xC2;
+      encoding.opcode_size = 1;
+      if (amnt != 0) {
+        if (ops[0].kind != OPERAND_IMM) {
+          throw invalid_argument("Expected an immediate");
+        }
+        encode_imm(&encoding, 2, ops[0].value, false);
+      }
+      break;
+    case INSN_INT:
+      if (ops[0].kind != OPERAND_IMM) {
+        throw invalid_argument("Expected an immediate");
+      }
+      encoding.opcode[0] = 0xCD;
+      encoding.opcode_size = 1;
+      encode_imm(&encoding, 1, ops[0].value, false);
+      break;
+    case INSN_FIXED: {
+      string& data = current_section(object).data;
+      for (uint32_t bytes = insn.arg; bytes != 0; bytes >>= 8) {
+        data += static_cast<char>(bytes & 0xFF);
+      }
+      return;
+    }
+  }
+  for (size_t i = 0; i < amnt; ++i) {
+    if (ops[i].kind == OPERAND_REG) {
+      use_register(&encoding, ops[i].reg);
+    }
+  }
+  encode(encoding, object);
+}
+
+// Writes the instruction to the current section
+void encode(const x86_encoding& encoding, elf_object* object) {
+  elf_section& section = current_section(object);
+  string& data = section.data;
+  const elf_operand* rm = encoding.rm;
+  const bool memory = rm != nullptr && rm->kind == OPERAND_MEM;
+  if (memory && rm->address_size == 4) {
+    data += '\x67';
+  }
+  if (encoding.operand16) {
+    data += '\x66';
+  }
+  int rex = encoding.rex_w ? 8 : 0;
+  rex |= (encoding.reg >> 3) << 2;
+  if (encoding.opcode_reg >= 0) {
+    rex |= encoding.opcode_reg >> 3;
+  } else if (memory) {
+    rex |= (rm->index >= 0 ? rm->index >> 3 : 0) << 1;
+    rex |= rm->base >= 0 ? rm->base >> 3 : 0;
+  } else if (rm != nullptr) {
+    rex |= rm->reg.number >> 3;
+  }
+  if (rex != 0 || encoding.rex) {
+    if (encoding.no_rex) {
+      throw invalid_argument("ah, ch, dh and bh can't be used with this instruction");
+    }
+    data += static_cast<char>(0x40 | rex);
+  }
+  for (int i = 0; i < encoding.opcode_size; ++i) {
+    const int reg = i == encoding.opcode_size-1 && encoding.opcode_reg >= 0 ? encoding.opcode_reg & 7 : 0;
+    data += static_cast<char>(encoding.opcode[i]+reg);
+  }
+
+  if (rm != nullptr && !memory) {
+    data += static_cast<char>(0xC0 | (encoding.reg & 7) << 3 | (rm->reg.number & 7));
+  } else if (memory) {
+    const elf_value& disp = rm->value;
+    const int reg = (encoding.reg & 7) << 3;
+    static const int scales[] = {-1, 0, 1, -1, 2, -1, -1, -1, 3};
+    if (rm->scale < 1 || rm->scale > 8 || scales[rm->scale] < 0) {
+      throw invalid_argument("Scale must be 1, 2, 4 or 8");
+    }
+    if (rm->index == 4) {
+      throw invalid_argument("The stack pointer can't be an index");
+    }
+    int disp_size = 4;
+    uint32_t disp_reloc = rm->address_size == 4 ? R_X86_64_32 : R_X86_64_32S;
+    if (rm->rip) {
+      data += static_cast<char>(reg | 5);
+      disp_reloc = R_X86_64_PC32;
+    } else if (rm->base < 0) {
+      data += static_cast<char>(reg | 4);
+      data += static_cast<char>(scales[rm->scale] << 6 | (rm->index < 0 ? 4 : rm->index & 7) << 3 | 5);
+    } else {
+      int mod = 2;
+      if (disp.symbol.empty() && disp.number == 0 && (rm->base & 7) != 5) {
+        mod = 0;
+        disp_size = 0;
+      } else if (fits_int8(disp)) {
+        mod = 1;
+        disp_size = 1;
+      }
+      if (rm->index >= 0 || (rm->base & 7) == 4) {
+        data += static_cast<char>(mod << 6 | reg | 4);
+        data += static_cast<char>(scales[rm->scale] << 6 | (rm->index < 0 ? 4 : rm->index & 7) << 3 | (rm->base & 7));
+      } else {
+        data += static_cast<char>(mod << 6 | reg | (rm->base & 7));
+      }
+    }
+    if (disp_size == 4) {
+      if (disp.symbol.empty() && disp.number != static_cast<int32_t>(disp.number)
+          && (rm->address_size == 8 || static_cast<uint64_t>(disp.number) > 0xFFFFFFFFull)) {
+        throw invalid_argument("Displacement out of range");
+      }
+      if (!disp.symbol.empty()) {
+        int64_t addend = disp.number;
+        if (rm->rip) { // relative to the end of the instruction
+          addend -= 4+encoding.imm_size;
+        }
+        section.fixups.push_back({data.size(), disp_reloc, symbol_index(disp.symbol, object), addend});
+        put(&data, 0, 4);
+      } else {
+        put(&data, disp.number, 4);
+      }
+    } else if (disp_size == 1) {
+      put(&data, disp.number, 1);
+    }
+  }
+
+  if (encoding.imm_size != 0) {
+    if (!encoding.imm.symbol.empty()) {
+      section.fixups.push_back({data.size(), encoding.imm_reloc, symbol_index(encoding.imm.symbol, object),
+                                encoding.imm.number});
+      put(&data, 0, encoding.imm_size);
+    } else {
+      put(&data, encoding.imm.number, encoding.imm_size);
+    }
+  }
+}
+
+// Sets the opcode, operand size and r/m operand of an instruction taking a ModRM byte
+void encode_rm(x86_encoding* encoding, const int& size, const uint8_t& opcode, const elf_operand& rm) {
+  encoding->opcode[0] = opcode;
+  encoding->opcode_size = 1;
+  encoding->operand16 = size == 2;
+  encoding->rex_w = size == 8;
+  encoding->rm = &rm;
+}
+
+// Sets the immediate, checking that a number fits it. sign_extended is set for 32 bit immediates the cpu
+// widens to 64 bits
+void encode_imm(x86_encoding* encoding, const int& size, const elf_value& imm, const bool& sign_extended) {
+  encoding->imm_size = size;
+  encoding->imm = imm;
+  switch (size) {
+    case 1:
+      encoding->imm_reloc = R_X86_64_8;
+      break;
+    case 2:
+      encoding->imm_reloc = R_X86_64_16;
+      break;
+    case 4:
+      encoding->imm_reloc = sign_extended ? R_X86_64_32S : R_X86_64_32;
+      break;
+    default:
+      encoding->imm_reloc = R_X86_64_64;
+      break;
+  }
+  if (!imm.symbol.empty() || size == 8) {
+    return;
+  }
+  const int64_t min = sign_extended ? INT32_MIN : -(int64_t(1) << (size*8-1));
+  const int64_t max = sign_extended ? INT32_MAX : (int64_t(1) << (size*8))-1;
+  if (imm.number < min || imm.number > max) {
+    throw invalid_argument("Immediate out of range");
+  }
+}
+
+// jmp (condition -1) or jcc to a label. The jump is laid out short, lay_out makes it long when it has to
+void encode_branch(const int& condition, const elf_operand& target, elf_object* object) {
+  elf_section& section = current_section(object);
+  section.branches.push_back({section.data.size(), symbol_index(target.value.symbol, object), target.value.number,
+                              condition, false});
+  section.data.append(2, '\0');
+}
+
+void use_register(x86_encoding* encoding, const x86_register& reg) {
+  encoding->rex |= (reg.flags & REG_REX) != 0;
+  encoding->no_rex |= (reg.flags & REG_HIGH) != 0;
+}
+
+// Size in bytes of an operation on first and second, which have to agree on it
+int operation_size(const elf_operand& first, const elf_operand& second) {
+  const int first_size = first.kind == OPERAND_REG ? first.reg.size : first.kind == OPERAND_MEM ? first.size : 0;
+  const int second_size = second.kind == OPERAND_REG ? second.reg.size : second.kind == OPERAND_MEM ? second.size : 0;
+  if (first_size != 0 && second_size != 0 && first_size != second_size) {
+    throw invalid_argument("Mismatch in operand sizes");
+  }
+  const int size = first_size != 0 ? first_size : second_size;
+  if (size == 0) {
+    throw invalid_argument("Operation size not specified");
+  }
+  return size;
+}
+
+bool fits_int8(const elf_value& value) {
+  return value.symbol.empty() && value.number >= -128 && value.number <= 127;
+}
+
+elf_operand parse_operand(con_strview text, elf_object* object) {
+  elf_operand operand;
+  elf_reader reader = {trim(text), 0};
+  elf_reader after_size = reader;
+  const int size = lookup_size(read_identifier(&after_size));
+  if (size != 0) {
+    operand.size = size;
+    reader = after_size;
+  }
+  elf_reader after_keyword = reader;
+  const con_strview keyword = read_identifier(&after_keyword);
+  if (keyword == "short" || keyword == "near") { // jumps are sized by their distance anyway
+    reader = after_keyword;
+  }
+  if (reader.eat('[')) {
+    operand.kind = OPERAND_MEM;
+    parse_memory(&reader, &operand, object);
+    if (!reader.eat(']')) {
+      throw invalid_argument("Expected ]");
+    }
+  } else {
+    elf_reader after_reg = reader;
+    const con_strview name = read_identifier(&after_reg);
+    if (!name.empty() && lookup_register(name, &operand.reg) && after_reg.done()) {
+      operand.kind = OPERAND_REG;
+      if (operand.size != 0 && operand.size != operand.reg.size) {
+        throw invalid_argument("Mismatch in operand sizes");
+      }
+      reader = after_reg;
+    } else {
+      operand.kind = OPERAND_IMM;
+      operand.value = parse_expression(&reader, object);
+    }
+  }
+  if (!reader.done()) {
+    throw invalid_argument("Unexpected characters in operand ["+text.str()+"]");
+  }
+  return operand;
+}
+
+// base + index*scale + displacement, in any order
+void parse_memory(elf_reader* reader, elf_operand* operand, elf_object* object) {
+  elf_reader after_keyword = *reader;
+  const con_strview keyword = read_identifier(&after_keyword);
+  bool rel = object->default_rel;
+  if (keyword == "rel" || keyword == "abs") {
+    rel = keyword == "rel";
+    *reader = after_keyword;
+  }
+  int address_size = 0;
+  bool first = true;
+  while (reader->peek() != ']' && reader->peek() != '\0') {
+    bool negative = false;
+    if (!first) {
+      if (reader->eat('-')) {
+        negative = true;
+      } else if (!reader->eat('+')) {
+        throw invalid_argument("Expected + or -");
+      }
+    }
+    first = false;
+    // A product of numbers and at most one register
+    x86_register reg;
+    bool has_reg = false;
+    bool has_value = false;
+    elf_value value;
+    value.number = 1;
+    do {
+      elf_reader after_reg = *reader;
+      const con_strview name = read_identifier(&after_reg);
+      if (!name.empty() && lookup_register(name, &reg)) {
+        if (has_reg) {
+          throw invalid_argument("Registers can't be multiplied");
+        }
+        has_reg = true;
+        *reader = after_reg;
+        continue;
+      }
+      const elf_value factor = parse_factor(reader, object);
+      if (has_value && (!value.symbol.empty() || !factor.symbol.empty())) {
+        throw invalid_argument("Symbols can't be multiplied");
+      }
+      value.number = has_value ? value.number*factor.number : factor.number;
+      value.symbol = factor.symbol;
+      has_value = true;
+    } while (reader->eat('*'));
+
+    if (!has_reg) {
+      if (negative && !value.symbol.empty()) {
+        throw invalid_argument("Can't subtract a symbol");
+      }
+      if (!value.symbol.empty() && !operand->value.symbol.empty()) {
+        throw invalid_argument("Only one symbol per address");
+      }
+      if (!value.symbol.empty()) {
+        operand->value.symbol = value.symbol;
+      }
+      operand->value.number += negative ? -value.number : value.number;
+      continue;
+    }
+    if (negative || !value.symbol.empty() || reg.size < 4) {
+      throw invalid_argument("Invalid effective address");
+    }
+    if (address_size != 0 && address_size != reg.size) {
+      throw invalid_argument("Mixed address sizes");
+    }
+    address_size = reg.size;
+    if (value.number == 1 && operand->base < 0) {
+      operand->base = reg.number;
+    } else if (operand->index < 0) {
+      operand->index = reg.number;
+      operand->scale = value.number;
+    } else if (value.number == 1 && operand->scale == 1) {
+      operand->base = operand->index; // [index+base] with the second one as base
+      operand->index = reg.number;
+    } else {
+      throw invalid_argument("Invalid effective address");
+    }
+  }
+  if (operand->base < 0 && operand->index >= 0 && operand->scale == 1) {
+    operand->base = operand->index; // a lone register is a base, it needs no SIB byte
+    operand->index = -1;
+  }
+  if (operand->index == 4 && operand->scale == 1 && (operand->base & 7) != 4) {
+    swap(operand->base, operand->index); // [rax+rsp] is [rsp+rax]
+  }
+  operand->address_size = address_size == 0 ? 8 : address_size;
+  operand->rip = rel && operand->base < 0 && operand->index < 0;
+}
+
+elf_value parse_expression(elf_reader* reader, elf_object* object) {
+  elf_value value = parse_term(reader, object);
+  for (;;) {
+    const bool add = reader->eat('+');
+    if (!add && !reader->eat('-')) {
+      return value;
+    }
+    const elf_value term = parse_term(reader, object);
+    if (!term.symbol.empty() && (!add || !value.symbol.empty())) {
+      throw invalid_argument("Only a single symbol can be added to a number");
+    }
+    if (!term.symbol.empty()) {
+      value.symbol = term.symbol;
+    }
+    value.number = add ? value.number+term.number : value.number-term.number;
+  }
+}
+
+elf_value parse_term(elf_reader* reader, elf_object* object) {
+  elf_value value = parse_factor(reader, object);
+  while (reader->eat('*')) {
+    const elf_value factor = parse_factor(reader, object);
+    if (!value.symbol.empty() || !factor.symbol.empty()) {
+      throw invalid_argument("Symbols can't be multiplied");
+    }
+    value.number *= factor.number;
+  }
+  return value;
+}
+
+elf_value parse_factor(elf_reader* reader, elf_object* object) {
+  const char c = reader->peek();
+  elf_value value;
+  if (c == '-' || c == '+') {
+    ++reader->pos;
+    value = parse_factor(reader, object);
+    if (!value.symbol.empty() && c == '-') {
+      throw invalid_argument("Can't negate a symbol");
+    }
+    value.number = c == '-' ? -value.number : value.number;
+  } else if (c == '(') {
+    ++reader->pos;
+    value = parse_expression(reader, object);
+    if (!reader->eat(')')) {
+      throw invalid_argument("Expected )");
+    }
+  } else if (c == '\'' || c == '"' || c == '`') {
+    const string chars = parse_string(reader);
+    if (chars.size() > 8) {
+      throw invalid_argument("Character constant too long");
+    }
+    uint64_t number = 0;
+    for (size_t i = chars.size(); i-- > 0;) {
+      number = number << 8 | static_cast<uint8_t>(chars[i]);
+    }
+    value.number = number;
+  } else if (c >= '0' && c <= '9') {
+    const size_t start = reader->pos;
+    while (reader->pos < reader->text.size && is_identifier_char(reader->text[reader->pos])) ++reader->pos;
+    value.number = parse_number(reader->text.substr(start, reader->pos-start));
+  } else {
+    const con_strview name = read_identifier(reader);
+    x86_register reg;
+    if (name.empty() || lookup_register(name, &reg)) {
+      throw invalid_argument("Expected a number or symbol");
+    }
+    value.symbol = name[0] == '.' && !object->last_label.empty()
+                   ? con_strdup(&object->arena, object->last_label.str()+name)
+                   : name;
+  }
+  return value;
+}
+
+con_strview read_identifier(elf_reader* reader) {
+  reader->skip();
+  const size_t start = reader->pos;
+  if (reader->pos < reader->text.size && is_identifier_start(reader->text[reader->pos])) {
+    ++reader->pos;
+    while (reader->pos < reader->text.size && is_identifier_char(reader->text[reader->pos])) ++reader->pos;
+  }
+  return reader->text.substr(start, reader->pos-start);
+}
+
+// 10, 0x1f, 1fh, 0b101, 101b, 0o17 and 17q, with '_' between digits
+uint64_t parse_number(con_strview digits) {
+  string clean;
+  for (size_t i = 0; i < digits.size; ++i) {
+    if (digits[i] != '_') clean += static_cast<char>(tolower(digits[i]));
+  }
+  int base = 10;
+  if (clean.size() > 2 && clean[0] == '0' && (clean[1] == 'x' || clean[1] == 'h')) {
+    base = 16;
+    clean.erase(0, 2);
+  } else if (clean.size() > 2 && clean[0] == '0' && (clean[1] == 'b' || clean[1] == 'y')) {
+    base = 2;
+    clean.erase(0, 2);
+  } else if (clean.size() > 2 && clean[0] == '0' && (clean[1] == 'o' || clean[1] == 'q')) {
+    base = 8;
+    clean.erase(0, 2);
+  } else if (clean.size() > 1 && clean.back() == 'h') {
+    base = 16;
+    clean.pop_back();
+  } else if (clean.size() > 1 && (clean.back() == 'q' || clean.back() == 'o')) {
+    base = 8;
+    clean.pop_back();
+  } else if (clean.size() > 1 && (clean.back() == 'b' || clean.back() == 'y')) {
+    base = 2;
+    clean.pop_back();
+  } else if (clean.size() > 1 && clean.back() == 'd') {
+    clean.pop_back();
+  }
+  uint64_t number = 0;
+  for (size_t i = 0; i < clean.size(); ++i) {
+    const char c = clean[i];
+    const int digit = c >= '0' && c <= '9' ? c-'0' : c >= 'a' && c <= 'f' ? c-'a'+10 : 99;
+    if (digit >= base) {
+      throw invalid_argument("Invalid number: "+digits.str());
+    }
+    number = number*base+digit;
+  }
+  return number;
+}
+
+// 'text', "text" or `text` with C escapes
+string parse_string(elf_reader* reader) {
+  const con_strview& text = reader->text;
+  const char quote = text[reader->pos++];
+  string str;
+  while (reader->pos < text.size && text[reader->pos] != quote) {
+    char c = text[reader->pos++];
+    if (quote == '`' && c == '\\' && reader->pos < text.size) {
+      c = text[reader->pos++];
+      switch (c) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case '0': c = '\0'; break;
+        case 'a': c = '\a'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'v': c = '\v'; break;
+        case 'e': c = '\x1b'; break;
+        case 'x': {
+          int number = 0;
+          for (int digits = 0; digits < 2 && reader->pos < text.size && isxdigit(text[reader->pos]); ++digits) {
+            const char d = tolower(text[reader->pos++]);
+            number = number*16+(d <= '9' ? d-'0' : d-'a'+10);
+          }
+          c = static_cast<char>(number);
+          break;
+        }
+        default: break; // \\, \', \" and \` stand for themselves
+      }
+    }
+    str += c;
+  }
+  if (reader->pos >= text.size) {
+    throw invalid_argument("Unterminated string");
+  }
+  ++reader->pos;
+  return str;
+}
+
+// Reads the operand of args at *pos, operands are split at the commas outside of brackets and strings.
+// False once all of them were read
+bool next_operand(con_strview args, size_t* pos, con_strview* operand) {
+  if (*pos > args.size || args.empty()) {
+    return false;
+  }
+  size_t end = *pos;
+  int depth = 0;
+  char quote = '\0';
+  for (; end < args.size; ++end) {
+    const char c = args[end];
+    if (quote != '\0') {
+      if (c == '\\' && quote == '`') {
+        ++end;
+      } else if (c == quote) {
+        quote = '\0';
+      }
+    } else if (c == '\'' || c == '"' || c == '`') {
+      quote = c;
+    } else if (c == '[' || c == '(') {
+      ++depth;
+    } else if (c == ']' || c == ')') {
+      --depth;
+    } else if (c == ',' && depth == 0) {
+      break;
+    }
+  }
+  *operand = trim(args.substr(*pos, end-*pos));
+  *pos = end+1;
+  if (operand->empty()) {
+    throw invalid_argument("Empty operand");
+  }
+  return true;
+}
+
+con_strview strip_comment(con_strview line) {
+  char quote = '\0';
+  for (size_t i = 0; i < line.size; ++i) {
+    const char c = line[i];
+    if (quote != '\0') {
+      if (c == '\\' && quote == '`') {
+        ++i;
+      } else if (c == quote) {
+        quote = '\0';
+      }
+    } else if (c == '\'' || c == '"' || c == '`') {
+      quote = c;
+    } else if (c == ';') {
+      return line.substr(0, i);
+    }
+  }
+  return line;
+}
+
+con_strview trim(con_strview text) {
+  size_t start = 0;
+  while (start < text.size && (text[start] == ' ' || text[start] == '\t' || text[start] == '\r')) ++start;
+  size_t end = text.size;
+  while (end > start && (text[end-1] == ' ' || text[end-1] == '\t' || text[end-1] == '\r')) --end;
+  return text.substr(start, end-start);
+}
+
+bool is_identifier_start(const char& c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.' || c == '?' || c == '@';
+}
+
+bool is_identifier_char(const char& c) {
+  return is_identifier_start(c) || (c >= '0' && c <= '9') || c == '$' || c == '#' || c == '~';
+}
+
+bool lookup_register(con_strview name, x86_register* reg) {
+  char buffer[8];
+  const con_strview word = lower(name, buffer, sizeof(buffer));
+  con_strview found;
+  switch (con_hash(word)) {
+#define CON_REGISTER(_name, _number, _size, _flags) \
+    case con_hash(_name): found = _name; reg->number = _number; reg->size = _size; reg->flags = _flags; break;
+#include "construct_x86.def"
+#undef CON_REGISTER
+    default:
+      break;
+  }
+  return !found.empty() && found == word; // unknown names can still share a hash with a known one
+}
+
+bool lookup_insn(con_strview name, x86_insn* insn) {
+  char buffer[8];
+  const con_strview word = lower(name, buffer, sizeof(buffer));
+  con_strview found;
+  switch (con_hash(word)) {
+#define CON_INSN(_name, _kind, _arg) case con_hash(_name): found = _name; insn->kind = _kind; insn->arg = _arg; break;
+#include "construct_x86.def"
+#undef CON_INSN
+    default:
+      break;
+  }
+  return !found.empty() && found == word;
+}
+
+CON_DIRECTIVE lookup_directive(con_strview name, int* unit) {
+  char buffer[8];
+  const con_strview word = lower(name, buffer, sizeof(buffer));
+  con_strview found;
+  CON_DIRECTIVE directive = DIRECTIVE_NONE;
+  switch (con_hash(word)) {
+#define CON_DIRECTIVE_CASE(_name, _directive, _unit) \
+    case con_hash(_name): found = _name; directive = _directive; *unit = _unit; break;
+    CON_DIRECTIVE_CASE("global" , DIRECTIVE_GLOBAL , 0)
+    CON_DIRECTIVE_CASE("extern" , DIRECTIVE_EXTERN , 0)
+    CON_DIRECTIVE_CASE("section", DIRECTIVE_SECTION, 0)
+    CON_DIRECTIVE_CASE("segment", DIRECTIVE_SECTION, 0)
+    CON_DIRECTIVE_CASE("default", DIRECTIVE_DEFAULT, 0)
+    CON_DIRECTIVE_CASE("bits"   , DIRECTIVE_BITS   , 0)
+    CON_DIRECTIVE_CASE("db"     , DIRECTIVE_DATA   , 1)
+    CON_DIRECTIVE_CASE("dw"     , DIRECTIVE_DATA   , 2)
+    CON_DIRECTIVE_CASE("dd"     , DIRECTIVE_DATA   , 4)
+    CON_DIRECTIVE_CASE("dq"     , DIRECTIVE_DATA   , 8)
+    CON_DIRECTIVE_CASE("resb"   , DIRECTIVE_RESERVE, 1)
+    CON_DIRECTIVE_CASE("resw"   , DIRECTIVE_RESERVE, 2)
+    CON_DIRECTIVE_CASE("resd"   , DIRECTIVE_RESERVE, 4)
+    CON_DIRECTIVE_CASE("resq"   , DIRECTIVE_RESERVE, 8)
+#undef CON_DIRECTIVE_CASE
+    default:
+      break;
+  }
+  return !found.empty() && found == word ? directive : DIRECTIVE_NONE;
+}
+
+int lookup_size(con_strview name) {
+  char buffer[8];
+  const con_strview word = lower(name, buffer, sizeof(buffer));
+  if (word == "byte") return 1;
+  if (word == "word") return 2;
+  if (word == "dword") return 4;
+  if (word == "qword") return 8;
+  return 0;
+}
+
+// Lower case copy of name in buffer, empty when it does not fit
+con_strview lower(con_strview name, char* buffer, const size_t& capacity) {
+  if (name.size > capacity) {
+    return con_strview();
+  }
+  for (size_t i = 0; i < name.size; ++i) {
+    buffer[i] = name[i] >= 'A' && name[i] <= 'Z' ? name[i]-'A'+'a' : name[i];
+  }
+  return con_strview(buffer, name.size);
+}
+
+uint32_t symbol_index(con_strview name, elf_object* object) {
+  unordered_map<con_strview, uint32_t, elf_name_hash>::const_iterator found = object->symbol_map.find(name);
+  if (found != object->symbol_map.end()) {
+    return found->second;
+  }
+  const uint32_t index = object->symbols.size();
+  elf_symbol symbol;
+  symbol.name = name;
+  object->symbols.push_back(symbol);
+  object->symbol_map.emplace(name, index);
+  return index;
+}
+
+void define_label(con_strview name, elf_object* object) {
+  if (name[0] == '.' && !object->last_label.empty()) {
+    name = con_strdup(&object->arena, object->last_label.str()+name);
+  } else if (name[0] != '.') {
+    object->last_label = name;
+  }
+  elf_section& section = current_section(object);
+  elf_symbol& symbol = object->symbols[symbol_index(name, object)];
+  if (symbol.section >= 0 || symbol.external) {
+    throw invalid_argument("Symbol \""+name.str()+"\" defined twice");
+  }
+  symbol.section = object->section;
+  symbol.offset = section.type == SHT_NOBITS ? section.bss_size : section.data.size();
+}
+
+// nasm starts out in .text
+elf_section& current_section(elf_object* object) {
+  if (object->section < 0) {
+    switch_section(".text", object);
+  }
+  return object->sections[object->section];
+}
+
+void switch_section(con_strview name, elf_object* object) {
+  if (name.empty()) {
+    throw invalid_argument("Expected a section name");
+  }
+  for (size_t i = 0; i < object->sections.size(); ++i) {
+    if (object->sections[i].name == name) {
+      object->section = i;
+      return;
+    }
+  }
+  elf_section section;
+  section.name = name;
+  section.type = SHT_PROGBITS;
+  if (name == ".text") {
+    section.flags = SHF_ALLOC | SHF_EXECINSTR;
+    section.align = 16;
+  } else if (name == ".data") {
+    section.flags = SHF_ALLOC | SHF_WRITE;
+    section.align = 4;
+  } else if (name == ".rodata") {
+    section.flags = SHF_ALLOC;
+    section.align = 4;
+  } else if (name == ".bss") {
+    section.type = SHT_NOBITS;
+    section.flags = SHF_ALLOC | SHF_WRITE;
+    section.align = 4;
+  } else {
+    section.flags = SHF_ALLOC;
+    section.align = 1;
+  }
+  object->sections.push_back(section);
+  object->section = object->sections.size()-1;
+}
+
+// Offset in the laid out section of an offset in section.data
+size_t final_offset(const elf_section& section, const size_t& offset) {
+  const size_t before = lower_bound(section.branches.begin(), section.branches.end(), offset,
+                                    [](const elf_branch& branch, const size_t& at) { return branch.offset < at; })
+                        - section.branches.begin();
+  return offset+section.growth[before];
+}
+
+// Makes the jumps that don't reach their label with a short jump long, until all of them reach it.
+// Jumps only grow, so this ends
+void lay_out(elf_section* section, elf_object* object) {
+  vector<elf_branch>& branches = section->branches;
+  for (vector<elf_branch>::iterator it = branches.begin(); it != branches.end(); ++it) {
+    it->is_long = object->symbols[it->symbol].section != &*section-&object->sections[0];
+  }
+  section->growth.assign(branches.size()+1, 0);
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 0; i < branches.size(); ++i) {
+      section->growth[i+1] = section->growth[i]+(branches[i].is_long ? branches[i].condition < 0 ? 3 : 4 : 0);
+    }
+    for (vector<elf_branch>::iterator it = branches.begin(); it != branches.end(); ++it) {
+      if (it->is_long) {
+        continue;
+      }
+      const int64_t target = final_offset(*section, object->symbols[it->symbol].offset)+it->addend;
+      const int64_t from = final_offset(*section, it->offset)+2;
+      if (target-from < -128 || target-from > 127) {
+        it->is_long = true;
+        changed = true;
+      }
+    }
+  }
+}
+
+// Symbol table order: the null symbol, section symbols, local labels, then global and external symbols
+void number_symbols(elf_object* object) {
+  uint32_t index = 1;
+  for (vector<elf_section>::iterator it = object->sections.begin(); it != object->sections.end(); ++it) {
+    it->symbol = index++;
+  }
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1) {
+      object->first_global = index;
+    }
+    for (vector<elf_symbol>::iterator it = object->symbols.begin(); it != object->symbols.end(); ++it) {
+      if ((it->global || it->external) == (pass == 1)) {
+        it->index = index++;
+      }
+    }
+  }
+  object->symtab_size = index;
+}
+
+// Writes the laid out section and its relocations, references to the section itself are filled in
+void resolve(elf_section* section, elf_object* object) {
+  const int section_index = section-&object->sections[0];
+  string& data = section->final_data;
+  data.reserve(section->data.size()+section->growth.back());
+  size_t copied = 0;
+  for (vector<elf_branch>::const_iterator it = section->branches.cbegin(); it != section->branches.cend(); ++it) {
+    data.append(section->data, copied, it->offset-copied);
+    copied = it->offset+2;
+    const elf_symbol& target = object->symbols[it->symbol];
+    if (!it->is_long) {
+      data += static_cast<char>(it->condition < 0 ? 0xEB : 0x70+it->condition);
+      data += static_cast<char>(target.offset+it->addend-(data.size()+1));
+      continue;
+    }
+    if (it->condition < 0) {
+      data += '\xE9';
+    } else {
+      data += '\x0F';
+      data += static_cast<char>(0x80+it->condition);
+    }
+    if (target.section == section_index) {
+      put(&data, target.offset+it->addend-(data.size()+4), 4);
+    } else {
+      add_reloc(section, data.size(), R_X86_64_PLT32, it->symbol, it->addend-4, *object);
+      put(&data, 0, 4);
+    }
+  }
+  data.append(section->data, copied, string::npos);
+
+  for (vector<elf_fixup>::const_iterator it = section->fixups.cbegin(); it != section->fixups.cend(); ++it) {
+    const size_t offset = final_offset(*section, it->offset);
+    const elf_symbol& target = object->symbols[it->symbol];
+    const bool relative = it->type == R_X86_64_PC32 || it->type == R_X86_64_PLT32;
+    if (relative && target.section == section_index) {
+      const int64_t value = static_cast<int64_t>(target.offset)+it->addend-static_cast<int64_t>(offset);
+      if (value != static_cast<int32_t>(value)) {
+        throw std::runtime_error("Reference to \""+target.name.str()+"\" out of range");
+      }
+      string field;
+      put(&field, value, 4);
+      data.replace(offset, 4, field);
+    } else {
+      add_reloc(section, offset, it->type, it->symbol, it->addend, *object);
+    }
+  }
+}
+
+// Relocations to labels that are not global are made to the section they are in
+void add_reloc(elf_section* section, const size_t& offset, uint32_t type, const uint32_t& symbol,
+               int64_t addend, const elf_object& object) {
+  const elf_symbol& target = object.symbols[symbol];
+  Elf64_Rela reloc;
+  reloc.r_offset = offset;
+  if (target.section >= 0 && !target.global) {
+    if (type == R_X86_64_PLT32) {
+      type = R_X86_64_PC32;
+    }
+    addend += target.offset;
+    reloc.r_info = ELF64_R_INFO(object.sections[target.section].symbol, type);
+  } else {
+    reloc.r_info = ELF64_R_INFO(target.index, type);
+  }
+  reloc.r_addend = addend;
+  section->relocs.push_back(reloc);
+}
+
+void put(string* data, const uint64_t& value, const int& size) {
+  for (int i = 0; i < size; ++i) {
+    *data += static_cast<char>(value >> (i*8) & 0xFF);
+  }
+}
+
+// Header, section contents, symbols, strings and relocations, then the section headers
+void write_object(elf_object* object, con_emitter* emitter) {
+  const vector<elf_section>& sections = object->sections;
+  const vector<elf_symbol>& symbols = object->symbols;
+
+  vector<Elf64_Sym> symtab(object->symtab_size);
+  memset(symtab.data(), 0, symtab.size()*sizeof(Elf64_Sym));
+  string strtab(1, '\0');
+  for (size_t i = 0; i < sections.size(); ++i) {
+    Elf64_Sym& sym = symtab[sections[i].symbol];
+    sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    sym.st_shndx = i+1;
+  }
+  for (vector<elf_symbol>::const_iterator it = symbols.cbegin(); it != symbols.cend(); ++it) {
+    Elf64_Sym& sym = symtab[it->index];
+    sym.st_name = strtab.size();
+    strtab += it->name;
+    strtab += '\0';
+    sym.st_info = ELF64_ST_INFO(it->global || it->external ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+    sym.st_shndx = it->section >= 0 ? it->section+1 : SHN_UNDEF;
+    sym.st_value = it->section >= 0 ? it->offset : 0;
+  }
+
+  string image(sizeof(Elf64_Ehdr), '\0');
+  vector<Elf64_Shdr> headers(1);
+  memset(&headers[0], 0, sizeof(Elf64_Shdr));
+  string shstrtab(1, '\0');
+  auto add_section = [&](con_strview name, const uint32_t& type, const uint64_t& flags, const uint64_t& align,
+                         const char* data, const size_t& size, const uint32_t& link, const uint32_t& info,
+                         const uint64_t& entsize) {
+    Elf64_Shdr header;
+    memset(&header, 0, sizeof(header));
+    header.sh_name = shstrtab.size();
+    shstrtab += name;
+    shstrtab += '\0';
+    header.sh_type = type;
+    header.sh_flags = flags;
+    image.append((align-image.size()%align)%align, '\0');
+    header.sh_offset = image.size();
+    header.sh_size = size;
+    if (type != SHT_NOBITS) {
+      image.append(data, size);
+    }
+    header.sh_link = link;
+    header.sh_info = info;
+    header.sh_addralign = align;
+    header.sh_entsize = entsize;
+    headers.push_back(header);
+    return static_cast<uint32_t>(headers.size()-1);
+  };
+  for (vector<elf_section>::const_iterator it = sections.cbegin(); it != sections.cend(); ++it) {
+    const bool nobits = it->type == SHT_NOBITS;
+    add_section(it->name, it->type, it->flags, it->align, it->final_data.data(),
+                nobits ? it->bss_size : it->final_data.size(), 0, 0, 0);
+  }
+  const uint32_t symtab_index = headers.size();
+  const uint32_t strtab_index = symtab_index+1;
+  add_section(".symtab", SHT_SYMTAB, 0, 8, reinterpret_cast<const char*>(symtab.data()),
+              symtab.size()*sizeof(Elf64_Sym), strtab_index, object->first_global, sizeof(Elf64_Sym));
+  add_section(".strtab", SHT_STRTAB, 0, 1, strtab.data(), strtab.size(), 0, 0, 0);
+  for (size_t i = 0; i < sections.size(); ++i) {
+    if (sections[i].relocs.empty()) {
+      continue;
+    }
+    const string name = ".rela"+sections[i].name;
+    add_section(con_strview(name), SHT_RELA, SHF_INFO_LINK, 8,
+                reinterpret_cast<const char*>(sections[i].relocs.data()),
+                sections[i].relocs.size()*sizeof(Elf64_Rela), symtab_index, i+1, sizeof(Elf64_Rela));
+  }
+  const uint32_t shstrtab_index = add_section(".shstrtab", SHT_STRTAB, 0, 1, "", 0, 0, 0, 0);
+  headers[shstrtab_index].sh_offset = image.size(); // the names are complete only now
+  headers[shstrtab_index].sh_size = shstrtab.size();
+  image += shstrtab;
+
+  image.append((8-image.size()%8)%8, '\0');
+  Elf64_Ehdr header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = ELFCLASS64;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  header.e_type = ET_REL;
+  header.e_machine = EM_X86_64;
+  header.e_version = EV_CURRENT;
+  header.e_shoff = image.size();
+  header.e_ehsize = sizeof(Elf64_Ehdr);
+  header.e_shentsize = sizeof(Elf64_Shdr);
+  header.e_shnum = headers.size();
+  header.e_shstrndx = shstrtab_index;
+  memcpy(&image[0], &header, sizeof(header));
+  image.append(reinterpret_cast<const char*>(headers.data()), headers.size()*sizeof(Elf64_Shdr));
+  emitter->write(con_strview(image));
+}
@@ -0,0 +1,47 @@
+#ifndef CONSTRUCT_ELF_H_
+#define CONSTRUCT_ELF_H_
+
+#include "construct_types.h"
+
+class con_emitter;
+
+// The instructions of construct_x86.def by the operands they take
+enum CON_INSN_KIND {
+  INSN_ALU,
+  INSN_MOV,
+  INSN_TEST,
+  INSN_XCHG,
+  INSN_LEA,
+  INSN_INCDEC,
+  INSN_UNARY,
+  INSN_IMUL,
+  INSN_SHIFT,
+  INSN_MOVX,
+  INSN_MOVSXD,
+  INSN_PUSH,
+  INSN_POP,
+  INSN_CALL,
+  INSN_JMP,
+  INSN_RET,
+  INSN_INT,
+  INSN_JCC,
+  INSN_SETCC,
+  INSN_CMOVCC,
+  INSN_FIXED
+};
+
+// Assembles nasm as construct writes it to an ELF64 relocatable object, without running nasm.
+// Understood are global, extern and section (.text, .data, .rodata, .bss), labels (names starting
+// with '.' belong to the label before them), db/dw/dd/dq, resb/resw/resd/resq and the instructions
+// of construct_x86.def with register, immediate and [base+index*scale+disp] operands. Immediates
+// and displacements are numbers, characters or a symbol plus a number. Jumps to labels of the same
+// section are made short when they can be. Throws on lines it can't encode, those need nasm
+void assemble_elf64(con_strview nasm, con_emitter* emitter);
+
+// Bytes one instruction line takes, with jumps to labels short. -1 when it can't be encoded
+int x86_insn_size(con_strview line);
+int x86_insn_size(const con_cmd& cmd);
+// Kind and arg (see construct_x86.def) of an instruction, false when it is not one of the def file
+bool x86_insn_kind(con_strview name, CON_INSN_KIND* kind, uint32_t* arg);
+
+#endif // CONSTRUCT_ELF_H_
@@ -0,0 +1,114 @@
+#include <string>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "construct_emitter.h"
+
+using namespace std;
+
+con_emitter::con_emitter(size_t buffer_size) : buffer_(new char[buffer_size]), capacity_(buffer_size) {}
+
+con_emitter::~con_emitter() {
+  if (!tmp_path_.empty()) { // not closed after a complete write, the temporary file is dropped
+    used_ = 0;
+    failed_ = true;
+  }
+  close();
+  delete[] buffer_;
+}
+
+int con_emitter::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  failed_ = fd_ < 0;
+  return failed_ ? -1 : 0;
+}
+
+int con_emitter::open_replacing(const std::string& path) {
+  static atomic<unsigned> tmp_amnt(0); // several threads may replace the same path at once
+  const string tmp_path = path+".tmp"+to_string(getpid())+"_"+to_string(tmp_amnt++);
+  if (open(tmp_path) != 0) {
+    return -1;
+  }
+  path_ = path;
+  tmp_path_ = tmp_path;
+  return 0;
+}
+
+void con_emitter::open_text(std::string* text) {
+  close();
+  text_ = text;
+  failed_ = false;
+}
+
+int con_emitter::close() {
+  if (text_ != nullptr) {
+    flush();
+    text_ = nullptr;
+    return 0;
+  }
+  if (fd_ < 0) {
+    return failed_ ? -1 : 0;
+  }
+  flush();
+  if (::close(fd_) != 0) {
+    failed_ = true;
+  }
+  fd_ = -1;
+  if (!tmp_path_.empty()) {
+    if (failed_ || rename(tmp_path_.c_str(), path_.c_str()) != 0) {
+      unlink(tmp_path_.c_str());
+      failed_ = true;
+    }
+    path_.clear();
+    tmp_path_.clear();
+  }
+  return failed_ ? -1 : 0;
+}
+
+int con_emitter::flush() {
+  if (text_ != nullptr) {
+    text_->append(buffer_, used_);
+    used_ = 0;
+    return 0;
+  }
+  const char* data = buffer_;
+  size_t left = used_;
+  while (left > 0 && fd_ >= 0) {
+    ssize_t written = ::write(fd_, data, left);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      failed_ = true;
+      break;
+    }
+    data += written;
+    left -= written;
+  }
+  used_ = 0;
+  return failed_ ? -1 : 0;
+}
+
+void con_emitter::write_slow(con_strview str) {
+  flush();
+  if (str.size <= capacity_) {
+    memcpy(buffer_, str.data, str.size);
+    used_ = str.size;
+    return;
+  }
+  // Bigger than the whole buffer: write it through directly
+  if (text_ != nullptr) {
+    text_->append(str.data, str.size);
+    return;
+  }
+  while (str.size > 0 && fd_ >= 0) {
+    ssize_t written = ::write(fd_, str.data, str.size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      failed_ = true;
+      break;
+    }
+    str = str.substr(written);
+  }
+}
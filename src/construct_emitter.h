@@ -0,0 +1,58 @@
+#ifndef CONSTRUCT_EMITTER_H_
+#define CONSTRUCT_EMITTER_H_
+
+#include <string>
+#include "construct_types.h"
+
+// Buffered output file. Text is collected in a fixed-size buffer that is written to the file
+// descriptor whenever it fills up, so output reaches the disk while compilation is still running.
+// Opened on a string instead, the buffer is appended to the string.
+// Opened with open_replacing, it writes to a temporary file next to the path that close() renames
+// to it, so the path keeps what it had when the emitter is destroyed without close().
+class con_emitter {
+ public:
+  explicit con_emitter(size_t buffer_size = 1 << 20);
+  con_emitter(const con_emitter&) = delete;
+  con_emitter& operator=(const con_emitter&) = delete;
+  ~con_emitter();
+
+  int open(const std::string& path);
+  int open_replacing(const std::string& path);
+  void open_text(std::string* text);
+  int close();
+
+  void write(con_strview str) {
+    if (str.size > capacity_-used_) {
+      write_slow(str);
+      return;
+    }
+    memcpy(buffer_+used_, str.data, str.size);
+    used_ += str.size;
+  }
+  void write(char c, size_t amnt = 1) {
+    while (amnt > capacity_-used_) {
+      size_t part = capacity_-used_;
+      memset(buffer_+used_, c, part);
+      used_ += part;
+      amnt -= part;
+      flush();
+    }
+    memset(buffer_+used_, c, amnt);
+    used_ += amnt;
+  }
+  int flush();
+
+ private:
+  void write_slow(con_strview str);
+
+  int fd_ = -1;
+  std::string path_;     // renamed to on close() when opened with open_replacing
+  std::string tmp_path_; // written to until then
+  std::string* text_ = nullptr;
+  char* buffer_;
+  size_t used_ = 0;
+  size_t capacity_;
+  bool failed_ = false;
+};
+
+#endif // CONSTRUCT_EMITTER_H_
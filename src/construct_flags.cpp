@@ -1,65 +1,125 @@
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
 #include "construct_flags.h"
 #include "construct_types.h"
 
-extern CON_BITWIDTH bitwidth;
-
 using namespace std;
 
-int set_bitwidth(char* argv) {
+static int read_response_file(const string& path, vector<string>* paths);
+
+int set_bitwidth(char* argv, CON_BITWIDTH* bitwidth) {
   if (string(argv) == "elf8") {
-    bitwidth = BIT8;
+    *bitwidth = BIT8;
     return 0;
   }
   if (string(argv) == "elf16") {
-    bitwidth = BIT16;
+    *bitwidth = BIT16;
     return 0;
   }
   if (string(argv) == "elf32") {
-    bitwidth = BIT32;
+    *bitwidth = BIT32;
     return 0;
   }
   if (string(argv) == "elf64") {
-    bitwidth = BIT64;
+    *bitwidth = BIT64;
     return 0;
   }
   cout << "\"" << argv << "\" not a supported format" << endl;
   return -1;
 }
 
-int handle_flags(int argc, char** argv, string* path, string* outpath) {
+int handle_flags(int argc, char** argv, con_options* options) {
   bool bitwidth_set = false;
-  bool path_set = false;
   bool outpath_set = false;
   for (int i = 1; i < argc; ++i) {
-    if (string(argv[i]) == "-f" && set_bitwidth(argv[i+1]) == 0) {
+    if (string(argv[i]) == "-f" && i+1 < argc && set_bitwidth(argv[i+1], &options->bitwidth) == 0) {
       bitwidth_set = true;
       ++i;
       continue;
     }
-    if (string(argv[i]) == "-i") {
-      path_set = true;
+    if (string(argv[i]) == "-i" && i+1 < argc) {
       ++i;
-      (*path) = argv[i];
+      options->paths.push_back(argv[i]);
       continue;
     }
-    if (string(argv[i]) == "-o") {
+    if (string(argv[i]) == "-o" && i+1 < argc) {
       outpath_set = true;
       ++i;
-      (*outpath) = argv[i];
+      options->outpath = argv[i];
+      continue;
+    }
+    if (string(argv[i]) == "-c" && i+1 < argc) {
+      ++i;
+      options->cache_dir = argv[i];
+      continue;
+    }
+    if (string(argv[i]) == "--time-passes") {
+      options->time_passes = true;
+      continue;
+    }
+    if (string(argv[i]) == "--stats") {
+      options->stats = true;
+      continue;
+    }
+    if (string(argv[i]) == "--json") {
+      options->json = true;
+      continue;
+    }
+    if (string(argv[i]) == "--stream") {
+      options->stream = true;
+      continue;
+    }
+    if (string(argv[i]) == "--ast") {
+      options->write_ast = true;
+      continue;
+    }
+    if (string(argv[i]) == "--obj") {
+      options->write_object = true;
+      continue;
+    }
+    if (string(argv[i]) == "-O") {
+      options->optimize = true;
+      continue;
+    }
+    if (string(argv[i]) == "--depfile") {
+      options->write_depfile = true;
+      continue;
+    }
+    if (string(argv[i]) == "-s" && i+1 < argc) {
+      ++i;
+      options->socket_path = argv[i];
       continue;
     }
-    if (path != NULL) {
-      path_set = true;
-      (*path) = argv[i];
+    if (string(argv[i]) == "-j" && i+1 < argc) {
+      ++i;
+      char* end = nullptr;
+      unsigned long jobs = strtoul(argv[i], &end, 10);
+      if (*end != '\0' || jobs == 0) {
+        cout << "\"" << argv[i] << "\" not a valid job count" << endl;
+        return -1;
+      }
+      options->jobs = jobs;
+      continue;
     }
+    if (argv[i][0] == '@') {
+      if (read_response_file(argv[i]+1, &options->paths) != 0) {
+        cout << "Could not read response file \"" << argv[i]+1 << "\"" << endl;
+        return -1;
+      }
+      continue;
+    }
+    options->paths.push_back(argv[i]);
+  }
+  if (!options->socket_path.empty()) {
+    return 0;
   }
   if (!bitwidth_set) {
     cout << "flag -f (format) not set" << endl;
     return -1;
   }
-  if (!path_set) {
+  if (options->paths.empty()) {
     cout << "flag -i (input file) not set" << endl;
     return -1;
   }
@@ -67,5 +127,30 @@ int handle_flags(int argc, char** argv, string* path, string* outpath) {
     cout << "flag -o (output file) not set" << endl;
     return -1;
   }
+  if (options->write_object && (options->bitwidth != BIT64 || options->write_ast)) {
+    cout << "flag --obj needs -f elf64 and can't be combined with --ast" << endl;
+    return -1;
+  }
+  return 0;
+}
+
+std::string output_extension(const con_options& options) {
+  if (options.write_ast) {
+    return ".ast";
+  }
+  return options.write_object ? ".o" : ".asm";
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+int read_response_file(const string& path, vector<string>* paths) {
+  ifstream file(path);
+  if (!file) {
+    return -1;
+  }
+  string input_path;
+  while (file >> input_path) {
+    paths->push_back(input_path);
+  }
   return 0;
 }
@@ -2,9 +2,34 @@
 #define CONSTRUCT_FLAGS_H_
 
 #include <string>
+#include <vector>
+#include "construct_types.h"
 
-int set_bitwidth(char* argv);
+struct con_options {
+  CON_BITWIDTH bitwidth = BIT64;
+  std::vector<std::string> paths; // input files, in the order they were given
+  std::string outpath;            // output file, or output directory when there are several inputs
+  unsigned jobs = 0;              // compilations running at once, 0 is one per core
+  std::string cache_dir;          // lowered functions are cached here when set
+  std::string socket_path;        // run as a compile server on this socket when set
+  bool time_passes = false;       // report time, tokens and allocations of every stage
+  bool stats = false;             // time_passes and the lowering counters
+  bool json = false;              // report as JSON
+  bool stream = false;            // compile in batches of top-level blocks with bounded memory
+  bool write_ast = false;         // write the pre-parsed tree instead of nasm
+  bool write_object = false;      // write an ELF64 object instead of nasm, see construct_elf.h
+  bool write_depfile = false;     // write a make rule listing the imported files to <output>.d
+  bool optimize = false;          // run the peephole pass, see construct_peephole.h
+};
 
-int handle_flags(int argc, char** argv, std::string* path, std::string* outpath);
+int set_bitwidth(char* argv, CON_BITWIDTH* bitwidth);
+
+// What batch mode appends to the name of every input: .asm, .ast or .o
+std::string output_extension(const con_options& options);
+
+// Inputs are given with -i, as plain arguments or as @file, a response file holding
+// whitespace separated input paths. With -s SOCKET no other flag is needed, the server gets them
+// with every request
+int handle_flags(int argc, char** argv, con_options* options);
 
 #endif // CONSTRUCT_FLAGS_H_
@@ -0,0 +1,49 @@
+#ifndef CONSTRUCT_HASH_H_
+#define CONSTRUCT_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "construct_types.h"
+
+// 32 bit FNV-1a. The constexpr overloads hash string literals at compile time, so a fixed
+// vocabulary can be matched with a switch over con_hash values: a collision between two entries
+// is a duplicate case label and fails the build, so such a switch is a perfect hash.
+
+constexpr uint32_t con_hash(const char* str, size_t size, uint32_t hash = 2166136261u) {
+  return size == 0 ? hash : con_hash(str+1, size-1, (hash ^ static_cast<uint8_t>(str[0])) * 16777619u);
+}
+template <size_t N>
+constexpr uint32_t con_hash(const char (&str)[N]) {
+  return con_hash(str, N-1);
+}
+
+inline uint32_t con_hash(con_strview str) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < str.size; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(str[i])) * 16777619u;
+  }
+  return hash;
+}
+
+// 64 bit FNV-1a for keys that have to stay unique across many inputs, like cache keys. Strings are
+// hashed with their size first, so consecutive fields can't run into each other
+const uint64_t CON_HASH64_INIT = 14695981039346656037ull;
+
+inline uint64_t con_hash64(const void* data, size_t size, uint64_t hash = CON_HASH64_INIT) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+inline uint64_t con_hash64(con_strview str, uint64_t hash = CON_HASH64_INIT) {
+  const uint64_t size = str.size;
+  return con_hash64(str.data, str.size, con_hash64(&size, sizeof(size), hash));
+}
+
+// For unordered containers keyed by names
+struct con_strview_hash {
+  size_t operator()(const con_strview& str) const { return con_hash(str); }
+};
+
+#endif // CONSTRUCT_HASH_H_
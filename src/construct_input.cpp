@@ -0,0 +1,58 @@
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "construct_input.h"
+
+using namespace std;
+
+con_input::~con_input() {
+  close();
+}
+
+int con_input::open(const std::string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+      ::close(fd);
+      data_ = static_cast<const char*>(mapping);
+      size_ = st.st_size;
+      mapped_ = true;
+      return 0;
+    }
+  }
+
+  // Fallback: read everything in large chunks
+  char chunk[1 << 16];
+  ssize_t amnt;
+  while ((amnt = read(fd, chunk, sizeof(chunk))) != 0) {
+    if (amnt < 0) {
+      ::close(fd);
+      buffer_.clear();
+      return -1;
+    }
+    buffer_.append(chunk, amnt);
+  }
+  ::close(fd);
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+  return 0;
+}
+
+void con_input::close() {
+  if (mapped_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  buffer_.clear();
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+}
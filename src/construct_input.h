@@ -0,0 +1,28 @@
+#ifndef CONSTRUCT_INPUT_H_
+#define CONSTRUCT_INPUT_H_
+
+#include <string>
+#include "construct_types.h"
+
+// Read-only view of an input file. Regular files are memory-mapped, anything else
+// (pipes, empty files, ...) is read into a single buffer.
+class con_input {
+ public:
+  con_input() = default;
+  con_input(const con_input&) = delete;
+  con_input& operator=(const con_input&) = delete;
+  ~con_input();
+
+  int open(const std::string& path);
+  void close();
+
+  con_strview view() const { return con_strview(data_, size_); }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string buffer_; // only used when the file could not be mapped
+};
+
+#endif // CONSTRUCT_INPUT_H_
@@ -0,0 +1,259 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <climits>
+#include <cstdlib>
+#include "construct_module.h"
+#include "construct_ast.h"
+#include "construct_emitter.h"
+#include "construct_input.h"
+#include "construct_threads.h"
+#include "deconstruct.h"
+
+using namespace std;
+
+static void parse_module(con_module* module);
+static string resolve_import(const string& importer_path, con_strview import);
+static string canonical_path(const string& path);
+static con_token* copy_token(const con_token& token, con_arena* arena);
+template <typename T>
+static con_list<T> copy_list(const con_list<T>& list, con_arena* arena);
+static con_token* make_text_section(con_arena* arena);
+static void write_escaped(const string& path, con_emitter* emitter);
+
+vector<con_strview> take_imports(con_token_list* tokens) {
+  vector<con_strview> imports;
+  for (con_token_list::iterator it = tokens->begin(); it != tokens->end();) {
+    if ((*it)->tok_type != CMD || (*it)->tok_cmd.command != "import") {
+      ++it;
+      continue;
+    }
+    con_strview import = (*it)->tok_cmd.arg1;
+    if (import.size >= 2 && import.front() == '"' && import.back() == '"') {
+      import = import.substr(1, import.size-2);
+    }
+    if (import.empty() || !(*it)->tok_cmd.arg2.empty()) {
+      throw invalid_argument("Invalid import: expected \"import path\"");
+    }
+    imports.push_back(import);
+    it = tokens->erase(it);
+  }
+  return imports;
+}
+
+bool con_has_imports(con_strview code) {
+  for (size_t pos = code.find(con_strview("import")); pos != con_strview::npos;
+       pos = code.find(con_strview("import"), pos+1)) {
+    if ((pos == 0 || code[pos-1] == '\n') && pos+6 < code.size && (code[pos+6] == ' ' || code[pos+6] == '\t')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+vector<const con_module*> con_modules::load(const string& importer_path, const vector<con_strview>& imports,
+                                            const unsigned& jobs) {
+  // Breadth first over the import graph, every level is parsed in parallel
+  map<entry*, vector<entry*>> edges;
+  vector<entry*> roots;
+  vector<entry*> level;
+  set<entry*> seen;
+  for (vector<con_strview>::const_iterator it = imports.cbegin(); it != imports.cend(); ++it) {
+    roots.push_back(find(resolve_import(importer_path, *it)));
+    if (seen.insert(roots.back()).second) {
+      level.push_back(roots.back());
+    }
+  }
+  while (!level.empty()) {
+    con_parallel_for(level.size(), jobs, [&](size_t i) {
+      call_once(level[i]->parsed, parse_module, &level[i]->module); // parse_module does not throw
+    });
+    vector<entry*> next;
+    for (vector<entry*>::const_iterator it = level.cbegin(); it != level.cend(); ++it) {
+      const con_module& module = (*it)->module;
+      if (!module.error.empty()) {
+        throw runtime_error(module.error);
+      }
+      vector<entry*>& targets = edges[*it];
+      for (vector<string>::const_iterator path = module.import_paths.cbegin();
+           path != module.import_paths.cend(); ++path) {
+        entry* target = find(*path);
+        targets.push_back(target);
+        if (seen.insert(target).second) {
+          next.push_back(target);
+        }
+      }
+    }
+    level.swap(next);
+  }
+
+  // Depth first for the order, a module is done once everything it imports is
+  vector<const con_module*> order;
+  map<entry*, bool> done; // false while its imports are visited
+  vector<entry*> chain;
+  const string importer = canonical_path(importer_path);
+  function<void(entry*)> visit = [&](entry* e) {
+    map<entry*, bool>::const_iterator state = done.find(e);
+    if (state != done.end() && state->second) {
+      return;
+    }
+    if (state != done.end() || canonical_path(e->module.path) == importer) {
+      string cycle = importer_path;
+      for (vector<entry*>::const_iterator it = chain.cbegin(); it != chain.cend(); ++it) {
+        cycle += " -> "+(*it)->module.path;
+      }
+      throw runtime_error("Import cycle: "+cycle+" -> "+e->module.path);
+    }
+    done[e] = false;
+    chain.push_back(e);
+    const vector<entry*>& targets = edges[e];
+    for (vector<entry*>::const_iterator it = targets.cbegin(); it != targets.cend(); ++it) {
+      visit(*it);
+    }
+    chain.pop_back();
+    done[e] = true;
+    order.push_back(&e->module);
+  };
+  for (vector<entry*>::const_iterator it = roots.cbegin(); it != roots.cend(); ++it) {
+    visit(*it);
+  }
+  return order;
+}
+
+con_modules::entry* con_modules::find(const string& path) {
+  lock_guard<mutex> lock(mutex_);
+  unique_ptr<entry>& found = entries_[canonical_path(path)];
+  if (!found) {
+    found.reset(new entry());
+    found->module.path = path;
+  }
+  return found.get();
+}
+
+void prepend_modules(const vector<const con_module*>& modules, con_token_list* tokens, con_arena* arena) {
+  if (modules.empty()) {
+    return;
+  }
+  con_token_list combined;
+  combined.push_back(arena, tokens->front()); // global _start
+  for (vector<const con_module*>::const_iterator it = modules.cbegin(); it != modules.cend(); ++it) {
+    const con_token_list& module_tokens = (*it)->tokens;
+    if (module_tokens.empty() || module_tokens.front()->tok_type != SECTION) {
+      combined.push_back(arena, make_text_section(arena));
+    }
+    for (con_token_list::const_iterator token = module_tokens.cbegin(); token != module_tokens.cend(); ++token) {
+      combined.push_back(arena, copy_token(**token, arena)); // lowering changes the tokens it is given
+    }
+  }
+  if (tokens->size() == 1 || (*tokens)[1]->tok_type != SECTION) {
+    combined.push_back(arena, make_text_section(arena));
+  }
+  combined.insert(arena, combined.end(), tokens->begin()+1, tokens->end());
+  *tokens = combined;
+}
+
+void write_depfile(const string& outpath, const string& path, const vector<const con_module*>& modules,
+                   con_emitter* emitter) {
+  write_escaped(outpath, emitter);
+  emitter->write(": ");
+  write_escaped(path, emitter);
+  for (vector<const con_module*>::const_iterator it = modules.cbegin(); it != modules.cend(); ++it) {
+    emitter->write(' ');
+    write_escaped((*it)->path, emitter);
+  }
+  emitter->write('\n');
+  // Deleting a module then makes make rebuild instead of failing
+  for (vector<const con_module*>::const_iterator it = modules.cbegin(); it != modules.cend(); ++it) {
+    emitter->write('\n');
+    write_escaped((*it)->path, emitter);
+    emitter->write(":\n");
+  }
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+void parse_module(con_module* module) {
+  con_input input;
+  if (input.open(module->path) != 0) {
+    module->error = "Could not read imported file \""+module->path+"\"";
+    return;
+  }
+  if (con_is_ast(input.view())) {
+    module->error = "Imported file \""+module->path+"\" is a pre-parsed tree, import its source instead";
+    return;
+  }
+  try {
+    con_token_list tokens = parse_construct(input.view(), &module->arena);
+    module->tokens = delinearize_tokens(tokens, &module->arena);
+    vector<con_strview> imports = take_imports(&module->tokens);
+    for (vector<con_strview>::const_iterator it = imports.cbegin(); it != imports.cend(); ++it) {
+      module->import_paths.push_back(resolve_import(module->path, *it));
+    }
+    module->lines = count(input.view().begin(), input.view().end(), '\n');
+  }
+  catch (const exception& e) {
+    module->error = module->path+": "+e.what();
+  }
+}
+string resolve_import(const string& importer_path, con_strview import) {
+  if (import.front() == '/') {
+    return import.str();
+  }
+  const size_t dir_end = importer_path.find_last_of('/');
+  return dir_end == string::npos ? import.str() : importer_path.substr(0, dir_end+1)+import;
+}
+// Tells apart different paths to the same file, paths that don't exist are kept for the error
+string canonical_path(const string& path) {
+  char resolved[PATH_MAX];
+  return realpath(path.c_str(), resolved) == nullptr ? path : string(resolved);
+}
+// The strings are shared, lowering replaces them instead of writing to them
+con_token* copy_token(const con_token& token, con_arena* arena) {
+  con_token* copy = arena->make<con_token>(token);
+  copy->tokens = con_token_list();
+  copy->tokens.reserve(arena, token.tokens.size());
+  for (con_token_list::const_iterator it = token.tokens.cbegin(); it != token.tokens.cend(); ++it) {
+    copy->tokens.push_back(arena, copy_token(**it, arena));
+  }
+  if (token.tok_type == FUNCTION) {
+    copy->tok_function.arguments = copy_list(token.tok_function.arguments, arena);
+  } else if (token.tok_type == FUNCALL) {
+    copy->tok_funcall.arguments = copy_list(token.tok_funcall.arguments, arena);
+  } else if (token.tok_type == SYSCALL) {
+    copy->tok_syscall.arguments = copy_list(token.tok_syscall.arguments, arena);
+  }
+  return copy;
+}
+template <typename T>
+con_list<T> copy_list(const con_list<T>& list, con_arena* arena) {
+  con_list<T> copy;
+  if (list.empty()) {
+    return copy;
+  }
+  copy.insert(arena, copy.begin(), list.begin(), list.end());
+  return copy;
+}
+con_token* make_text_section(con_arena* arena) {
+  con_token* section_tok = arena->make<con_token>(SECTION);
+  section_tok->tok_section.name = ".text";
+  section_tok->indentation = 0;
+  return section_tok;
+}
+// Make needs spaces and $ escaped
+void write_escaped(const string& path, con_emitter* emitter) {
+  for (string::const_iterator it = path.cbegin(); it != path.cend(); ++it) {
+    if (*it == ' ') {
+      emitter->write('\\');
+    } else if (*it == '$') {
+      emitter->write('$');
+    }
+    emitter->write(*it);
+  }
+}
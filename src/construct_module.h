@@ -0,0 +1,59 @@
+#ifndef CONSTRUCT_MODULE_H_
+#define CONSTRUCT_MODULE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include "construct_types.h"
+
+class con_emitter;
+
+// A file brought in with an "import path" line. Paths are relative to the importing file
+struct con_module {
+  std::string path;                       // as resolved from the first file importing it
+  con_arena arena;                        // owns the tokens
+  con_token_list tokens;                  // delinearized top-level tokens, imports taken out
+  std::vector<std::string> import_paths;  // resolved like path
+  uint64_t lines = 0;
+  std::string error;                      // why it could not be read or parsed, empty if it was
+};
+
+// Removes the top-level "import path" lines from tokens and returns their paths
+std::vector<con_strview> take_imports(con_token_list* tokens);
+
+// Whether a line of code starts with "import ", for callers that need to know before parsing
+bool con_has_imports(con_strview code);
+
+// The modules of a build, shared by all its inputs so that each file is parsed only once.
+// Safe to use from several threads at once
+class con_modules {
+ public:
+  // Every module importer (the file at importer_path) imports directly or indirectly, the modules
+  // it depends on before the module itself. The modules of a level of the dependency graph are
+  // parsed on up to jobs threads at once. Throws on unreadable files, parse errors and cycles
+  std::vector<const con_module*> load(const std::string& importer_path, const std::vector<con_strview>& imports,
+                                      const unsigned& jobs);
+
+ private:
+  struct entry {
+    std::once_flag parsed;
+    con_module module;
+  };
+
+  entry* find(const std::string& path);
+
+  std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<entry>> entries_; // by canonical path
+};
+
+// Copies the modules' tokens into tokens before the tokens of the importing file, which start with
+// the global _start line. Every module starts in .text, so does the importer after them
+void prepend_modules(const std::vector<const con_module*>& modules, con_token_list* tokens, con_arena* arena);
+
+// Writes the make rule "outpath: path <modules>" and an empty rule for every module to emitter
+void write_depfile(const std::string& outpath, const std::string& path,
+                   const std::vector<const con_module*>& modules, con_emitter* emitter);
+
+#endif // CONSTRUCT_MODULE_H_
@@ -0,0 +1,264 @@
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include "construct_peephole.h"
+#include "construct_cfg.h"
+#include "construct_elf.h"
+#include "construct_hash.h"
+#include "construct_stats.h"
+
+using namespace std;
+
+namespace {
+
+enum { REG_REX = 1, REG_HIGH = 2 };
+
+// A general purpose register, number is the one of the 64 bit register it is part of
+struct peephole_register {
+  int number;
+  int size;
+};
+
+// What an instruction does to the flags, as far as the zero idiom is concerned
+enum CON_FLAGS_USE {
+  FLAGS_UNKNOWN, // reads them, or might
+  FLAGS_KEEP,    // leaves them to the next instruction
+  FLAGS_WRITE    // sets all of them without reading any
+};
+
+}  // namespace
+
+static void apply_instruction_rules(vector<con_token*>& code, const CON_BITWIDTH& bitwidth,
+                                    con_counters* counters);
+static bool apply_jump_rules(vector<con_token*>& code, con_counters* counters);
+static bool flags_dead_after(const vector<con_token*>& code, size_t i);
+static CON_FLAGS_USE flags_use(con_strview command);
+static bool is_command(const con_token* token, con_strview command);
+static bool reads_register(con_strview operand, const int& number);
+static bool lookup_register(con_strview name, peephole_register* reg);
+static bool is_identifier_char(const char& c);
+static void count_saved(const int& before, const con_token& after, uint64_t* bytes);
+
+static const char* const dword_registers[16] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                                                "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+
+void peephole_tokens(con_token_list& tokens, const CON_BITWIDTH& bitwidth, con_arena* arena,
+                     con_counters* counters) {
+  con_cfg cfg;
+  build_cfg(tokens, &cfg);
+  apply_instruction_rules(cfg.code, bitwidth, counters);
+  // Every change to the jumps changes the graph, it is built again until they settle. A few times
+  // at most, jumps in a cycle never do
+  for (int pass = 0; pass < 8; ++pass) {
+    if (!chain_branches(&cfg, counters) && !remove_unreachable(&cfg, counters)
+        && !apply_jump_rules(cfg.code, counters)) {
+      break;
+    }
+    build_blocks(&cfg);
+  }
+  cfg_to_tokens(cfg, &tokens, arena);
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+// Zero idioms, cmp to test and the removal of movs, in one sweep from the end, so that what an
+// instruction is followed by is already final. Removed tokens become null
+void apply_instruction_rules(vector<con_token*>& code, const CON_BITWIDTH& bitwidth, con_counters* counters) {
+  size_t next_i = code.size(); // next token that was not removed
+  for (size_t i = code.size(); i-- > 0; next_i = code[i] == nullptr ? next_i : i) {
+    con_token* token = code[i];
+    if (token->tok_type != CMD) {
+      continue;
+    }
+    con_cmd& cmd = token->tok_cmd;
+    peephole_register reg;
+    if (!lookup_register(cmd.arg1, &reg)) {
+      continue;
+    }
+    if (cmd.command == "mov" && cmd.arg2 == cmd.arg1 && (reg.size != 4 || bitwidth != BIT64)) {
+      if (counters != nullptr) {
+        ++counters->peephole_movs;
+        const int size = x86_insn_size(token->tok_cmd);
+        counters->peephole_mov_bytes += size > 0 ? size : 0;
+      }
+      code[i] = nullptr;
+    } else if (cmd.command == "mov" && cmd.arg2 == "0" && reg.size >= 4 && flags_dead_after(code, i)) {
+      const int before = counters == nullptr ? 0 : x86_insn_size(token->tok_cmd);
+      cmd.command = "xor";
+      cmd.arg1 = dword_registers[reg.number];
+      cmd.arg2 = cmd.arg1;
+      if (counters != nullptr) {
+        ++counters->peephole_zero_idioms;
+        count_saved(before, *token, &counters->peephole_zero_idiom_bytes);
+      }
+    } else if (cmd.command == "cmp" && cmd.arg2 == "0") {
+      const int before = counters == nullptr ? 0 : x86_insn_size(token->tok_cmd);
+      cmd.command = "test";
+      cmd.arg2 = cmd.arg1;
+      if (counters != nullptr) {
+        ++counters->peephole_tests;
+        count_saved(before, *token, &counters->peephole_test_bytes);
+      }
+    } else if (cmd.command == "mov" && next_i < code.size() && is_command(code[next_i], "mov")) {
+      // Dead when the next mov overwrites all of the register: the same one or a 32/64 bit alias
+      const con_cmd& next = code[next_i]->tok_cmd;
+      peephole_register next_reg;
+      if (lookup_register(next.arg1, &next_reg) && next_reg.number == reg.number
+          && (next.arg1 == cmd.arg1 || next_reg.size >= 4) && !reads_register(next.arg2, reg.number)) {
+        if (counters != nullptr) {
+          ++counters->peephole_movs;
+          const int size = x86_insn_size(token->tok_cmd);
+          counters->peephole_mov_bytes += size > 0 ? size : 0;
+        }
+        code[i] = nullptr;
+      }
+    }
+  }
+}
+
+// Removal of jumps to the next instruction and of unused labels. Returns whether anything changed
+bool apply_jump_rules(vector<con_token*>& code, con_counters* counters) {
+  bool changed = false;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (code[i] == nullptr || !is_jump(code[i])) {
+      continue;
+    }
+    const con_cmd& jump = code[i]->tok_cmd;
+    // A jump to one of the labels right after it
+    for (size_t next = i+1; next < code.size() && (code[next] == nullptr || code[next]->tok_type == TAG); ++next) {
+      if (code[next] != nullptr && code[next]->tok_tag.name == jump.arg1) {
+        if (counters != nullptr) {
+          ++counters->peephole_jumps_removed;
+          const int size = x86_insn_size(code[i]->tok_cmd);
+          counters->peephole_jump_bytes += size > 0 ? size : 0;
+        }
+        code[i] = nullptr;
+        changed = true;
+        break;
+      }
+    }
+  }
+
+  unordered_set<con_strview, con_strview_hash> referenced;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (code[i] == nullptr || code[i]->tok_type != CMD) {
+      continue;
+    }
+    const con_strview args[2] = {code[i]->tok_cmd.arg1, code[i]->tok_cmd.arg2};
+    for (int a = 0; a < 2; ++a) {
+      for (size_t pos = 0; pos < args[a].size;) {
+        size_t end = pos;
+        while (end < args[a].size && is_identifier_char(args[a][end])) {
+          ++end;
+        }
+        if (end > pos) {
+          referenced.insert(args[a].substr(pos, end-pos));
+        }
+        pos = end+1;
+      }
+    }
+  }
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (code[i] != nullptr && code[i]->tok_type == TAG && code[i]->tok_tag.generated
+        && referenced.find(code[i]->tok_tag.name) == referenced.end()) {
+      code[i] = nullptr;
+      changed = true;
+      if (counters != nullptr) {
+        ++counters->peephole_labels_removed;
+      }
+    }
+  }
+  return changed;
+}
+
+// Whether the flags are written before anything could read them, following the code that runs next
+bool flags_dead_after(const vector<con_token*>& code, size_t i) {
+  for (++i; i < code.size(); ++i) {
+    if (code[i] == nullptr || code[i]->tok_type == TAG) {
+      continue;
+    }
+    if (code[i]->tok_type != CMD) {
+      return false;
+    }
+    const CON_FLAGS_USE use = flags_use(code[i]->tok_cmd.command);
+    if (use != FLAGS_KEEP) {
+      return use == FLAGS_WRITE;
+    }
+  }
+  return false;
+}
+CON_FLAGS_USE flags_use(con_strview command) {
+  con_strview found;
+  CON_FLAGS_USE use = FLAGS_UNKNOWN;
+  switch (con_hash(command)) {
+#define CON_FLAGS_CASE(_name, _use) case con_hash(_name): found = _name; use = _use; break;
+    CON_FLAGS_CASE("cmp", FLAGS_WRITE)
+    CON_FLAGS_CASE("test", FLAGS_WRITE)
+    CON_FLAGS_CASE("add", FLAGS_WRITE)
+    CON_FLAGS_CASE("sub", FLAGS_WRITE)
+    CON_FLAGS_CASE("and", FLAGS_WRITE)
+    CON_FLAGS_CASE("or", FLAGS_WRITE)
+    CON_FLAGS_CASE("xor", FLAGS_WRITE)
+    CON_FLAGS_CASE("neg", FLAGS_WRITE)
+    CON_FLAGS_CASE("mov", FLAGS_KEEP)
+    CON_FLAGS_CASE("movzx", FLAGS_KEEP)
+    CON_FLAGS_CASE("movsx", FLAGS_KEEP)
+    CON_FLAGS_CASE("movsxd", FLAGS_KEEP)
+    CON_FLAGS_CASE("lea", FLAGS_KEEP)
+    CON_FLAGS_CASE("push", FLAGS_KEEP)
+    CON_FLAGS_CASE("pop", FLAGS_KEEP)
+    CON_FLAGS_CASE("xchg", FLAGS_KEEP)
+    CON_FLAGS_CASE("not", FLAGS_KEEP)
+    CON_FLAGS_CASE("nop", FLAGS_KEEP)
+    CON_FLAGS_CASE("inc", FLAGS_KEEP) // keeps CF
+    CON_FLAGS_CASE("dec", FLAGS_KEEP)
+#undef CON_FLAGS_CASE
+    default:
+      break;
+  }
+  return found == command ? use : FLAGS_UNKNOWN;
+}
+bool is_command(const con_token* token, con_strview command) {
+  return token != nullptr && token->tok_type == CMD && token->tok_cmd.command == command;
+}
+bool reads_register(con_strview operand, const int& number) {
+  for (size_t pos = 0; pos < operand.size;) {
+    size_t end = pos;
+    while (end < operand.size && is_identifier_char(operand[end])) {
+      ++end;
+    }
+    peephole_register reg;
+    if (end > pos && lookup_register(operand.substr(pos, end-pos), &reg) && reg.number == number) {
+      return true;
+    }
+    pos = end+1;
+  }
+  return false;
+}
+bool lookup_register(con_strview name, peephole_register* reg) {
+  con_strview found;
+  switch (con_hash(name)) {
+#define CON_REGISTER(_name, _number, _size, _flags)                                         \
+    case con_hash(_name):                                                                  \
+      found = _name;                                                                       \
+      reg->number = (_flags) & REG_HIGH ? (_number)-4 : (_number); /* ah is part of rax */ \
+      reg->size = _size;                                                                   \
+      break;
+#include "construct_x86.def"
+#undef CON_REGISTER
+    default:
+      break;
+  }
+  return !found.empty() && found == name;
+}
+bool is_identifier_char(const char& c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.'
+         || c == '$' || c == '@' || c == '?';
+}
+// Sizes as encoded for 64 bit code, jumps to labels counted short
+void count_saved(const int& before, const con_token& after, uint64_t* bytes) {
+  const int after_size = x86_insn_size(after.tok_cmd);
+  if (before > 0 && after_size > 0 && before > after_size) {
+    *bytes += before-after_size;
+  }
+}
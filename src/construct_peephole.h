@@ -0,0 +1,25 @@
+#ifndef CONSTRUCT_PEEPHOLE_H_
+#define CONSTRUCT_PEEPHOLE_H_
+
+#include "construct_types.h"
+
+struct con_counters;
+
+// Peephole pass over the lowered, linearized nasm of one top-level token, run with -O. Only the
+// instructions construct generates and the common integer ones are understood, anything else is
+// left alone and ends what the rules look at:
+// - mov r64/r32, 0 becomes xor r32, r32 when the flags are written again before they are read
+// - cmp reg, 0 becomes test reg, reg
+// - a mov to its own source is removed (not for 32 bit registers in 64 bit code, those zero the
+//   upper half), as is a mov to a register the next instruction moves to again without reading it
+// - a jump to a label followed by jmp goes to the target of that jmp, a jmp to a ret becomes the ret
+// - instructions no path through the control flow graph reaches are removed, such as the ret after
+//   a tail call or syscall exit() (see construct_cfg.h)
+// - a jump to the instructions right after it is removed
+// - the labels of ifs and whiles no jump refers to anymore are removed
+// Tokens construct does not write out are dropped. counters, when given, get how often every rule
+// applied and the bytes of code it saved
+void peephole_tokens(con_token_list& tokens, const CON_BITWIDTH& bitwidth, con_arena* arena,
+                     con_counters* counters = nullptr);
+
+#endif // CONSTRUCT_PEEPHOLE_H_
@@ -0,0 +1,1040 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+#include <cstdint>
+#include "construct_regalloc.h"
+#include "construct_cfg.h"
+#include "construct_elf.h"
+#include "construct_hash.h"
+#include "construct_stats.h"
+#include "construct_symtab.h"
+
+using namespace std;
+
+namespace {
+
+enum { REG_REX = 1, REG_HIGH = 2 };
+
+// Numbers of the 64 bit registers, as in construct_x86.def
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11,
+       REGISTER_AMNT = 16 };
+
+// Registers by number, bit n is register n
+typedef uint32_t reg_mask;
+const reg_mask ALL_REGISTERS = 0xFFFF;
+const reg_mask ARGUMENT_REGISTERS = 1<<RDI | 1<<RSI | 1<<RDX | 1<<RCX | 1<<R8 | 1<<R9;
+const reg_mask CALLER_SAVED = 1<<RAX | ARGUMENT_REGISTERS | 1<<R10 | 1<<R11;
+const reg_mask CALLEE_SAVED = 1<<RBX | 0xF000;
+const reg_mask SYSCALL_USES = 1<<RAX | 1<<RDI | 1<<RSI | 1<<RDX | 1<<R10 | 1<<R8 | 1<<R9;
+const reg_mask SYSCALL_DEFS = 1<<RAX | 1<<RCX | 1<<R11;
+
+// The order registers are given out in, the ones calls clobber anyway first
+const int register_pool[] = {RCX, RDX, R8, R9, R10, R11, RSI, RDI, RAX, RBX, 12, 13, 14, 15};
+
+enum CON_ACCESS {
+  ACCESS_NONE = 0,
+  ACCESS_READ = 1,
+  ACCESS_WRITE = 2,
+  ACCESS_RW = 3
+};
+
+// Nodes of the interference graph: the 16 registers, then the auto registers
+struct node_set {
+  std::vector<uint64_t> words;
+
+  explicit node_set(const size_t& size = 0) : words((size+63)/64, 0) {}
+  void add(const size_t& node) { words[node/64] |= uint64_t(1) << node%64; }
+  bool has(const size_t& node) const { return words[node/64] >> node%64 & 1; }
+  // The first node from on that is in the set, -1 when there is none
+  int next(size_t from) const;
+  bool merge(const node_set& other);
+  void remove(const node_set& other);
+};
+
+// An auto register in an operand
+struct auto_operand {
+  int arg;         // 0 for arg1, 1 for arg2
+  uint32_t number;
+  bool whole;      // the operand is the register alone, not an address or expression with it
+};
+
+// What an instruction reads and writes
+struct insn_info {
+  node_set uses;
+  node_set defs;
+  node_set live_after;
+  std::vector<auto_operand> autos;
+  int kind = -1;                             // CON_INSN_KIND, -1 for the ones not in construct_x86.def
+  int access[2] = {ACCESS_NONE, ACCESS_NONE};
+  bool can_be_memory[2] = {false, false};
+  bool memory[2] = {false, false};           // the operand is a memory operand
+  int operand_node[2] = {-1, -1};            // the register the operand is, if it is one
+  int operand_size[2] = {0, 0};
+  reg_mask named = 0;    // registers it names
+  reg_mask implicit = 0; // registers it reads or writes without naming them
+  bool high = false;     // names ah, ch, dh or bh, which rule out spl, bpl, sil and dil
+  bool exit = false;     // ret or jump out of the function
+  int move_def = -1;     // nodes of a mov of one 64 bit register to another
+  int move_use = -1;
+  uint64_t weight = 1;
+
+  explicit insn_info(const size_t& nodes) : uses(nodes), defs(nodes), live_after(nodes) {}
+};
+
+struct x86_register {
+  int number;
+  int size;
+  int flags;
+};
+
+typedef std::unordered_map<const con_token*, std::vector<con_token*>> insertions;
+
+// The decisions of allocate_registers, what rewrite_insn needs of them
+struct allocation {
+  std::vector<int> assigned; // register of every auto register, -1 when it is spilled or unused
+  std::vector<int> slots;    // stack slot of the spilled ones
+  reg_mask allowed = 0;      // registers that may be given out
+  reg_mask saved = 0;        // of those, callee saved ones in use
+  insertions before;
+  insertions after;
+};
+
+}  // namespace
+
+static bool is_auto_value(con_strview value);
+static void scan_function(const con_token* token, const con_symtab* globals, con_function_registers* entry,
+                          con_arena* arena);
+static reg_mask named_callee_saved(con_strview operand, const con_symtab* globals);
+static con_strview call_target(con_strview target, const con_symtab* globals, con_arena* arena);
+static reg_mask call_clobbers(con_strview target, const con_functions* functions);
+static bool is_name(con_strview operand);
+static void collect_code(const con_token_list& tokens, const uint64_t& weight, vector<con_token*>* code,
+                         vector<uint64_t>* weights);
+static void describe_insn(const con_token* token, const con_cfg& cfg, const vector<con_auto_register>& registers,
+                          const con_functions* functions, insn_info* info);
+static void describe_operand(con_strview operand, const int& arg, const vector<con_auto_register>& registers,
+                             insn_info* info);
+static void interfere(vector<node_set>* edges, const int& a, const int& b);
+static int assign_registers(const vector<uint32_t>& order, const vector<uint64_t>& costs,
+                            const vector<vector<int>>& hints, const vector<node_set>& edges,
+                            const vector<bool>& spilled, allocation* alloc);
+static bool rewrite_insn(con_token* token, const insn_info& info, const vector<con_auto_register>& registers,
+                         const bool& check_only, allocation* alloc, con_arena* arena);
+static int pick_victim(const insn_info& info, const allocation& alloc, const vector<uint64_t>& costs);
+static bool memory_allowed(const insn_info& info, const int& arg, const uint8_t& size, con_strview other);
+static con_strview slot_operand(const int& slot, const uint8_t& size, con_arena* arena);
+static con_token* make_cmd(con_strview command, con_strview arg1, con_strview arg2, con_arena* arena);
+static void insert_tokens(con_token_list* tokens, const insertions& before, const insertions& after, con_arena* arena);
+static bool parse_auto(con_strview name, uint32_t* number);
+static string source_operand(con_strview operand, const vector<con_auto_register>& registers);
+static bool lookup_register(con_strview name, x86_register* reg);
+static const char* register_name(const int& number, const uint8_t& size);
+static int size_index(const uint8_t& size);
+static bool is_identifier_char(const char& c);
+
+bool declare_auto_register(con_macro* macro, vector<con_auto_register>* registers, const CON_BITWIDTH& bitwidth,
+                           con_arena* arena) {
+  const con_strview value = macro->value;
+  if (!is_auto_value(value)) {
+    return false;
+  }
+  if (registers == nullptr) {
+    throw invalid_argument("Auto macro "+macro->macro.str()+" outside of a function");
+  }
+  if (bitwidth != BIT64) {
+    throw invalid_argument("Auto macro "+macro->macro.str()+" in code other than 64 bit");
+  }
+  con_auto_register reg;
+  reg.name = macro->macro;
+  reg.size = 8;
+  if (value.size > 4) {
+    const con_strview size = value.substr(5);
+    if (size == "db") {
+      reg.size = 1;
+    } else if (size == "dw") {
+      reg.size = 2;
+    } else if (size == "dd") {
+      reg.size = 4;
+    } else if (size != "dq") {
+      throw invalid_argument("Invalid auto macro size: "+size.str()+", expected db, dw, dd or dq");
+    }
+  }
+  macro->value = con_strdup(arena, "auto@"+to_string(registers->size()));
+  registers->push_back(reg);
+  return true;
+}
+
+bool declares_auto_register(const con_token* token) {
+  if (token->tok_type == MACRO && is_auto_value(token->tok_macro.value)) {
+    return true;
+  }
+  for (con_token_list::const_iterator it = token->tokens.cbegin(); it != token->tokens.cend(); ++it) {
+    if (declares_auto_register(*it)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool names_callee_saved(con_strview operand) {
+  return named_callee_saved(operand, nullptr) != 0;
+}
+
+const con_function_registers& declare_function_registers(const con_token* function, const con_symtab* globals,
+                                                         con_functions* functions, con_arena* arena) {
+  con_function_registers entry;
+  for (con_token_list::const_iterator it = function->tokens.cbegin(); it != function->tokens.cend(); ++it) {
+    scan_function(*it, globals, &entry, arena);
+  }
+  const con_strview name = function->tok_function.name;
+  con_function_registers& declared = (*functions)[arena == nullptr ? name : con_strdup(arena, name)];
+  declared.clobbered = entry.clobbered;
+  declared.calls.swap(entry.calls);
+  declared.jumps.swap(entry.jumps);
+  return declared;
+}
+
+void allocate_registers(con_token* function, const vector<con_auto_register>& registers,
+                        const con_functions* functions, con_arena* arena, con_counters* counters) {
+  if (registers.empty()) {
+    return;
+  }
+  con_cfg cfg;
+  vector<uint64_t> weights;
+  collect_code(function->tokens, 1, &cfg.code, &weights);
+  build_blocks(&cfg);
+  const vector<con_token*>& code = cfg.code;
+  const size_t node_amnt = REGISTER_AMNT+registers.size();
+
+  vector<insn_info> insns(code.size(), insn_info(node_amnt));
+  reg_mask named = 0;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (code[i]->tok_type == CMD) {
+      describe_insn(code[i], cfg, registers, functions, &insns[i]);
+      insns[i].weight = weights[i];
+      named |= insns[i].named;
+    }
+  }
+
+  // Live at the start of every block, until nothing changes
+  vector<node_set> live_in(cfg.blocks.size(), node_set(node_amnt));
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t b = cfg.blocks.size(); b-- > 0;) {
+      const con_block& block = cfg.blocks[b];
+      node_set live(node_amnt);
+      for (vector<uint32_t>::const_iterator s_it = block.successors.cbegin(); s_it != block.successors.cend(); ++s_it) {
+        live.merge(live_in[*s_it]);
+      }
+      for (uint32_t i = block.end; i-- > block.begin;) {
+        if (code[i]->tok_type == CMD) {
+          live.remove(insns[i].defs);
+          live.merge(insns[i].uses);
+        }
+      }
+      changed = live_in[b].merge(live) || changed;
+    }
+  }
+
+  // What an instruction writes interferes with everything live after it, except for the source of
+  // a mov, which can share the register
+  vector<node_set> edges(node_amnt, node_set(node_amnt));
+  for (size_t b = 0; b < cfg.blocks.size(); ++b) {
+    const con_block& block = cfg.blocks[b];
+    node_set live(node_amnt);
+    for (vector<uint32_t>::const_iterator s_it = block.successors.cbegin(); s_it != block.successors.cend(); ++s_it) {
+      live.merge(live_in[*s_it]);
+    }
+    for (uint32_t i = block.end; i-- > block.begin;) {
+      if (code[i]->tok_type != CMD) {
+        continue;
+      }
+      insn_info& info = insns[i];
+      info.live_after = live;
+      for (int d = info.defs.next(0); d >= 0; d = info.defs.next(d+1)) {
+        for (int l = live.next(0); l >= 0; l = live.next(l+1)) {
+          if (l != d && !(d == info.move_def && l == info.move_use)) {
+            interfere(&edges, d, l);
+          }
+        }
+      }
+      for (vector<auto_operand>::const_iterator a_it = info.autos.cbegin(); a_it != info.autos.cend(); ++a_it) {
+        const int node = REGISTER_AMNT+a_it->number;
+        if (info.high && registers[a_it->number].size == 1) {
+          interfere(&edges, node, RSI);
+          interfere(&edges, node, RDI);
+        }
+        for (int r = 0; info.exit && r < REGISTER_AMNT; ++r) {
+          if (CALLEE_SAVED >> r & 1) { // popped before it
+            interfere(&edges, node, r);
+          }
+        }
+      }
+      live.remove(info.defs);
+      live.merge(info.uses);
+    }
+  }
+  // What is live at the start was set before the function, all at once
+  const node_set& entry = live_in.empty() ? node_set(node_amnt) : live_in[0];
+  for (int a = entry.next(0); a >= 0; a = entry.next(a+1)) {
+    for (int b = entry.next(a+1); b >= 0; b = entry.next(b+1)) {
+      interfere(&edges, a, b);
+    }
+  }
+
+  vector<uint64_t> costs(registers.size(), 0);
+  vector<vector<int>> hints(registers.size());
+  for (vector<insn_info>::const_iterator i_it = insns.cbegin(); i_it != insns.cend(); ++i_it) {
+    for (vector<auto_operand>::const_iterator a_it = i_it->autos.cbegin(); a_it != i_it->autos.cend(); ++a_it) {
+      costs[a_it->number] += i_it->weight;
+    }
+    if (i_it->move_def >= REGISTER_AMNT) {
+      hints[i_it->move_def-REGISTER_AMNT].push_back(i_it->move_use);
+    }
+    if (i_it->move_use >= REGISTER_AMNT) {
+      hints[i_it->move_use-REGISTER_AMNT].push_back(i_it->move_def);
+    }
+  }
+
+  allocation alloc;
+  for (size_t p = 0; p < sizeof(register_pool)/sizeof(register_pool[0]); ++p) {
+    alloc.allowed |= 1 << register_pool[p];
+  }
+  alloc.allowed &= ~(named & CALLEE_SAVED); // the function's own use of them is left alone
+  if (named & 1<<RSP) {
+    alloc.allowed &= ~CALLEE_SAVED; // pushing them would move what it finds through rsp
+  }
+  vector<uint32_t> order(registers.size());
+  for (uint32_t v = 0; v < order.size(); ++v) {
+    order[v] = v;
+  }
+  stable_sort(order.begin(), order.end(), [&](const uint32_t& a, const uint32_t& b) { return costs[a] > costs[b]; });
+
+  // A spilled one used where no register is free for it spills another one that is live there
+  vector<bool> spilled(registers.size(), false);
+  int slot_amnt = 0;
+  for (;;) {
+    slot_amnt = assign_registers(order, costs, hints, edges, spilled, &alloc);
+    size_t i = 0;
+    while (i < code.size() && (code[i]->tok_type != CMD || insns[i].autos.empty()
+                               || rewrite_insn(code[i], insns[i], registers, true, &alloc, arena))) {
+      ++i;
+    }
+    if (i == code.size()) {
+      break;
+    }
+    const int victim = pick_victim(insns[i], alloc, costs);
+    if (victim < 0) {
+      const con_cmd& cmd = code[i]->tok_cmd;
+      throw invalid_argument("No register is free for the spilled auto macros at "+cmd.command.str()+" "
+                             +source_operand(cmd.arg1, registers)
+                             +(cmd.arg2.empty() ? "" : ", "+source_operand(cmd.arg2, registers)));
+    }
+    spilled[victim] = true;
+  }
+  const con_token* name_tok = function->tokens.front();
+  if (slot_amnt > 0 && (named & (1<<RBP | 1<<RSP))) {
+    throw invalid_argument("Not enough registers for the auto macros of "+name_tok->tok_tag.name.str()
+                           +", spilling them needs rbp and rsp, which it uses");
+  }
+
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (code[i]->tok_type == CMD && !insns[i].autos.empty()) {
+      rewrite_insn(code[i], insns[i], registers, false, &alloc, arena);
+    }
+  }
+
+  // Frame for the slots and the callee saved registers, undone before every exit
+  vector<con_token*> prologue;
+  vector<con_token*> epilogue;
+  if (slot_amnt > 0) {
+    prologue.push_back(make_cmd("push", "rbp", con_strview(), arena));
+    prologue.push_back(make_cmd("mov", "rbp", "rsp", arena));
+    prologue.push_back(make_cmd("sub", "rsp", con_strdup(arena, to_string((8*slot_amnt+15)/16*16)), arena));
+  }
+  for (size_t p = 0; p < sizeof(register_pool)/sizeof(register_pool[0]); ++p) {
+    if (alloc.saved >> register_pool[p] & 1) {
+      prologue.push_back(make_cmd("push", register_name(register_pool[p], 8), con_strview(), arena));
+      epilogue.insert(epilogue.begin(), make_cmd("pop", register_name(register_pool[p], 8), con_strview(), arena));
+    }
+  }
+  if (slot_amnt > 0) {
+    epilogue.push_back(make_cmd("leave", con_strview(), con_strview(), arena));
+  }
+  if (!prologue.empty()) {
+    alloc.after[name_tok] = prologue;
+    for (size_t i = 0; i < code.size(); ++i) {
+      if (code[i]->tok_type != CMD || !insns[i].exit) {
+        continue;
+      }
+      if (insns[i].kind == INSN_JCC) {
+        throw invalid_argument("Conditional jump out of "+name_tok->tok_tag.name.str()
+                               +", which saves registers for its auto macros");
+      }
+      vector<con_token*>& before = alloc.before[code[i]];
+      for (vector<con_token*>::const_iterator e_it = epilogue.cbegin(); e_it != epilogue.cend(); ++e_it) {
+        before.push_back(arena->make<con_token>(**e_it));
+      }
+    }
+  }
+  if (!alloc.before.empty() || !alloc.after.empty()) {
+    insert_tokens(&function->tokens, alloc.before, alloc.after, arena);
+  }
+  if (counters != nullptr) {
+    counters->auto_registers += count_if(alloc.assigned.cbegin(), alloc.assigned.cend(),
+                                         [](const int& reg) { return reg >= 0; });
+    counters->auto_spills += slot_amnt;
+  }
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+int node_set::next(size_t from) const {
+  for (size_t w = from/64; w < words.size(); ++w) {
+    const uint64_t word = w == from/64 ? words[w] >> from%64 << from%64 : words[w];
+    if (word != 0) {
+      return w*64+__builtin_ctzll(word);
+    }
+  }
+  return -1;
+}
+bool node_set::merge(const node_set& other) {
+  bool changed = false;
+  for (size_t w = 0; w < words.size(); ++w) {
+    const uint64_t merged = words[w] | other.words[w];
+    changed = changed || merged != words[w];
+    words[w] = merged;
+  }
+  return changed;
+}
+void node_set::remove(const node_set& other) {
+  for (size_t w = 0; w < words.size(); ++w) {
+    words[w] &= ~other.words[w];
+  }
+}
+
+bool is_auto_value(con_strview value) {
+  return value == "auto" || (value.size > 5 && value.substr(0, 5) == "auto:");
+}
+// Adds what token does to the registers to entry, the tokens in it included. Only the operands an
+// instruction can write count, and the values of macros, which can stand for such an operand
+void scan_function(const con_token* token, const con_symtab* globals, con_function_registers* entry,
+                   con_arena* arena) {
+  if (token->tok_type == CMD) {
+    const con_cmd& cmd = token->tok_cmd;
+    CON_INSN_KIND kind;
+    uint32_t arg = 0;
+    if (!x86_insn_kind(cmd.command, &kind, &arg) || kind == INSN_INT) {
+      entry->clobbered |= CALLEE_SAVED; // what the allocator assumes of them as well
+    } else if (kind == INSN_CALL || kind == INSN_JMP || kind == INSN_JCC) {
+      const con_strview target = call_target(cmd.arg1, globals, arena);
+      if (target.empty()) {
+        entry->clobbered |= kind == INSN_CALL ? CALLEE_SAVED : 0; // jumps through a register stay local
+      } else if (kind == INSN_CALL) {
+        entry->calls.push_back(target);
+      } else {
+        entry->jumps.push_back(target);
+      }
+    } else {
+      entry->clobbered |= named_callee_saved(cmd.arg1, globals);
+      if (kind == INSN_XCHG) {
+        entry->clobbered |= named_callee_saved(cmd.arg2, globals);
+      }
+    }
+  } else if (token->tok_type == MACRO) {
+    entry->clobbered |= named_callee_saved(token->tok_macro.value, globals);
+  } else if (token->tok_type == FUNCALL) { // the arguments are only read
+    const con_strview target = call_target(token->tok_funcall.funcname, globals, arena);
+    if (target.empty()) {
+      entry->clobbered |= CALLEE_SAVED;
+    } else if (entry->calls.empty() || entry->calls.back() != target) {
+      entry->calls.push_back(target);
+    }
+  }
+  for (con_token_list::const_iterator it = token->tokens.cbegin(); it != token->tokens.cend(); ++it) {
+    scan_function(*it, globals, entry, arena);
+  }
+}
+// rbx and r12-r15 among the registers the operand names, directly or through a top-level macro
+reg_mask named_callee_saved(con_strview operand, const con_symtab* globals) {
+  reg_mask named = 0;
+  for (size_t pos = 0; pos < operand.size;) {
+    size_t end = pos;
+    while (end < operand.size && is_identifier_char(operand[end])) {
+      ++end;
+    }
+    if (end == pos) {
+      ++pos;
+      continue;
+    }
+    const con_strview name = operand.substr(pos, end-pos);
+    pos = end;
+    x86_register reg;
+    const con_macro* macro;
+    if (lookup_register(name, &reg)) {
+      named |= 1 << reg.number;
+    } else if (globals != nullptr && (macro = globals->lookup(name)) != nullptr) {
+      named |= named_callee_saved(macro->value, nullptr); // substituted when it was declared
+    }
+  }
+  return named & CALLEE_SAVED;
+}
+// The function name a call or jump goes to, through a top-level macro, copied to arena when given.
+// Empty when it goes through a register or memory
+con_strview call_target(con_strview target, const con_symtab* globals, con_arena* arena) {
+  const con_macro* macro = globals == nullptr ? nullptr : globals->lookup(target);
+  if (macro != nullptr) {
+    target = macro->value;
+  }
+  if (!is_name(target)) {
+    return con_strview();
+  }
+  return arena == nullptr ? target : con_strdup(arena, target);
+}
+// The callee saved registers a call to target clobbers, following the calls and jumps of functions
+reg_mask call_clobbers(con_strview target, const con_functions* functions) {
+  if (functions == nullptr) {
+    return CALLEE_SAVED;
+  }
+  con_functions::const_iterator found = functions->find(target);
+  if (found == functions->end()) {
+    return CALLEE_SAVED;
+  }
+  reg_mask clobbered = 0;
+  vector<const con_function_registers*> pending(1, &found->second);
+  vector<const con_function_registers*> seen(1, &found->second);
+  while (!pending.empty() && clobbered != CALLEE_SAVED) {
+    const con_function_registers* entry = pending.back();
+    pending.pop_back();
+    clobbered |= entry->clobbered;
+    for (int list = 0; list < 2; ++list) {
+      const vector<con_strview>& names = list == 0 ? entry->calls : entry->jumps;
+      for (vector<con_strview>::const_iterator n_it = names.cbegin(); n_it != names.cend(); ++n_it) {
+        found = functions->find(*n_it);
+        if (found == functions->end()) {
+          clobbered |= list == 0 ? CALLEE_SAVED : 0; // a jump to a label of its own
+        } else if (find(seen.begin(), seen.end(), &found->second) == seen.end()) {
+          seen.push_back(&found->second);
+          pending.push_back(&found->second);
+        }
+      }
+    }
+  }
+  return clobbered;
+}
+bool is_name(con_strview operand) {
+  if (operand.empty()) {
+    return false;
+  }
+  x86_register reg;
+  for (size_t i = 0; i < operand.size; ++i) {
+    if (!is_identifier_char(operand[i])) {
+      return false;
+    }
+  }
+  return !lookup_register(operand, &reg);
+}
+// The tokens nasm is written from, in order, and how often each runs relative to the others
+void collect_code(const con_token_list& tokens, const uint64_t& weight, vector<con_token*>* code,
+                  vector<uint64_t>* weights) {
+  for (con_token_list::const_iterator c_it = tokens.cbegin(); c_it != tokens.cend(); ++c_it) {
+    const CON_TOKENTYPE type = (*c_it)->tok_type;
+    if (type == IF || type == FUNCTION) {
+      collect_code((*c_it)->tokens, weight, code, weights);
+    } else if (type == WHILE) {
+      collect_code((*c_it)->tokens, min<uint64_t>(weight*10, 10000), code, weights);
+    } else if (type == SECTION || type == TAG || type == CMD || type == DATA) {
+      code->push_back(*c_it);
+      weights->push_back(weight);
+    }
+  }
+}
+void describe_insn(const con_token* token, const con_cfg& cfg, const vector<con_auto_register>& registers,
+                   const con_functions* functions, insn_info* info) {
+  const con_cmd& cmd = token->tok_cmd;
+  int* access = info->access;
+  bool* memory = info->can_be_memory;
+  reg_mask uses = 0;
+  reg_mask defs = 0;
+  CON_INSN_KIND kind;
+  uint32_t arg = 0;
+  if (!x86_insn_kind(cmd.command, &kind, &arg)) {
+    // Not known, it might read or write anything
+    access[0] = access[1] = ACCESS_RW;
+    uses = defs = ALL_REGISTERS;
+  } else {
+    info->kind = kind;
+    memory[0] = memory[1] = true;
+    const bool outside = is_jump(token) && cfg.labels.count(cmd.arg1) == 0;
+    switch (kind) {
+      case INSN_ALU:
+        if (arg == 7) { // cmp
+          access[0] = access[1] = ACCESS_READ;
+        } else if ((arg == 5 || arg == 6) && cmd.arg1 == cmd.arg2) { // sub or xor with itself
+          access[0] = ACCESS_WRITE;
+        } else {
+          access[0] = ACCESS_RW;
+          access[1] = ACCESS_READ;
+        }
+        break;
+      case INSN_MOV:
+        access[0] = ACCESS_WRITE;
+        access[1] = ACCESS_READ;
+        break;
+      case INSN_TEST:
+        access[0] = access[1] = ACCESS_READ;
+        break;
+      case INSN_XCHG:
+        access[0] = access[1] = ACCESS_RW;
+        break;
+      case INSN_LEA:
+      case INSN_MOVX:
+      case INSN_MOVSXD:
+        access[0] = ACCESS_WRITE;
+        access[1] = ACCESS_READ;
+        memory[0] = false;
+        break;
+      case INSN_INCDEC:
+        access[0] = ACCESS_RW;
+        break;
+      case INSN_UNARY:
+        if (arg == 2 || arg == 3) { // not, neg
+          access[0] = ACCESS_RW;
+        } else { // mul, div and idiv on rdx:rax
+          access[0] = ACCESS_READ;
+          uses = defs = 1<<RAX | 1<<RDX;
+        }
+        break;
+      case INSN_IMUL:
+        if (cmd.arg2.empty()) {
+          access[0] = ACCESS_READ;
+          uses = defs = 1<<RAX | 1<<RDX;
+        } else {
+          access[0] = ACCESS_RW;
+          access[1] = ACCESS_READ;
+          memory[0] = false;
+        }
+        break;
+      case INSN_SHIFT:
+        access[0] = ACCESS_RW;
+        access[1] = ACCESS_READ;
+        memory[1] = false;
+        break;
+      case INSN_PUSH:
+        access[0] = ACCESS_READ;
+        break;
+      case INSN_POP:
+      case INSN_SETCC:
+        access[0] = ACCESS_WRITE;
+        break;
+      case INSN_CALL:
+        access[0] = ACCESS_READ;
+        uses = 1<<RAX | ARGUMENT_REGISTERS;
+        defs = CALLER_SAVED | call_clobbers(cmd.arg1, functions);
+        break;
+      case INSN_JMP:
+      case INSN_JCC:
+        access[0] = ACCESS_READ;
+        memory[0] = false; // read after leave when it leaves the function
+        if (outside) { // a tail call, the callee gets the arguments
+          uses = 1<<RAX | ARGUMENT_REGISTERS;
+          info->exit = true;
+        }
+        break;
+      case INSN_RET:
+        uses = 1<<RAX;
+        info->exit = true;
+        break;
+      case INSN_INT:
+        uses = defs = ALL_REGISTERS;
+        break;
+      case INSN_CMOVCC:
+        access[0] = ACCESS_RW;
+        access[1] = ACCESS_READ;
+        memory[0] = false;
+        break;
+      case INSN_FIXED:
+        switch (arg) {
+          case 0x050F: // syscall
+            uses = SYSCALL_USES;
+            defs = SYSCALL_DEFS;
+            break;
+          case 0x9866: // cbw, cwde, cdqe
+          case 0x98:
+          case 0x9848:
+            uses = defs = 1<<RAX;
+            break;
+          case 0x9966: // cwd writes dx only
+            uses = 1<<RAX | 1<<RDX;
+            defs = 1<<RDX;
+            break;
+          case 0x99: // cdq, cqo
+          case 0x9948:
+            uses = 1<<RAX;
+            defs = 1<<RDX;
+            break;
+          default:
+            break;
+        }
+        break;
+    }
+  }
+  info->implicit = uses | defs;
+  for (int r = 0; r < REGISTER_AMNT; ++r) {
+    if (uses >> r & 1) {
+      info->uses.add(r);
+    }
+    if (defs >> r & 1) {
+      info->defs.add(r);
+    }
+  }
+  describe_operand(cmd.arg1, 0, registers, info);
+  describe_operand(cmd.arg2, 1, registers, info);
+  if (info->kind == INSN_MOV && info->operand_node[0] >= 0 && info->operand_node[1] >= 0
+      && info->operand_size[0] == 8 && info->operand_size[1] == 8) {
+    info->move_def = info->operand_node[0];
+    info->move_use = info->operand_node[1];
+  }
+}
+void describe_operand(con_strview operand, const int& arg, const vector<con_auto_register>& registers,
+                      insn_info* info) {
+  const bool memory = operand.find('[') != con_strview::npos;
+  const int access = info->access[arg];
+  info->memory[arg] = memory;
+  for (size_t pos = 0; pos < operand.size;) {
+    size_t end = pos;
+    while (end < operand.size && is_identifier_char(operand[end])) {
+      ++end;
+    }
+    if (end == pos) {
+      ++pos;
+      continue;
+    }
+    const con_strview name = operand.substr(pos, end-pos);
+    const bool whole = !memory && name.size == operand.size;
+    pos = end;
+    int node;
+    int size;
+    uint32_t number;
+    x86_register reg;
+    if (parse_auto(name, &number) && number < registers.size()) {
+      node = REGISTER_AMNT+number;
+      size = registers[number].size;
+      info->autos.push_back(auto_operand{arg, number, whole});
+    } else if (lookup_register(name, &reg)) {
+      node = reg.number;
+      size = reg.size;
+      info->named |= 1 << reg.number;
+      info->high = info->high || (reg.flags & REG_HIGH);
+    } else {
+      continue;
+    }
+    if (!whole) { // an address is read, anything else is taken to be read and written
+      info->uses.add(node);
+      if (!memory && (access & ACCESS_WRITE)) {
+        info->defs.add(node);
+      }
+      continue;
+    }
+    info->operand_node[arg] = node;
+    info->operand_size[arg] = size;
+    // Writing 8 or 16 bits of a register keeps the rest of it
+    if ((access & ACCESS_READ) || ((access & ACCESS_WRITE) && node < REGISTER_AMNT && size <= 2)) {
+      info->uses.add(node);
+    }
+    if (access & ACCESS_WRITE) {
+      info->defs.add(node);
+    }
+  }
+}
+void interfere(vector<node_set>* edges, const int& a, const int& b) {
+  if (a < REGISTER_AMNT && b < REGISTER_AMNT) {
+    return;
+  }
+  (*edges)[a].add(b);
+  (*edges)[b].add(a);
+}
+// Greedy colouring in the given order, the register of a hint first. Returns the amount of slots
+int assign_registers(const vector<uint32_t>& order, const vector<uint64_t>& costs, const vector<vector<int>>& hints,
+                     const vector<node_set>& edges, const vector<bool>& spilled, allocation* alloc) {
+  alloc->assigned.assign(order.size(), -1);
+  alloc->slots.assign(order.size(), -1);
+  alloc->saved = 0;
+  int slot_amnt = 0;
+  for (vector<uint32_t>::const_iterator v_it = order.cbegin(); v_it != order.cend(); ++v_it) {
+    const uint32_t v = *v_it;
+    if (costs[v] == 0) {
+      continue;
+    }
+    reg_mask taken = ~alloc->allowed;
+    const node_set& adjacent = edges[REGISTER_AMNT+v];
+    for (int n = adjacent.next(0); n >= 0; n = adjacent.next(n+1)) {
+      if (n < REGISTER_AMNT) {
+        taken |= 1 << n;
+      } else if (alloc->assigned[n-REGISTER_AMNT] >= 0) {
+        taken |= 1 << alloc->assigned[n-REGISTER_AMNT];
+      }
+    }
+    int choice = -1;
+    for (vector<int>::const_iterator h_it = hints[v].cbegin(); h_it != hints[v].cend() && choice < 0; ++h_it) {
+      const int reg = *h_it < REGISTER_AMNT ? *h_it : alloc->assigned[*h_it-REGISTER_AMNT];
+      if (reg >= 0 && !(taken >> reg & 1)) {
+        choice = reg;
+      }
+    }
+    for (size_t p = 0; p < sizeof(register_pool)/sizeof(register_pool[0]) && choice < 0; ++p) {
+      if (!(taken >> register_pool[p] & 1)) {
+        choice = register_pool[p];
+      }
+    }
+    if (choice < 0 || spilled[v]) {
+      alloc->slots[v] = slot_amnt++;
+      continue;
+    }
+    alloc->assigned[v] = choice;
+    alloc->saved |= (CALLEE_SAVED & 1 << choice);
+  }
+  return slot_amnt;
+}
+// Replaces the auto registers of the instruction. A spilled one becomes its slot where the
+// instruction can take memory there, else a register free at the instruction. With check_only
+// nothing is changed, it returns whether there are enough free registers for that
+bool rewrite_insn(con_token* token, const insn_info& info, const vector<con_auto_register>& registers,
+                  const bool& check_only, allocation* alloc, con_arena* arena) {
+  con_cmd& cmd = token->tok_cmd;
+  // Registers the instruction uses, or that hold something live across it
+  reg_mask busy = info.named | info.implicit | ~alloc->allowed;
+  if (info.exit) {
+    busy |= CALLEE_SAVED; // popped before it
+  }
+  node_set occupied = info.live_after;
+  occupied.merge(info.uses);
+  occupied.merge(info.defs);
+  for (int n = occupied.next(0); n >= 0; n = occupied.next(n+1)) {
+    const int reg = n < REGISTER_AMNT ? n : alloc->assigned[n-REGISTER_AMNT];
+    busy |= reg >= 0 ? 1 << reg : 0;
+  }
+
+  bool memory[2] = {info.memory[0], info.memory[1]};
+  unordered_map<uint32_t, int> scratch; // of the spilled ones that need one
+  vector<con_strview> replacements;
+  replacements.reserve(info.autos.size());
+  vector<con_token*>* before = nullptr;
+  vector<con_token*>* after = nullptr;
+  for (vector<auto_operand>::const_iterator a_it = info.autos.cbegin(); a_it != info.autos.cend(); ++a_it) {
+    const con_auto_register& reg = registers[a_it->number];
+    if (alloc->assigned[a_it->number] >= 0) {
+      replacements.push_back(register_name(alloc->assigned[a_it->number], reg.size));
+      continue;
+    }
+    const int slot = alloc->slots[a_it->number];
+    const con_strview other = a_it->arg == 0 ? cmd.arg2 : cmd.arg1;
+    if (a_it->whole && !memory[1-a_it->arg] && memory_allowed(info, a_it->arg, reg.size, other)) {
+      memory[a_it->arg] = true;
+      if (!check_only) {
+        replacements.push_back(slot_operand(slot, reg.size, arena));
+      }
+      continue;
+    }
+    unordered_map<uint32_t, int>::const_iterator found = scratch.find(a_it->number);
+    if (check_only && found != scratch.end()) {
+      continue;
+    }
+    int scratch_reg = found == scratch.end() ? -1 : found->second;
+    if (scratch_reg < 0) {
+      for (size_t p = 0; p < sizeof(register_pool)/sizeof(register_pool[0]) && scratch_reg < 0; ++p) {
+        if (!(busy >> register_pool[p] & 1)) {
+          scratch_reg = register_pool[p];
+        }
+      }
+      if (scratch_reg < 0) {
+        return false;
+      }
+      busy |= 1 << scratch_reg;
+      scratch[a_it->number] = scratch_reg;
+      if (check_only) {
+        continue;
+      }
+      alloc->saved |= (CALLEE_SAVED & 1 << scratch_reg);
+      before = before == nullptr ? &alloc->before[token] : before;
+      before->push_back(make_cmd("mov", register_name(scratch_reg, reg.size), slot_operand(slot, reg.size, arena),
+                                 arena));
+    }
+    if (a_it->whole && (info.access[a_it->arg] & ACCESS_WRITE)) {
+      after = after == nullptr ? &alloc->after[token] : after;
+      after->push_back(make_cmd("mov", slot_operand(slot, reg.size, arena), register_name(scratch_reg, reg.size),
+                                arena));
+    }
+    replacements.push_back(register_name(scratch_reg, reg.size));
+  }
+  if (check_only) {
+    return true;
+  }
+
+  // In the order describe_operand found them
+  vector<con_strview>::const_iterator replacement = replacements.cbegin();
+  con_strview* args[2] = {&cmd.arg1, &cmd.arg2};
+  for (int a = 0; a < 2; ++a) {
+    const con_strview operand = *args[a];
+    string rewritten;
+    size_t copied = 0;
+    for (size_t pos = 0; pos < operand.size;) {
+      size_t end = pos;
+      while (end < operand.size && is_identifier_char(operand[end])) {
+        ++end;
+      }
+      uint32_t number;
+      if (end > pos && parse_auto(operand.substr(pos, end-pos), &number) && number < registers.size()) {
+        rewritten.append(operand.data+copied, pos-copied);
+        rewritten.append(replacement->data, replacement->size);
+        ++replacement;
+        copied = end;
+      }
+      pos = end == pos ? pos+1 : end;
+    }
+    if (copied > 0) {
+      rewritten.append(operand.data+copied, operand.size-copied);
+      *args[a] = con_strdup(arena, rewritten);
+    }
+  }
+  return true;
+}
+// The auto register with a register that is live across the instruction, not named by it and the
+// least used. -1 when there is none
+int pick_victim(const insn_info& info, const allocation& alloc, const vector<uint64_t>& costs) {
+  node_set occupied = info.live_after;
+  occupied.merge(info.uses);
+  occupied.merge(info.defs);
+  int victim = -1;
+  for (int n = occupied.next(REGISTER_AMNT); n >= 0; n = occupied.next(n+1)) {
+    const int v = n-REGISTER_AMNT;
+    bool named = false;
+    for (vector<auto_operand>::const_iterator a_it = info.autos.cbegin(); a_it != info.autos.cend(); ++a_it) {
+      named = named || a_it->number == static_cast<uint32_t>(v);
+    }
+    if (alloc.assigned[v] >= 0 && !named && (victim < 0 || costs[v] < costs[victim])) {
+      victim = v;
+    }
+  }
+  return victim;
+}
+// Whether the operand can be the slot of a spilled auto register, with other as the other operand
+bool memory_allowed(const insn_info& info, const int& arg, const uint8_t& size, con_strview other) {
+  if (!info.can_be_memory[arg]) {
+    return false;
+  }
+  if ((info.kind == INSN_PUSH || info.kind == INSN_POP || info.kind == INSN_CALL) && size != 8) {
+    return false;
+  }
+  if (size == 8 && info.operand_node[1-arg] < 0 && !other.empty()
+      && (info.kind == INSN_ALU || info.kind == INSN_MOV || info.kind == INSN_TEST)) {
+    // The immediate of a 64 bit memory operand has 32 bits
+    const string number = other.str();
+    char* number_end;
+    errno = 0;
+    const long long value = strtoll(number.c_str(), &number_end, 0);
+    return errno == 0 && *number_end == '\0' && value >= INT32_MIN && value <= INT32_MAX;
+  }
+  return true;
+}
+con_strview slot_operand(const int& slot, const uint8_t& size, con_arena* arena) {
+  static const char* const size_names[4] = {"byte", "word", "dword", "qword"};
+  return con_strdup(arena, string(size_names[size_index(size)])+" [rbp-"+to_string(8*(slot+1))+"]");
+}
+con_token* make_cmd(con_strview command, con_strview arg1, con_strview arg2, con_arena* arena) {
+  con_token* cmd_tok = arena->make<con_token>(CMD);
+  cmd_tok->tok_cmd.command = command;
+  cmd_tok->tok_cmd.arg1 = arg1;
+  cmd_tok->tok_cmd.arg2 = arg2;
+  return cmd_tok;
+}
+void insert_tokens(con_token_list* tokens, const insertions& before, const insertions& after, con_arena* arena) {
+  con_token_list result;
+  result.reserve(arena, tokens->size());
+  for (con_token_list::iterator it = tokens->begin(); it != tokens->end(); ++it) {
+    insertions::const_iterator found = before.find(*it);
+    if (found != before.end()) {
+      result.insert(arena, result.end(), found->second.data(), found->second.data()+found->second.size());
+    }
+    result.push_back(arena, *it);
+    const CON_TOKENTYPE type = (*it)->tok_type;
+    if (type == IF || type == WHILE || type == FUNCTION) {
+      insert_tokens(&(*it)->tokens, before, after, arena);
+    }
+    found = after.find(*it);
+    if (found != after.end()) {
+      result.insert(arena, result.end(), found->second.data(), found->second.data()+found->second.size());
+    }
+  }
+  *tokens = result;
+}
+bool parse_auto(con_strview name, uint32_t* number) {
+  if (name.size <= 5 || name.substr(0, 5) != "auto@") {
+    return false;
+  }
+  *number = 0;
+  for (size_t i = 5; i < name.size; ++i) {
+    if (name[i] < '0' || name[i] > '9') {
+      return false;
+    }
+    *number = *number*10 + (name[i]-'0');
+  }
+  return true;
+}
+// The operand with the names of the auto macros in place of their auto@<number>, as it was written
+string source_operand(con_strview operand, const vector<con_auto_register>& registers) {
+  string named;
+  size_t copied = 0;
+  for (size_t pos = 0; pos < operand.size;) {
+    size_t end = pos;
+    while (end < operand.size && is_identifier_char(operand[end])) {
+      ++end;
+    }
+    uint32_t number;
+    if (end > pos && parse_auto(operand.substr(pos, end-pos), &number) && number < registers.size()) {
+      named.append(operand.data+copied, pos-copied);
+      named += registers[number].name.str();
+      copied = end;
+    }
+    pos = end == pos ? pos+1 : end;
+  }
+  named.append(operand.data+copied, operand.size-copied);
+  return named;
+}
+bool lookup_register(con_strview name, x86_register* reg) {
+  con_strview found;
+  switch (con_hash(name)) {
+#define CON_REGISTER(_name, _number, _size, _flags)                                         \
+    case con_hash(_name):                                                                  \
+      found = _name;                                                                       \
+      reg->number = (_flags) & REG_HIGH ? (_number)-4 : (_number); /* ah is part of rax */ \
+      reg->size = _size;                                                                   \
+      reg->flags = _flags;                                                                 \
+      break;
+#include "construct_x86.def"
+#undef CON_REGISTER
+    default:
+      break;
+  }
+  return !found.empty() && found == name;
+}
+const char* register_name(const int& number, const uint8_t& size) {
+  static const char* const names[REGISTER_AMNT][4] = {
+    {"al", "ax", "eax", "rax"}, {"cl", "cx", "ecx", "rcx"}, {"dl", "dx", "edx", "rdx"}, {"bl", "bx", "ebx", "rbx"},
+    {"spl", "sp", "esp", "rsp"}, {"bpl", "bp", "ebp", "rbp"}, {"sil", "si", "esi", "rsi"}, {"dil", "di", "edi", "rdi"},
+    {"r8b", "r8w", "r8d", "r8"}, {"r9b", "r9w", "r9d", "r9"}, {"r10b", "r10w", "r10d", "r10"},
+    {"r11b", "r11w", "r11d", "r11"}, {"r12b", "r12w", "r12d", "r12"}, {"r13b", "r13w", "r13d", "r13"},
+    {"r14b", "r14w", "r14d", "r14"}, {"r15b", "r15w", "r15d", "r15"}};
+  return names[number][size_index(size)];
+}
+int size_index(const uint8_t& size) {
+  return size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3;
+}
+bool is_identifier_char(const char& c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.'
+         || c == '$' || c == '@' || c == '?';
+}
@@ -0,0 +1,65 @@
+#ifndef CONSTRUCT_REGALLOC_H_
+#define CONSTRUCT_REGALLOC_H_
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include "construct_types.h"
+#include "construct_hash.h"
+
+struct con_counters;
+class con_symtab;
+
+// A macro declared as !name auto or !name auto:db|dw|dd|dq, a register the allocator picks
+struct con_auto_register {
+  con_strview name; // of the macro, for errors
+  uint8_t size;     // in bytes, 8 for plain auto
+};
+
+// What a call to a top-level function does to rbx and r12-r15, the registers auto macros keep their
+// values in across calls
+struct con_function_registers {
+  uint16_t clobbered = 0;          // the ones it writes or has macros for, all of them when it has instructions
+                                   // the allocator does not know or calls through a register or memory
+  std::vector<con_strview> calls;  // by name, what is not a function of the file clobbers all of them
+  std::vector<con_strview> jumps;  // by name, the functions among them count as calls
+};
+// The top-level functions of a file by name, before main becomes _start
+typedef std::unordered_map<con_strview, con_function_registers, con_strview_hash> con_functions;
+
+// When the value of macro is auto, adds it to registers and replaces the value with auto@<number>,
+// which its uses are substituted with until allocate_registers replaces them. registers is the
+// list of the top-level function the macro is in, nullptr outside of functions, where auto throws.
+// Throws as well for an unknown size and for code other than 64 bit. Returns whether it was auto
+bool declare_auto_register(con_macro* macro, std::vector<con_auto_register>* registers,
+                           const CON_BITWIDTH& bitwidth, con_arena* arena);
+// Whether token or a token in it declares an auto macro, so its lowering depends on its callees
+bool declares_auto_register(const con_token* token);
+
+// Whether operand names rbx or r12-r15
+bool names_callee_saved(con_strview operand);
+// Scans a top-level function before lowering for the registers it writes and adds it to functions.
+// globals are the top-level macros when one of them names rbx or r12-r15, nullptr otherwise. The
+// names are copied to arena when given, otherwise they have to outlive functions. Returns the entry
+const con_function_registers& declare_function_registers(const con_token* function, const con_symtab* globals,
+                                                         con_functions* functions, con_arena* arena);
+
+// Assigns registers to the auto macros of a lowered top-level function, from a liveness analysis
+// over the control flow graph of its body (see construct_cfg.h):
+// - an auto register only gets a register nothing else live uses where it is written, so argument
+//   registers are free again after their last use, and calls and syscalls clobber what the ABI says.
+//   Calls clobber rbx and r12-r15 as well when the callee in functions writes them or calls a
+//   function that does, and always when the callee is not one of functions
+// - the most used ones, uses in loops counting 10 times more per loop, are picked first, and take
+//   the register they are moved from or to when they can, scratch registers before rbx and r12-r15
+// - rbx and r12-r15 are pushed after the function label and popped before every ret and jmp out of
+//   the function when they are used, and only when the function doesn't name them itself
+// - when no register is left the macro is spilled to a stack slot below rbp, which the function
+//   then sets up (and leave restores). Instructions that can take memory use the slot directly, the
+//   others a register that is free there, loaded before and stored after
+// Instructions not in construct_x86.def are assumed to read and write every register. Throws when
+// spilling needs rbp or rsp and the function uses them, or no register is free for a spilled one
+void allocate_registers(con_token* function, const std::vector<con_auto_register>& registers,
+                        const con_functions* functions, con_arena* arena, con_counters* counters = nullptr);
+
+#endif // CONSTRUCT_REGALLOC_H_
@@ -0,0 +1,271 @@
+#include <cstring>
+#include <stdexcept>
+#include "construct_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CON_SCAN_X86
+#endif
+
+using namespace std;
+
+namespace {
+
+// Line being scanned, updated with the masks of one block of bytes at a time
+struct scan_state {
+  size_t pos;
+  int indentation = 0;
+  bool in_indentation = true;
+  bool has_alpha = false;
+  bool clean = true;
+  bool prev_space = false; // the byte before the block is a space
+};
+
+}  // namespace
+
+static bool scan_block(uint32_t newlines, uint32_t tabs, uint32_t spaces, uint32_t alphas, const unsigned& avail,
+                       const unsigned& width, scan_state* state);
+static con_line_info finish_scan(const scan_state& state);
+static size_t scan_lines_scalar(con_strview code, size_t start, con_line_info* lines, const size_t& max);
+#ifdef CON_SCAN_X86
+static size_t scan_lines_sse2(con_strview code, size_t start, con_line_info* lines, const size_t& max);
+static size_t scan_lines_avx2(con_strview code, size_t start, con_line_info* lines, const size_t& max);
+#endif
+
+CON_SIMD con_simd_level() {
+#ifdef CON_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_AVX2;
+  }
+  return __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+con_line_info con_scan_line(con_strview code, size_t start) {
+  con_line_info info = {start, 0, false, true};
+  con_scan_lines(code, start, &info, 1);
+  return info;
+}
+
+size_t con_scan_lines(con_strview code, size_t start, con_line_info* lines, const size_t& max) {
+  static const CON_SIMD level = con_simd_level();
+  return con_scan_lines(code, start, lines, max, level);
+}
+
+size_t con_scan_lines(con_strview code, size_t start, con_line_info* lines, const size_t& max,
+                      const CON_SIMD& level) {
+  switch (level) {
+#ifdef CON_SCAN_X86
+    case SIMD_AVX2:
+      return scan_lines_avx2(code, start, lines, max);
+    case SIMD_SSE2:
+      return scan_lines_sse2(code, start, lines, max);
+#endif
+    default:
+      return scan_lines_scalar(code, start, lines, max);
+  }
+}
+
+con_delims::con_delims(con_strview chars) {
+  if (chars.empty() || chars.size > sizeof(chars_)) {
+    throw invalid_argument("con_delims takes 1 to 4 characters");
+  }
+  for (size_t i = 0; i < sizeof(chars_); ++i) {
+    chars_[i] = chars[i < chars.size ? i : 0];
+  }
+}
+
+size_t con_delims::find(con_strview input, size_t pos) const {
+#ifdef __SSE2__
+  const __m128i delim0 = _mm_set1_epi8(chars_[0]);
+  const __m128i delim1 = _mm_set1_epi8(chars_[1]);
+  const __m128i delim2 = _mm_set1_epi8(chars_[2]);
+  const __m128i delim3 = _mm_set1_epi8(chars_[3]);
+  for (; pos < input.size; pos += 16) {
+    const size_t avail = input.size-pos;
+    __m128i block;
+    if (avail >= 16) {
+      block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input.data+pos));
+    } else {
+      char buffer[16] = {};
+      memcpy(buffer, input.data+pos, avail);
+      block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer));
+    }
+    __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, delim0), _mm_cmpeq_epi8(block, delim1)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(block, delim2), _mm_cmpeq_epi8(block, delim3)));
+    uint32_t mask = _mm_movemask_epi8(found);
+    if (avail < 16) {
+      mask &= (1u << avail)-1;
+    }
+    if (mask != 0) {
+      return pos+__builtin_ctz(mask);
+    }
+  }
+  return con_strview::npos;
+#else
+  for (; pos < input.size; ++pos) {
+    const char c = input[pos];
+    if (c == chars_[0] || c == chars_[1] || c == chars_[2] || c == chars_[3]) {
+      return pos;
+    }
+  }
+  return con_strview::npos;
+#endif
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+// Bit i of a mask is byte i of the block, avail bytes of it are input. Returns true when the line ended
+bool scan_block(uint32_t newlines, uint32_t tabs, uint32_t spaces, uint32_t alphas, const unsigned& avail,
+                const unsigned& width, scan_state* state) {
+  const uint32_t input = avail >= 32 ? 0xffffffffu : (1u << avail)-1;
+  newlines &= input;
+  const unsigned length = newlines != 0 ? __builtin_ctz(newlines) : avail;
+  const uint32_t line = length >= 32 ? 0xffffffffu : (1u << length)-1;
+  tabs &= line;
+  spaces &= line;
+  if (state->in_indentation) {
+    const uint32_t others = ~tabs & line;
+    if (others == 0) {
+      state->indentation += length;
+      tabs = 0;
+    } else {
+      const unsigned leading = __builtin_ctz(others);
+      state->indentation += leading;
+      state->in_indentation = false;
+      tabs &= ~((1u << leading)-1);
+    }
+  }
+  if (tabs != 0 || (spaces & ((spaces << 1) | (state->prev_space ? 1u : 0u))) != 0) {
+    state->clean = false;
+  }
+  if ((alphas & line) != 0) {
+    state->has_alpha = true;
+  }
+  if (newlines != 0 || avail < width) {
+    state->pos += length;
+    return true;
+  }
+  state->prev_space = (spaces >> (width-1)) & 1;
+  state->pos += width;
+  return false;
+}
+con_line_info finish_scan(const scan_state& state) {
+  con_line_info info;
+  info.end = state.pos;
+  info.indentation = state.indentation;
+  info.has_alpha = state.has_alpha;
+  info.clean = state.clean;
+  return info;
+}
+// The scanners below classify lines until max are done or the input ends
+size_t scan_lines_scalar(con_strview code, size_t start, con_line_info* lines, const size_t& max) {
+  size_t amnt = 0;
+  while (amnt < max && start < code.size) {
+    scan_state state;
+    state.pos = start;
+    for (;;) {
+      const unsigned avail = code.size-state.pos < 16 ? code.size-state.pos : 16;
+      uint32_t newlines = 0;
+      uint32_t tabs = 0;
+      uint32_t spaces = 0;
+      uint32_t alphas = 0;
+      for (unsigned i = 0; i < avail; ++i) {
+        const char c = code[state.pos+i];
+        const char lower = c | 0x20;
+        newlines |= static_cast<uint32_t>(c == '\n') << i;
+        tabs |= static_cast<uint32_t>(c == '\t') << i;
+        spaces |= static_cast<uint32_t>(c == ' ') << i;
+        alphas |= static_cast<uint32_t>((lower >= 'a' && lower <= 'z') || c == '!') << i;
+      }
+      if (scan_block(newlines, tabs, spaces, alphas, avail, 16, &state)) {
+        break;
+      }
+    }
+    lines[amnt++] = finish_scan(state);
+    start = state.pos+1;
+  }
+  return amnt;
+}
+#ifdef CON_SCAN_X86
+size_t scan_lines_sse2(con_strview code, size_t start, con_line_info* lines, const size_t& max) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i bang = _mm_set1_epi8('!');
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  const __m128i letter_offset = _mm_set1_epi8(128-'a'); // moves 'a'..'z' to the bottom of the signed range
+  const __m128i letter_limit = _mm_set1_epi8(-128+26);
+  size_t amnt = 0;
+  while (amnt < max && start < code.size) {
+    scan_state state;
+    state.pos = start;
+    for (;;) {
+      const size_t left = code.size-state.pos;
+      const unsigned avail = left < 16 ? left : 16;
+      __m128i block;
+      if (avail == 16) {
+        block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(code.data+state.pos));
+      } else {
+        char buffer[16] = {};
+        memcpy(buffer, code.data+state.pos, avail);
+        block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer));
+      }
+      const __m128i letters = _mm_cmplt_epi8(_mm_add_epi8(_mm_or_si128(block, case_bit), letter_offset),
+                                             letter_limit);
+      if (scan_block(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)),
+                     _mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)),
+                     _mm_movemask_epi8(_mm_cmpeq_epi8(block, space)),
+                     _mm_movemask_epi8(_mm_or_si128(letters, _mm_cmpeq_epi8(block, bang))),
+                     avail, 16, &state)) {
+        break;
+      }
+    }
+    lines[amnt++] = finish_scan(state);
+    start = state.pos+1;
+  }
+  return amnt;
+}
+__attribute__((target("avx2")))
+size_t scan_lines_avx2(con_strview code, size_t start, con_line_info* lines, const size_t& max) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i bang = _mm256_set1_epi8('!');
+  const __m256i case_bit = _mm256_set1_epi8(0x20);
+  const __m256i letter_offset = _mm256_set1_epi8(128-'a');
+  const __m256i letter_limit = _mm256_set1_epi8(-128+26);
+  size_t amnt = 0;
+  while (amnt < max && start < code.size) {
+    scan_state state;
+    state.pos = start;
+    for (;;) {
+      const size_t left = code.size-state.pos;
+      const unsigned avail = left < 32 ? left : 32;
+      __m256i block;
+      if (avail == 32) {
+        block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(code.data+state.pos));
+      } else {
+        char buffer[32] = {};
+        memcpy(buffer, code.data+state.pos, avail);
+        block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer));
+      }
+      const __m256i letters = _mm256_cmpgt_epi8(letter_limit,
+                                                _mm256_add_epi8(_mm256_or_si256(block, case_bit), letter_offset));
+      if (scan_block(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)),
+                     _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)),
+                     _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space)),
+                     _mm256_movemask_epi8(_mm256_or_si256(letters, _mm256_cmpeq_epi8(block, bang))),
+                     avail, 32, &state)) {
+        break;
+      }
+    }
+    lines[amnt++] = finish_scan(state);
+    start = state.pos+1;
+  }
+  return amnt;
+}
+#endif
@@ -0,0 +1,47 @@
+#ifndef CONSTRUCT_SCAN_H_
+#define CONSTRUCT_SCAN_H_
+
+#include <cstdint>
+#include "construct_types.h"
+
+// Vectorized scanning of the input. Lines are classified 16 (SSE2) or 32 (AVX2, when the cpu has
+// it) bytes at a time; other architectures use the same logic on bytes.
+
+enum CON_SIMD {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2
+};
+
+// The best level this cpu supports
+CON_SIMD con_simd_level();
+
+struct con_line_info {
+  size_t end;      // position of the '\n' ending the line, or the size of the input
+  int indentation; // leading tabs
+  bool has_alpha;  // contains a letter or '!', other lines are skipped
+  bool clean;      // no tab after the indentation and no double space, the line needs no normalizing
+};
+
+// Classifies the line of code starting at start, an empty one at the end of code
+con_line_info con_scan_line(con_strview code, size_t start);
+
+// Classifies up to max lines, the first one starting at start, and returns how many there were.
+// Only the last line of code may be empty, so a start == code.size gives none
+size_t con_scan_lines(con_strview code, size_t start, con_line_info* lines, const size_t& max);
+size_t con_scan_lines(con_strview code, size_t start, con_line_info* lines, const size_t& max,
+                      const CON_SIMD& level);
+
+// Set of up to 4 delimiter characters, found 16 bytes at a time
+class con_delims {
+ public:
+  explicit con_delims(con_strview chars);
+
+  // Position of the first delimiter in input at or after pos, or con_strview::npos
+  size_t find(con_strview input, size_t pos) const;
+
+ private:
+  char chars_[4];
+};
+
+#endif // CONSTRUCT_SCAN_H_
@@ -0,0 +1,483 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "construct_server.h"
+#include "construct_arena.h"
+#include "construct_ast.h"
+#include "construct_cache.h"
+#include "construct_compile.h"
+#include "construct_context.h"
+#include "construct_emitter.h"
+#include "construct_flags.h"
+#include "construct_input.h"
+#include "construct_module.h"
+#include "construct_regalloc.h"
+#include "construct_threads.h"
+#include "deconstruct.h"
+#include "reconstruct.h"
+
+using namespace std;
+
+namespace {
+
+// A top-level block of a watched file, see construct_server.h
+struct con_block {
+  size_t offset;     // into con_watched_file::text
+  size_t size;
+  size_t first_line;
+  bool parsed = false;
+  bool in_data = false; // at the start of the block
+  bool in_data_after = false;
+  shared_ptr<con_arena> arena;     // owns tokens, shared with the blocks parsed along with this one
+  con_token_list tokens;           // top-level tokens, planned every compilation but never lowered
+  vector<con_strview> macro_values; // unresolved values of the top-level macros in tokens
+  int if_amnt = 0;   // labels numbered by the block in the file wide counters
+  int while_amnt = 0;
+  bool auto_registers = false; // a function of it declares auto macros, its nasm depends on its callees
+  bool lowered = false;
+  con_token_start start = con_token_start(); // where the block started when nasm was lowered
+  uint64_t function_hash = 0; // of the functions of the file when nasm was lowered
+  string nasm;
+};
+
+struct con_watched_file {
+  CON_BITWIDTH bitwidth = BIT64;
+  bool local_labels = false;
+  bool optimize = false;
+  string text;
+  vector<con_block> blocks;
+};
+
+}  // namespace
+
+static map<string, con_watched_file> watched_files;
+
+static int handle_request(const vector<string>& args, string* reply);
+static int compile_watched(const string& path, const string& outpath, const con_options& options,
+                           const unsigned& jobs, const con_cache* cache, string* error);
+static void update_blocks(con_watched_file* file, con_strview text);
+static void split_blocks(con_strview text, size_t first, const size_t& last, size_t line,
+                         vector<con_block>* blocks);
+static void parse_block(con_block* block, con_strview text, bool in_data, const CON_BITWIDTH& bitwidth,
+                        const bool& local_labels, const shared_ptr<con_arena>& arena);
+static bool same_start(const con_token_start& a, const con_token_start& b);
+static int read_all(const int& fd, string* data);
+static int write_all(const int& fd, const string& data);
+
+int run_server(const std::string& socket_path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    cout << "Socket path \"" << socket_path << "\" is too long" << endl;
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+  int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.c_str());
+  if (server_fd < 0 || ::bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+      || listen(server_fd, 16) != 0) {
+    cout << "Could not listen on \"" << socket_path << "\"" << endl;
+    if (server_fd >= 0) {
+      close(server_fd);
+    }
+    return -1;
+  }
+
+  // One request at a time, a request itself uses all the threads it is allowed to
+  bool running = true;
+  while (running) {
+    int client_fd = accept(server_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    string request;
+    if (read_all(client_fd, &request) == 0) {
+      vector<string> args;
+      for (size_t start = 0; start < request.size(); ) {
+        size_t end = request.find('\0', start);
+        if (end == string::npos) {
+          end = request.size();
+        }
+        args.push_back(request.substr(start, end-start));
+        start = end+1;
+      }
+      string reply;
+      if (args.size() == 1 && args[0] == "stop") {
+        running = false;
+        reply = "0";
+      } else {
+        int result = handle_request(args, &reply);
+        reply.insert(reply.begin(), result == 0 ? '0' : '1');
+      }
+      write_all(client_fd, reply);
+    }
+    close(client_fd);
+  }
+  close(server_fd);
+  unlink(socket_path.c_str());
+  return 0;
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+int handle_request(const vector<string>& args, string* reply) {
+  vector<char*> argv;
+  string program = "construct";
+  argv.push_back(&program[0]);
+  vector<string> args_copy(args);
+  for (vector<string>::iterator it = args_copy.begin(); it != args_copy.end(); ++it) {
+    argv.push_back(&(*it)[0]);
+  }
+
+  // handle_flags reports to cout, which belongs to the client here
+  ostringstream messages;
+  streambuf* stdout_buf = cout.rdbuf(messages.rdbuf());
+  con_options options;
+  int flags_result = handle_flags(argv.size(), argv.data(), &options);
+  cout.rdbuf(stdout_buf);
+  if (flags_result != 0) {
+    *reply = messages.str()+"Some flag(s) not set\n";
+    return 0;
+  }
+
+  con_cache cache(options.cache_dir);
+  if (!options.cache_dir.empty() && cache.open() != 0) {
+    *reply = "Could not create cache directory \""+options.cache_dir+"\"\n";
+    return 0;
+  }
+  const unsigned jobs = options.jobs == 0 ? con_default_jobs() : options.jobs;
+  int result = 0;
+  for (size_t i = 0; i < options.paths.size(); ++i) {
+    const string outpath = options.paths.size() == 1
+                           ? options.outpath
+                           : batch_outpath(options.paths[i], options.outpath, output_extension(options));
+    string error;
+    if (compile_watched(options.paths[i], outpath, options, jobs,
+                        options.cache_dir.empty() ? nullptr : &cache, &error) != 0) {
+      *reply += error+"\n";
+      result = 1;
+    }
+  }
+  return result;
+}
+
+int compile_watched(const string& path, const string& outpath, const con_options& options,
+                    const unsigned& jobs, const con_cache* cache, string* error) {
+  con_input input;
+  if (input.open(path) != 0) {
+    *error = "Could not read input file \""+path+"\"";
+    return -1;
+  }
+  if (options.write_ast || options.write_object || options.write_depfile || con_is_ast(input.view())
+      || con_has_imports(input.view())) { // nothing to parse again, or imported files that could change
+    input.close();
+    return compile_file(path, outpath, options, jobs, cache, error);
+  }
+  con_emitter outfile;
+  if (outfile.open_replacing(outpath) != 0) {
+    *error = "Could not open output file \""+outpath+"\"";
+    return -1;
+  }
+
+  con_watched_file& file = watched_files[path];
+  if (file.blocks.empty() || file.bitwidth != options.bitwidth || file.local_labels != (cache != nullptr)
+      || file.optimize != options.optimize) {
+    file = con_watched_file();
+    file.bitwidth = options.bitwidth;
+    file.optimize = options.optimize;
+    file.local_labels = cache != nullptr;
+  }
+  try {
+    update_blocks(&file, input.view());
+    input.close();
+    const con_strview text(file.text);
+
+    // Serial pass: parse what changed and plan every block as plan_tokens would plan its tokens
+    con_arena arena; // resolved macro values of this compilation
+    shared_ptr<con_arena> parse_arena = make_shared<con_arena>();
+    con_context globals;
+    globals.bitwidth = file.bitwidth;
+    globals.local_labels = file.local_labels;
+    bool in_data = false;
+    bool auto_registers = false;
+    vector<size_t> to_lower;
+    vector<con_token_start> starts(file.blocks.size());
+    for (size_t i = 0; i < file.blocks.size(); ++i) {
+      con_block& block = file.blocks[i];
+      if (!block.parsed || block.in_data != in_data) {
+        parse_block(&block, text, in_data, globals.bitwidth, globals.local_labels, parse_arena);
+      }
+      in_data = block.in_data_after;
+
+      starts[i].if_amnt = globals.if_amnt;
+      starts[i].while_amnt = globals.while_amnt;
+      starts[i].macro_amnt = globals.symbols.size();
+      starts[i].macro_hash = globals.macro_hash;
+
+      size_t macro_i = 0;
+      for (con_token_list::iterator it = block.tokens.begin(); it != block.tokens.end(); ++it) {
+        if ((*it)->tok_type == MACRO) {
+          (*it)->tok_macro.value = block.macro_values[macro_i++]; // resolved again, earlier ones may differ
+          declare_global(&(*it)->tok_macro, &globals, &arena);
+        }
+      }
+      globals.if_amnt += block.if_amnt;
+      globals.while_amnt += block.while_amnt;
+      auto_registers = auto_registers || block.auto_registers;
+    }
+    // As plan_tokens declares them, the blocks keep their tokens. Auto macros depend on the
+    // functions after their block as well
+    for (size_t i = 0; auto_registers && i < file.blocks.size(); ++i) {
+      const con_token_list& tokens = file.blocks[i].tokens;
+      for (con_token_list::const_iterator it = tokens.cbegin(); it != tokens.cend(); ++it) {
+        declare_function(*it, &globals, nullptr);
+      }
+    }
+    for (size_t i = 0; i < file.blocks.size(); ++i) {
+      const con_block& block = file.blocks[i];
+      if (!block.lowered || !same_start(block.start, starts[i])
+          || (block.auto_registers && block.function_hash != globals.function_hash)) {
+        to_lower.push_back(i);
+      }
+    }
+
+    // Lowering mutates the tokens, so the blocks are parsed once more for it
+    vector<exception_ptr> exceptions(to_lower.size());
+    con_parallel_for(to_lower.size(), jobs, [&](size_t i) {
+      con_block& block = file.blocks[to_lower[i]];
+      const con_token_start& start = starts[to_lower[i]];
+      try {
+        con_arena block_arena;
+        bool block_in_data = block.in_data;
+        con_token_list tokens = parse_construct(text.substr(block.offset, block.size), &block_arena,
+                                                &block_in_data, block.first_line);
+        tokens = delinearize_tokens(tokens, &block_arena);
+
+        con_context block_globals;
+        block_globals.bitwidth = globals.bitwidth;
+        block_globals.optimize = file.optimize;
+        block_globals.local_labels = globals.local_labels;
+        block_globals.if_amnt = start.if_amnt;
+        block_globals.while_amnt = start.while_amnt;
+        block_globals.macro_hash = start.macro_hash;
+        block_globals.symbols.set_parent(&globals.symbols, start.macro_amnt);
+        block_globals.functions = globals.functions;
+        block_globals.function_hash = globals.function_hash;
+        vector<con_token_start> token_starts = plan_tokens(tokens, &block_globals, &block_arena);
+
+        block.lowered = false;
+        con_emitter emitter(1 << 12);
+        emitter.open_text(&block.nasm);
+        block.nasm.clear();
+        emit_tokens(tokens, block_globals, token_starts, 1, cache, &emitter);
+        emitter.close();
+        block.start = start;
+        block.function_hash = globals.function_hash;
+        block.lowered = true;
+      }
+      catch (...) {
+        exceptions[i] = current_exception();
+      }
+    });
+    for (size_t i = 0; i < exceptions.size(); ++i) {
+      if (exceptions[i]) {
+        rethrow_exception(exceptions[i]);
+      }
+    }
+
+    con_token_list start_tokens;
+    start_tokens.push_back(&arena, make_global_start(&arena));
+    tokens_to_nasm(start_tokens, &outfile);
+    for (vector<con_block>::const_iterator c_it = file.blocks.cbegin(); c_it != file.blocks.cend(); ++c_it) {
+      outfile.write(con_strview(c_it->nasm));
+    }
+  }
+  catch (const std::exception& e) {
+    watched_files.erase(path); // start over with the next request
+    *error = path+": "+e.what();
+    return -1;
+  }
+  if (outfile.close() != 0) {
+    *error = "Could not write output file \""+outpath+"\"";
+    return -1;
+  }
+  return 0;
+}
+
+// Keeps the blocks that lie entirely in the unchanged beginning and end of the file and splits the
+// part in between into new blocks
+void update_blocks(con_watched_file* file, con_strview text) {
+  const con_strview old_text(file->text);
+  size_t prefix = 0;
+  const size_t max_common = min(old_text.size, text.size);
+  while (prefix < max_common) {
+    size_t chunk = min<size_t>(4096, max_common-prefix);
+    if (memcmp(old_text.data+prefix, text.data+prefix, chunk) != 0) {
+      while (old_text[prefix] == text[prefix]) {
+        ++prefix;
+      }
+      break;
+    }
+    prefix += chunk;
+  }
+  size_t suffix = 0;
+  const size_t max_suffix = max_common-prefix;
+  while (suffix < max_suffix && old_text[old_text.size-1-suffix] == text[text.size-1-suffix]) {
+    ++suffix;
+  }
+  if (prefix == old_text.size && prefix == text.size) {
+    return;
+  }
+
+  // A kept block must not touch the changed line: its end is the start of the next block, and
+  // that line may not start a block any more
+  size_t changed_line = prefix;
+  while (changed_line > 0 && text[changed_line-1] != '\n') {
+    --changed_line;
+  }
+  vector<con_block>& blocks = file->blocks;
+  size_t keep_front = 0;
+  while (keep_front < blocks.size() && blocks[keep_front].offset+blocks[keep_front].size < changed_line) {
+    ++keep_front;
+  }
+  size_t keep_back = 0; // a kept block's start line, and the newline before it, must be unchanged
+  while (keep_back < blocks.size()-keep_front
+         && blocks[blocks.size()-1-keep_back].offset > old_text.size-suffix) {
+    ++keep_back;
+  }
+
+  vector<con_block> updated;
+  updated.reserve(blocks.size());
+  for (size_t i = 0; i < keep_front; ++i) {
+    updated.push_back(blocks[i]);
+  }
+  size_t first = keep_front == 0 ? 0 : blocks[keep_front-1].offset+blocks[keep_front-1].size;
+  size_t line = 1;
+  if (keep_front > 0) {
+    line = blocks[keep_front-1].first_line;
+    for (size_t i = blocks[keep_front-1].offset; i < first; ++i) {
+      line += text[i] == '\n';
+    }
+  }
+  const ptrdiff_t shift = static_cast<ptrdiff_t>(text.size)-static_cast<ptrdiff_t>(old_text.size);
+  size_t last = keep_back == 0 ? text.size : blocks[blocks.size()-keep_back].offset+shift;
+  split_blocks(text, first, last, line, &updated);
+  for (size_t i = blocks.size()-keep_back; i < blocks.size(); ++i) {
+    updated.push_back(blocks[i]);
+    updated.back().offset += shift;
+  }
+  // Line numbers after the change moved, they are only used for parse errors
+  for (size_t i = keep_front+1; i < updated.size(); ++i) {
+    size_t lines = 0;
+    const con_block& prev = updated[i-1];
+    for (size_t c = prev.offset; c < prev.offset+prev.size; ++c) {
+      lines += text[c] == '\n';
+    }
+    updated[i].first_line = prev.first_line+lines;
+  }
+  blocks.swap(updated);
+  file->text.assign(text.data, text.size);
+}
+
+void split_blocks(con_strview text, size_t first, const size_t& last, size_t line, vector<con_block>* blocks) {
+  size_t block_start = first;
+  size_t block_line = line;
+  for (size_t pos = first; pos < last; ) {
+    size_t end = text.find('\n', pos);
+    end = end == con_strview::npos || end > last ? last : end+1;
+    bool alpha = false;
+    for (size_t c = pos; c < end && !alpha; ++c) {
+      alpha = isalpha(text[c]);
+    }
+    if (alpha && text[pos] != '\t' && pos != block_start) {
+      con_block block;
+      block.offset = block_start;
+      block.size = pos-block_start;
+      block.first_line = block_line;
+      blocks->push_back(block);
+      block_start = pos;
+      block_line = line;
+    }
+    pos = end;
+    ++line;
+  }
+  if (block_start < last) {
+    con_block block;
+    block.offset = block_start;
+    block.size = last-block_start;
+    block.first_line = block_line;
+    blocks->push_back(block);
+  }
+}
+
+void parse_block(con_block* block, con_strview text, bool in_data, const CON_BITWIDTH& bitwidth,
+                 const bool& local_labels, const shared_ptr<con_arena>& arena) {
+  block->in_data = in_data;
+  block->tokens = parse_construct(text.substr(block->offset, block->size), arena.get(), &in_data,
+                                  block->first_line);
+  block->tokens = delinearize_tokens(block->tokens, arena.get());
+  block->in_data_after = in_data;
+  block->arena = arena;
+  block->macro_values.clear();
+  block->if_amnt = 0;
+  block->while_amnt = 0;
+  block->auto_registers = false;
+  con_context counting;
+  counting.bitwidth = bitwidth;
+  counting.local_labels = local_labels;
+  for (con_token_list::iterator it = block->tokens.begin(); it != block->tokens.end(); ++it) {
+    if ((*it)->tok_type == MACRO) {
+      block->macro_values.push_back((*it)->tok_macro.value);
+    } else {
+      count_labels(*it, counting, &block->if_amnt, &block->while_amnt);
+      block->auto_registers = block->auto_registers || declares_auto_register(*it);
+    }
+  }
+  block->parsed = true;
+  block->lowered = false;
+}
+
+bool same_start(const con_token_start& a, const con_token_start& b) {
+  return a.if_amnt == b.if_amnt && a.while_amnt == b.while_amnt && a.macro_amnt == b.macro_amnt
+         && a.macro_hash == b.macro_hash;
+}
+
+int read_all(const int& fd, string* data) {
+  char buffer[4096];
+  for (;;) {
+    ssize_t amnt = read(fd, buffer, sizeof(buffer));
+    if (amnt < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (amnt == 0) {
+      return 0;
+    }
+    data->append(buffer, amnt);
+  }
+}
+int write_all(const int& fd, const string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t amnt = write(fd, data.data()+written, data.size()-written);
+    if (amnt < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    written += amnt;
+  }
+  return 0;
+}
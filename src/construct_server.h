@@ -0,0 +1,17 @@
+#ifndef CONSTRUCT_SERVER_H_
+#define CONSTRUCT_SERVER_H_
+
+#include <string>
+
+// Resident compiler listening on the Unix socket at socket_path. A request is the argument list
+// of a normal invocation, each argument terminated by '\0', the client then shuts down its write
+// side. The reply is '0' or '1' (the exit status) followed by the messages construct would print.
+// The request "stop" makes the server exit.
+//
+// Every compiled file is kept as a list of top-level blocks: a line without indentation and the
+// indented lines below it. After an edit only the blocks in the changed part of the file are parsed
+// again, and only blocks whose text or starting state (label numbers, visible macros) changed are
+// lowered again, everything else is copied from the previous compilation.
+int run_server(const std::string& socket_path);
+
+#endif // CONSTRUCT_SERVER_H_
@@ -0,0 +1,121 @@
+#include <cstdio>
+#include <string>
+#include <ostream>
+#include "construct_stats.h"
+
+using namespace std;
+
+// name, member of con_counters
+#define CON_COUNTERS(X)                              \
+  X("functions", functions)                          \
+  X("ifs", ifs)                                      \
+  X("whiles", whiles)                                \
+  X("macros_declared", macros_declared)              \
+  X("macros_resolved", macros_resolved)              \
+  X("funcalls_expanded", funcalls_expanded)          \
+  X("syscalls_expanded", syscalls_expanded)          \
+  X("stack_args", stack_args)                        \
+  X("register_shuffles", register_shuffles)          \
+  X("tail_calls", tail_calls)                        \
+  X("auto_registers", auto_registers)                \
+  X("auto_spills", auto_spills)                      \
+  X("cache_hits", cache_hits)                        \
+  X("cache_misses", cache_misses)                    \
+  X("zero_idioms", peephole_zero_idioms)             \
+  X("zero_idiom_bytes", peephole_zero_idiom_bytes)   \
+  X("cmp_to_test", peephole_tests)                   \
+  X("cmp_to_test_bytes", peephole_test_bytes)        \
+  X("movs_removed", peephole_movs)                   \
+  X("movs_removed_bytes", peephole_mov_bytes)        \
+  X("jumps_removed", peephole_jumps_removed)         \
+  X("jumps_removed_bytes", peephole_jump_bytes)      \
+  X("jumps_threaded", peephole_jumps_threaded)       \
+  X("jumps_to_ret", peephole_jumps_to_ret)           \
+  X("labels_removed", peephole_labels_removed)       \
+  X("unreachable_removed", peephole_unreachable)     \
+  X("unreachable_bytes", peephole_unreachable_bytes) \
+  X("rets_removed", peephole_rets_removed)
+
+void con_counters::add(const con_counters& other) {
+#define CON_ADD_COUNTER(name, member) member += other.member;
+  CON_COUNTERS(CON_ADD_COUNTER)
+#undef CON_ADD_COUNTER
+}
+
+void con_stats::add(const con_stats& other) {
+  inputs += other.inputs;
+  lines += other.lines;
+  for (int s = 0; s < STAGE_AMNT; ++s) {
+    stages[s].seconds += other.stages[s].seconds;
+    stages[s].tokens += other.stages[s].tokens;
+    stages[s].allocations += other.stages[s].allocations;
+    stages[s].bytes += other.stages[s].bytes;
+  }
+  counters.add(other.counters);
+}
+
+const char* stage_to_string(const CON_STAGE& stage) {
+  switch (stage) {
+    case STAGE_PARSE:
+      return "parse";
+    case STAGE_DELINEARIZE:
+      return "delinearize";
+    case STAGE_PLAN:
+      return "plan";
+    case STAGE_LOWER:
+      return "lower";
+    case STAGE_EMIT:
+      return "emit";
+    case STAGE_ASSEMBLE:
+      return "assemble";
+    default:
+      return "?";
+  }
+}
+
+void print_stats(const con_stats& stats, const double& wall_seconds, const bool& counters, ostream& out) {
+  char line[128];
+  snprintf(line, sizeof(line), "%-12s %10s %12s %12s %14s\n", "stage", "ms", "tokens", "allocations", "bytes");
+  out << line;
+  for (int s = 0; s < STAGE_AMNT; ++s) {
+    const con_stage_stats& stage = stats.stages[s];
+    snprintf(line, sizeof(line), "%-12s %10.3f %12llu %12llu %14llu\n", stage_to_string(static_cast<CON_STAGE>(s)),
+             stage.seconds*1000, static_cast<unsigned long long>(stage.tokens),
+             static_cast<unsigned long long>(stage.allocations), static_cast<unsigned long long>(stage.bytes));
+    out << line;
+  }
+  snprintf(line, sizeof(line), "%-12s %10.3f   (%llu input(s), %llu lines)\n", "wall", wall_seconds*1000,
+           static_cast<unsigned long long>(stats.inputs), static_cast<unsigned long long>(stats.lines));
+  out << line;
+  if (!counters) {
+    return;
+  }
+#define CON_PRINT_COUNTER(name, member)                                                      \
+  snprintf(line, sizeof(line), "%-20s %12llu\n", name, static_cast<unsigned long long>(stats.counters.member)); \
+  out << line;
+  CON_COUNTERS(CON_PRINT_COUNTER)
+#undef CON_PRINT_COUNTER
+}
+
+void print_stats_json(const con_stats& stats, const double& wall_seconds, const bool& counters, ostream& out) {
+  out << "{\"inputs\": " << stats.inputs << ", \"lines\": " << stats.lines
+      << ", \"wall_ms\": " << wall_seconds*1000 << ", \"stages\": {";
+  for (int s = 0; s < STAGE_AMNT; ++s) {
+    const con_stage_stats& stage = stats.stages[s];
+    out << (s == 0 ? "" : ", ") << "\"" << stage_to_string(static_cast<CON_STAGE>(s)) << "\": {\"ms\": "
+        << stage.seconds*1000 << ", \"tokens\": " << stage.tokens << ", \"allocations\": " << stage.allocations
+        << ", \"bytes\": " << stage.bytes << "}";
+  }
+  out << "}";
+  if (counters) {
+    out << ", \"counters\": {";
+    const char* separator = "";
+#define CON_PRINT_COUNTER(name, member)                                    \
+    out << separator << "\"" << name << "\": " << stats.counters.member; \
+    separator = ", ";
+    CON_COUNTERS(CON_PRINT_COUNTER)
+#undef CON_PRINT_COUNTER
+    out << "}";
+  }
+  out << "}\n";
+}
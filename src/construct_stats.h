@@ -0,0 +1,76 @@
+#ifndef CONSTRUCT_STATS_H_
+#define CONSTRUCT_STATS_H_
+
+#include <cstdint>
+#include <ostream>
+
+// What lowering did. Every compilation counts into its con_context, the counts are plain
+// increments, so they are kept whether or not they get reported
+struct con_counters {
+  uint64_t functions = 0;
+  uint64_t ifs = 0;
+  uint64_t whiles = 0;
+  uint64_t macros_declared = 0;
+  uint64_t macros_resolved = 0;   // names replaced by their macro's value
+  uint64_t funcalls_expanded = 0;
+  uint64_t syscalls_expanded = 0;
+  uint64_t stack_args = 0;        // funcall/syscall arguments after the sixth, pushed to the stack
+  uint64_t register_shuffles = 0; // push, pop and mov push_args emits to move argument registers
+  uint64_t tail_calls = 0;        // calls lowered to jmp with -O
+  uint64_t auto_registers = 0;    // auto macros given a register, see construct_regalloc.h
+  uint64_t auto_spills = 0;       // auto macros given a stack slot
+  uint64_t cache_hits = 0;
+  uint64_t cache_misses = 0;
+  // How often every -O rule applied and the bytes of code it saved, see construct_peephole.h
+  uint64_t peephole_zero_idioms = 0;
+  uint64_t peephole_zero_idiom_bytes = 0;
+  uint64_t peephole_tests = 0;
+  uint64_t peephole_test_bytes = 0;
+  uint64_t peephole_movs = 0;
+  uint64_t peephole_mov_bytes = 0;
+  uint64_t peephole_jumps_removed = 0;
+  uint64_t peephole_jump_bytes = 0;
+  uint64_t peephole_jumps_threaded = 0;
+  uint64_t peephole_jumps_to_ret = 0;
+  uint64_t peephole_labels_removed = 0;
+  uint64_t peephole_unreachable = 0;       // instructions in blocks nothing leads to, see construct_cfg.h
+  uint64_t peephole_unreachable_bytes = 0;
+  uint64_t peephole_rets_removed = 0;      // of those, rets
+
+  void add(const con_counters& other);
+};
+
+enum CON_STAGE {
+  STAGE_PARSE,
+  STAGE_DELINEARIZE,
+  STAGE_PLAN,
+  STAGE_LOWER,
+  STAGE_EMIT,
+  STAGE_ASSEMBLE,
+  STAGE_AMNT
+};
+
+struct con_stage_stats {
+  double seconds = 0;       // summed over the threads for lower and emit
+  uint64_t tokens = 0;      // tokens the stage produced, nasm tokens written for emit
+  uint64_t allocations = 0; // arena allocations
+  uint64_t bytes = 0;       // arena bytes, output bytes for emit
+};
+
+// Filled in by a compilation when it is given one, see compile_code
+struct con_stats {
+  uint64_t inputs = 0;
+  uint64_t lines = 0;
+  con_stage_stats stages[STAGE_AMNT];
+  con_counters counters;
+
+  void add(const con_stats& other);
+};
+
+const char* stage_to_string(const CON_STAGE& stage);
+
+// Human readable table of the stages, followed by the counters when counters is set
+void print_stats(const con_stats& stats, const double& wall_seconds, const bool& counters, std::ostream& out);
+void print_stats_json(const con_stats& stats, const double& wall_seconds, const bool& counters, std::ostream& out);
+
+#endif // CONSTRUCT_STATS_H_
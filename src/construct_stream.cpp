@@ -0,0 +1,193 @@
+#include <string>
+#include <vector>
+#include <exception>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "construct_stream.h"
+#include "construct_arena.h"
+#include "construct_ast.h"
+#include "construct_compile.h"
+#include "construct_context.h"
+#include "construct_emitter.h"
+#include "construct_module.h"
+#include "construct_scan.h"
+#include "deconstruct.h"
+#include "reconstruct.h"
+
+using namespace std;
+
+namespace {
+
+// What one batch leaves to the next
+struct con_stream_state {
+  con_arena macro_arena; // copies of the top-level macros and function names declared in globals
+  con_context globals;
+  bool in_data = false;
+  bool started = false;  // the global _start line was compiled
+  size_t line = 1;       // first line of the next batch
+};
+
+}  // namespace
+
+// A batch is compiled once it holds this many bytes of complete blocks, input is read in chunks of it
+static const size_t batch_size = 1 << 20;
+
+static void compile_batch(con_strview text, const unsigned& jobs, const con_cache* cache, con_stream_state* state,
+                          con_emitter* emitter, con_stats* stats);
+static ssize_t read_chunk(const int& fd, string* pending);
+
+int stream_file(const std::string& path, const std::string& outpath, const con_options& options,
+                const unsigned& jobs, const con_cache* cache, std::string* error, con_stats* stats) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error = "Could not read input file \""+path+"\"";
+    return -1;
+  }
+  con_emitter outfile;
+  if (outfile.open_replacing(outpath) != 0) {
+    close(fd);
+    *error = "Could not open output file \""+outpath+"\"";
+    return -1;
+  }
+
+  con_stream_state state;
+  state.globals.bitwidth = options.bitwidth;
+  state.globals.optimize = options.optimize;
+  state.globals.local_labels = cache != nullptr;
+  string pending;       // input not compiled yet, starting with a block
+  size_t scan_pos = 0;  // first line of pending not classified yet
+  size_t batch_end = 0; // start of the last block begun in pending, the blocks before it are complete
+  bool eof = false;
+  try {
+    while (!eof) {
+      const ssize_t amnt = read_chunk(fd, &pending);
+      if (amnt < 0) {
+        close(fd);
+        *error = "Could not read input file \""+path+"\"";
+        return -1;
+      }
+      eof = amnt == 0;
+      if (!state.started && con_is_ast(con_strview(pending))) {
+        close(fd);
+        *error = path+": pre-parsed trees can't be streamed";
+        return -1;
+      }
+
+      // The last line may go on in the next chunk, only complete lines are classified
+      size_t complete = pending.size();
+      if (!eof) {
+        complete = pending.rfind('\n');
+        complete = complete == string::npos ? 0 : complete+1;
+      }
+      const con_strview text(pending.data(), complete);
+      con_line_info infos[64];
+      while (scan_pos < complete) {
+        const size_t info_amnt = con_scan_lines(text, scan_pos, infos, sizeof(infos)/sizeof(infos[0]));
+        for (size_t i = 0; i < info_amnt; ++i) {
+          if (infos[i].has_alpha && infos[i].indentation == 0 && scan_pos > 0) {
+            batch_end = scan_pos;
+          }
+          scan_pos = infos[i].end+1;
+        }
+      }
+
+      if (eof || batch_end >= batch_size) {
+        const size_t end = eof ? pending.size() : batch_end;
+        compile_batch(con_strview(pending.data(), end), jobs, cache, &state, &outfile, stats);
+        pending.erase(0, end);
+        scan_pos -= end;
+        batch_end = 0;
+      }
+    }
+  }
+  catch (const std::exception& e) {
+    close(fd);
+    *error = path+": "+e.what();
+    return -1;
+  }
+  close(fd);
+  if (stats != nullptr) {
+    ++stats->inputs;
+    stats->counters.add(state.globals.counters);
+  }
+  if (outfile.close() != 0) {
+    *error = "Could not write output file \""+outpath+"\"";
+    return -1;
+  }
+  if (options.write_depfile) {
+    con_emitter depfile(1 << 12);
+    if (depfile.open_replacing(outpath+".d") != 0) {
+      *error = "Could not open dependency file \""+outpath+".d\"";
+      return -1;
+    }
+    write_depfile(outpath, path, vector<const con_module*>(), &depfile);
+    if (depfile.close() != 0) {
+      *error = "Could not write dependency file \""+outpath+".d\"";
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+// compile_code for a part of the file, planned as it would be planned in the whole file
+void compile_batch(con_strview text, const unsigned& jobs, const con_cache* cache, con_stream_state* state,
+                   con_emitter* emitter, con_stats* stats) {
+  con_arena arena;
+  con_stage_timer timer(arena, stats);
+  con_token_list tokens = parse_construct(text, &arena, &state->in_data, state->line);
+  timer.done(STAGE_PARSE, tokens.size());
+
+  if (!state->started) {
+    tokens.insert(&arena, tokens.begin(), make_global_start(&arena));
+    state->started = true;
+  }
+  tokens = delinearize_tokens(tokens, &arena);
+  if (!take_imports(&tokens).empty()) { // the imported files would have to come before everything streamed
+    throw invalid_argument("import can't be used with --stream");
+  }
+  timer.done(STAGE_DELINEARIZE, tokens.size());
+
+  // plan_tokens, but the declared macros and functions are copies that outlive the batch
+  con_context& globals = state->globals;
+  vector<con_token_start> starts;
+  starts.reserve(tokens.size());
+  for (con_token_list::iterator it = tokens.begin(); it != tokens.end(); ++it) {
+    const con_token_start token_start = {globals.if_amnt, globals.while_amnt, globals.symbols.size(),
+                                         globals.macro_hash};
+    starts.push_back(token_start);
+    if ((*it)->tok_type == MACRO) {
+      con_macro* macro = state->macro_arena.make<con_macro>();
+      macro->macro = con_strdup(&state->macro_arena, (*it)->tok_macro.macro);
+      macro->value = con_strdup(&state->macro_arena, (*it)->tok_macro.value);
+      declare_global(macro, &globals, &state->macro_arena);
+    } else {
+      declare_function(*it, &globals, &state->macro_arena);
+      count_labels(*it, globals, &globals.if_amnt, &globals.while_amnt);
+    }
+  }
+  timer.done(STAGE_PLAN, starts.size());
+
+  emit_tokens(tokens, globals, starts, jobs, cache, emitter, stats);
+  for (size_t pos = text.find('\n'); pos != con_strview::npos; pos = text.find('\n', pos+1)) {
+    ++state->line;
+    if (stats != nullptr) {
+      ++stats->lines;
+    }
+  }
+}
+
+// Appends up to batch_size bytes, returns the amount read: 0 at the end of the file, -1 on errors
+ssize_t read_chunk(const int& fd, string* pending) {
+  const size_t old_size = pending->size();
+  pending->resize(old_size+batch_size);
+  ssize_t amnt;
+  do {
+    amnt = read(fd, &(*pending)[old_size], batch_size);
+  } while (amnt < 0 && errno == EINTR);
+  pending->resize(old_size+(amnt > 0 ? amnt : 0));
+  return amnt;
+}
@@ -0,0 +1,19 @@
+#ifndef CONSTRUCT_STREAM_H_
+#define CONSTRUCT_STREAM_H_
+
+#include <string>
+#include "construct_flags.h"
+#include "construct_stats.h"
+
+class con_cache;
+
+// Compiles the construct file at path to nasm at outpath without holding all of it in memory.
+// The input is read in chunks and compiled in batches of whole top-level blocks (an unindented
+// line and the indented lines below it), a batch is released once its nasm is written. Memory is
+// bounded by the largest block (or the batch size) plus the top-level macros, which stay visible
+// to the rest of the file. The output is the same as compile_file's.
+// cache and stats may be null. Returns 0, or -1 with the reason in error
+int stream_file(const std::string& path, const std::string& outpath, const con_options& options,
+                const unsigned& jobs, const con_cache* cache, std::string* error, con_stats* stats = nullptr);
+
+#endif // CONSTRUCT_STREAM_H_
@@ -0,0 +1,127 @@
+#include "construct_symtab.h"
+#include "construct_hash.h"
+
+static inline bool is_ident_start(const char& c) {
+  return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+static inline bool is_ident_char(const char& c) {
+  return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+con_symtab::con_symtab() : slots_(64) {}
+
+void con_symtab::push_scope() {
+  scopes_.push_back(entries_.size());
+}
+void con_symtab::pop_scope() {
+  size_t mark = scopes_.back();
+  scopes_.pop_back();
+  while (entries_.size() > mark) {
+    slots_[entries_.back().slot].entry = entries_.back().shadowed;
+    entries_.pop_back();
+  }
+}
+
+void con_symtab::declare(const con_macro* macro) {
+  if ((names_+1)*4 > slots_.size()*3) {
+    grow();
+  }
+  uint32_t s = find_slot(macro->macro, con_hash(macro->macro));
+  if (slots_[s].name.data == nullptr) {
+    slots_[s].name = macro->macro;
+    ++names_;
+  }
+  entry e;
+  e.macro = macro;
+  e.slot = s;
+  e.shadowed = slots_[s].entry;
+  slots_[s].entry = static_cast<int32_t>(entries_.size());
+  entries_.push_back(e);
+}
+const con_macro* con_symtab::lookup(con_strview name) const {
+  return lookup(name, con_hash(name), entries_.size());
+}
+
+void con_symtab::set_parent(const con_symtab* parent, size_t visible) {
+  parent_ = parent;
+  parent_visible_ = visible;
+}
+
+size_t con_symtab::substitute(con_strview* arg, con_arena* arena) const {
+  if (entries_.empty() && parent_ == nullptr) {
+    return 0;
+  }
+  const con_strview in = *arg;
+  size_t copied = 0; // in[0, copied) is already in scratch_
+  size_t replaced = 0;
+  size_t i = 0;
+  while (i < in.size) {
+    if (!is_ident_char(in[i])) {
+      ++i;
+      continue;
+    }
+    size_t start = i;
+    while (i < in.size && is_ident_char(in[i])) {
+      ++i;
+    }
+    if (!is_ident_start(in[start])) {
+      continue; // a number like 0x10
+    }
+    const con_macro* macro = lookup(in.substr(start, i-start));
+    if (macro == nullptr) {
+      continue;
+    }
+    if (replaced == 0) {
+      scratch_.clear();
+    }
+    ++replaced;
+    scratch_.append(in.data+copied, start-copied);
+    scratch_.append(macro->value.data, macro->value.size);
+    copied = i;
+  }
+  if (replaced == 0) {
+    return 0;
+  }
+  scratch_.append(in.data+copied, in.size-copied);
+  *arg = con_strdup(arena, scratch_);
+  return replaced;
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+const con_macro* con_symtab::lookup(con_strview name, const uint32_t& hash, const size_t& visible) const {
+  // Declarations made after the first visible ones shadow them, walk back to the newest visible one
+  for (int32_t e = slots_[find_slot(name, hash)].entry; e >= 0; e = entries_[e].shadowed) {
+    if (static_cast<size_t>(e) < visible) {
+      return entries_[e].macro;
+    }
+  }
+  if (parent_ != nullptr) {
+    return parent_->lookup(name, hash, parent_visible_);
+  }
+  return nullptr;
+}
+uint32_t con_symtab::find_slot(con_strview name, const uint32_t& hash) const {
+  const uint32_t mask = slots_.size()-1;
+  uint32_t s = hash & mask;
+  while (slots_[s].name.data != nullptr && slots_[s].name != name) {
+    s = (s+1) & mask;
+  }
+  return s;
+}
+void con_symtab::grow() {
+  std::vector<slot> old;
+  old.swap(slots_);
+  slots_.resize(old.size()*2);
+  for (std::vector<slot>::const_iterator c_it = old.cbegin(); c_it != old.cend(); ++c_it) {
+    if (c_it->name.data == nullptr) {
+      continue;
+    }
+    uint32_t s = find_slot(c_it->name, con_hash(c_it->name));
+    slots_[s] = *c_it;
+    // entries keep their slot index, move it along
+    for (int32_t e = c_it->entry; e >= 0; e = entries_[e].shadowed) {
+      entries_[e].slot = s;
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef CONSTRUCT_SYMTAB_H_
+#define CONSTRUCT_SYMTAB_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "construct_types.h"
+
+// Scoped macro table. Names are hashed once into an open-addressing table, every slot points to
+// the innermost visible declaration of its name, which in turn remembers the declaration it shadows.
+// Leaving a scope drops all declarations made since the matching push_scope.
+class con_symtab {
+ public:
+  con_symtab();
+
+  void push_scope();
+  void pop_scope();
+
+  // The macro must outlive the table (it lives in the token arena)
+  void declare(const con_macro* macro);
+  const con_macro* lookup(con_strview name) const;
+
+  // Makes the first visible declarations of parent (and of its own parents) visible underneath the
+  // ones of this table. parent is only read, so several threads can share it as long as nobody
+  // declares in it
+  void set_parent(const con_symtab* parent, size_t visible);
+
+  // Replaces every identifier (letter or '_' followed by letters, digits and '_') of arg that names a visible macro
+  // with its value. The replaced string is allocated in arena, untouched args are kept as they are.
+  // Returns the amount of identifiers replaced
+  size_t substitute(con_strview* arg, con_arena* arena) const;
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct entry {
+    const con_macro* macro;
+    uint32_t slot;
+    int32_t shadowed; // entry index of the previous declaration with the same name or -1
+  };
+  struct slot {
+    con_strview name;
+    int32_t entry = -1; // -1 when the name was declared once but is out of scope now
+  };
+
+  const con_macro* lookup(con_strview name, const uint32_t& hash, const size_t& visible) const;
+  uint32_t find_slot(con_strview name, const uint32_t& hash) const;
+  void grow();
+
+  std::vector<slot> slots_;
+  std::vector<entry> entries_;
+  std::vector<size_t> scopes_; // entries_.size() at every push_scope
+  const con_symtab* parent_ = nullptr;
+  size_t parent_visible_ = 0;
+  size_t names_ = 0;
+  mutable std::string scratch_;
+};
+
+#endif // CONSTRUCT_SYMTAB_H_
@@ -0,0 +1,40 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "construct_threads.h"
+
+unsigned con_default_jobs() {
+  unsigned cores = std::thread::hardware_concurrency();
+  return cores == 0 ? 1 : cores;
+}
+
+void con_parallel_for(size_t count, unsigned jobs, const std::function<void(size_t)>& task) {
+  if (jobs == 0) {
+    jobs = con_default_jobs();
+  }
+  if (jobs > count) {
+    jobs = count;
+  }
+  if (jobs <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      task(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(jobs-1);
+  for (unsigned t = 1; t < jobs; ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it) {
+    it->join();
+  }
+}
@@ -0,0 +1,15 @@
+#ifndef CONSTRUCT_THREADS_H_
+#define CONSTRUCT_THREADS_H_
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads to use for jobs = 0 (one per core)
+unsigned con_default_jobs();
+
+// Runs task(0) ... task(count-1) on up to jobs threads, the calling one included. Each thread
+// keeps claiming the next unclaimed index, so tasks must not depend on the order they run in.
+// task must not throw, errors have to be stored per index and reported by the caller.
+void con_parallel_for(size_t count, unsigned jobs, const std::function<void(size_t)>& task);
+
+#endif // CONSTRUCT_THREADS_H_
@@ -2,8 +2,10 @@
 #define CONSTRUCT_TYPES_H_
 
 #include <string>
-#include <vector>
+#include <cstring>
+#include <cstdint>
 #include <stdexcept>
+#include "construct_arena.h"
 
 #define assert_throw(cond, except) \
 while (false) {                    \
@@ -12,6 +14,144 @@ while (false) {                    \
   }                                \
 }
 
+// Non-owning view of a character range. Used to pass the input and its lines through the parser
+// without copying them; a view is only turned into an owned string when a token keeps it.
+struct con_strview {
+  static const size_t npos = std::string::npos;
+
+  const char* data;
+  size_t size;
+
+  con_strview() : data(nullptr), size(0) {}
+  con_strview(const char* _data, size_t _size) : data(_data), size(_size) {}
+  con_strview(const char* cstr) : data(cstr), size(strlen(cstr)) {}
+  explicit con_strview(const std::string& str) : data(str.data()), size(str.size()) {}
+
+  bool empty() const { return size == 0; }
+  char operator[](size_t i) const { return data[i]; }
+  char front() const { return data[0]; }
+  char back() const { return data[size-1]; }
+  const char* begin() const { return data; }
+  const char* end() const { return data+size; }
+
+  size_t find(char c, size_t pos = 0) const {
+    if (pos >= size) return npos;
+    const void* found = memchr(data+pos, c, size-pos);
+    return found == nullptr ? npos : static_cast<const char*>(found) - data;
+  }
+  size_t find(const con_strview& needle, size_t pos = 0) const {
+    if (needle.size == 0) return pos <= size ? pos : npos;
+    for (; pos+needle.size <= size; ++pos) {
+      const void* found = memchr(data+pos, needle.data[0], size-needle.size+1-pos);
+      if (found == nullptr) return npos;
+      pos = static_cast<const char*>(found) - data;
+      if (memcmp(data+pos, needle.data, needle.size) == 0) return pos;
+    }
+    return npos;
+  }
+  con_strview substr(size_t pos, size_t len = npos) const {
+    if (pos > size) pos = size;
+    if (len > size-pos) len = size-pos;
+    return con_strview(data+pos, len);
+  }
+  std::string str() const { return std::string(data, size); }
+};
+
+inline bool operator==(const con_strview& lhs, const con_strview& rhs) {
+  return lhs.size == rhs.size && (lhs.size == 0 || memcmp(lhs.data, rhs.data, lhs.size) == 0);
+}
+inline bool operator!=(const con_strview& lhs, const con_strview& rhs) {
+  return !(lhs == rhs);
+}
+inline std::string& operator+=(std::string& lhs, const con_strview& rhs) {
+  return lhs.append(rhs.data, rhs.size);
+}
+inline std::string operator+(std::string lhs, const con_strview& rhs) {
+  return lhs.append(rhs.data, rhs.size);
+}
+inline std::string operator+(const con_strview& lhs, const std::string& rhs) {
+  return lhs.str() + rhs;
+}
+
+// Copies str into memory owned by arena
+inline con_strview con_strdup(con_arena* arena, con_strview str) {
+  if (str.empty()) {
+    return con_strview();
+  }
+  char* data = static_cast<char*>(arena->allocate(str.size, 1));
+  memcpy(data, str.data, str.size);
+  return con_strview(data, str.size);
+}
+inline con_strview con_strdup(con_arena* arena, const std::string& str) {
+  return con_strdup(arena, con_strview(str));
+}
+
+// Growable array living in a con_arena. It is 16 bytes and trivially copyable, so it can be a member
+// of the token union. Operations that may grow it take the arena the elements are allocated from.
+template <typename T>
+class con_list {
+ public:
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  con_list() : data_(nullptr), size_(0), capacity_(0) {}
+  // Wraps size elements owned by someone else, growing the list copies them to the arena
+  con_list(T* data, uint32_t size) : data_(data), size_(size), capacity_(size) {}
+
+  uint32_t size() const { return size_; }
+  uint32_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+  T* begin() { return data_; }
+  T* end() { return data_+size_; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_+size_; }
+  const T* cbegin() const { return data_; }
+  const T* cend() const { return data_+size_; }
+  T& operator[](size_t i) { return data_[i]; }
+  const T& operator[](size_t i) const { return data_[i]; }
+  T& front() { return data_[0]; }
+  T& back() { return data_[size_-1]; }
+  const T& front() const { return data_[0]; }
+  const T& back() const { return data_[size_-1]; }
+
+  void reserve(con_arena* arena, uint32_t capacity) {
+    if (capacity <= capacity_) return;
+    T* data = static_cast<T*>(arena->allocate(capacity*sizeof(T), alignof(T)));
+    if (size_ != 0) memcpy(data, data_, size_*sizeof(T));
+    data_ = data; // the old storage stays in the arena
+    capacity_ = capacity;
+  }
+  void push_back(con_arena* arena, const T& value) {
+    if (size_ == capacity_) reserve(arena, capacity_ == 0 ? 4 : capacity_*2);
+    data_[size_++] = value;
+  }
+  T* insert(con_arena* arena, T* pos, const T* first, const T* last) {
+    uint32_t index = pos-data_;
+    uint32_t amnt = last-first;
+    if (size_+amnt > capacity_) {
+      reserve(arena, size_+amnt > capacity_*2 ? size_+amnt : capacity_*2);
+    }
+    memmove(data_+index+amnt, data_+index, (size_-index)*sizeof(T));
+    memcpy(data_+index, first, amnt*sizeof(T));
+    size_ += amnt;
+    return data_+index;
+  }
+  T* insert(con_arena* arena, T* pos, const T& value) {
+    return insert(arena, pos, &value, &value+1);
+  }
+  T* erase(T* pos) {
+    memmove(pos, pos+1, (end()-pos-1)*sizeof(T));
+    --size_;
+    return pos;
+  }
+  void clear() { size_ = 0; }
+
+ private:
+  T* data_;
+  uint32_t size_;
+  uint32_t capacity_;
+};
+
 enum CON_BITWIDTH {
   BIT8,
   BIT16,
@@ -28,7 +168,7 @@ enum CON_COMPARISON {
   GE
 };
 
-enum CON_TOKENTYPE {
+enum CON_TOKENTYPE : uint8_t {
   SECTION,
   TAG,
   WHILE,
@@ -41,26 +181,30 @@ enum CON_TOKENTYPE {
   DATA
 };
 
+// Every token, payload and string below lives in the con_arena of its compilation.
+// None of them are ever destructed, they are released all at once with the arena.
+
 struct _con_condition {
   CON_COMPARISON op;
-  std::string arg1;
-  std::string arg2;
+  con_strview arg1;
+  con_strview arg2;
 };
 
 struct _con_arg {
-  std::string name;
+  con_strview name;
   CON_BITWIDTH length;
 
-  _con_arg(const std::string& _name, const CON_BITWIDTH& _length) : name(_name), length(_length) {}
+  _con_arg(const con_strview& _name, const CON_BITWIDTH& _length) : name(_name), length(_length) {}
 };
 
 
 struct con_section {
-  std::string name;
+  con_strview name;
 };
 
 struct con_tag {
-  std::string name;
+  con_strview name;
+  bool generated; // lowering an if or while made it, the code never names it itself
 };
 
 struct con_while {
@@ -72,126 +216,93 @@ struct con_if {
 };
 
 struct con_function {
-  std::string name;
-  std::vector<_con_arg> arguments;
+  con_strview name;
+  con_list<_con_arg> arguments;
 };
 
 struct con_cmd {
-  std::string command;
-  std::string arg1;
-  std::string arg2;
+  con_strview command;
+  con_strview arg1;
+  con_strview arg2;
 };
 
 struct con_macro {
-  std::string value;
-  std::string macro;
+  con_strview value;
+  con_strview macro;
 };
 
 struct con_funcall {
-  std::string funcname;
-  std::vector<std::string> arguments;
+  con_strview funcname;
+  con_list<con_strview> arguments;
 };
 
 struct con_syscall {
   uint16_t number;
-  std::vector<std::string> arguments;
+  con_list<con_strview> arguments;
 };
 
 struct con_data {
-  std::string line;
+  con_strview line;
 };
 
+struct con_token;
+typedef con_list<con_token*> con_token_list;
+
+// A token is its type, its indentation, its children and exactly one payload, selected by tok_type.
 struct con_token {
   CON_TOKENTYPE tok_type;
-  int indentation; // reused: deconstruct.cpp- number of tabs in input. reconstruct.cpp- number of tabs in output
-  con_section* tok_section = nullptr;
-  con_tag* tok_tag = nullptr;
-  con_while* tok_while = nullptr;
-  con_if* tok_if = nullptr;
-  con_function* tok_function = nullptr;
-  con_cmd* tok_cmd = nullptr;
-  con_macro* tok_macro = nullptr;
-  con_funcall* tok_funcall = nullptr;
-  con_syscall* tok_syscall = nullptr;
-  con_data* tok_data = nullptr;
-  std::vector<con_token*> tokens; // relevant to "if", "while", "function" and "syscall" tokens
-
-  con_token() = default;
-  explicit con_token(CON_TOKENTYPE tok_type) : tok_type(tok_type) {
+  int16_t indentation; // reused: deconstruct.cpp- number of tabs in input. reconstruct.cpp- number of tabs in output
+  con_token_list tokens; // relevant to "if", "while", "function" and "syscall" tokens
+  union {
+    con_section tok_section;
+    con_tag tok_tag;
+    con_while tok_while;
+    con_if tok_if;
+    con_function tok_function;
+    con_cmd tok_cmd;
+    con_macro tok_macro;
+    con_funcall tok_funcall;
+    con_syscall tok_syscall;
+    con_data tok_data;
+  };
+
+  explicit con_token(CON_TOKENTYPE tok_type) : tok_type(tok_type), indentation(0), tokens() {
     switch (tok_type) {
       case SECTION:
-        tok_section = new con_section;
+        new (&tok_section) con_section();
         break;
       case TAG:
-        tok_tag = new con_tag;
+        new (&tok_tag) con_tag();
         break;
       case WHILE:
-        tok_while = new con_while;
+        new (&tok_while) con_while();
         break;
       case IF:
-        tok_if = new con_if;
+        new (&tok_if) con_if();
         break;
       case FUNCTION:
-        tok_function = new con_function;
+        new (&tok_function) con_function();
         break;
       case CMD:
-        tok_cmd = new con_cmd;
+        new (&tok_cmd) con_cmd();
         break;
       case MACRO:
-        tok_macro = new con_macro;
+        new (&tok_macro) con_macro();
         break;
       case FUNCALL:
-        tok_funcall = new con_funcall;
+        new (&tok_funcall) con_funcall();
         break;
       case SYSCALL:
-        tok_syscall = new con_syscall;
+        new (&tok_syscall) con_syscall();
         break;
       case DATA:
-        tok_data = new con_data;
+        new (&tok_data) con_data();
         break;
       default:
         throw std::invalid_argument("Invalid token type: "+std::to_string(static_cast<int>(tok_type)));
         break;
     }
   }
-
-  ~con_token() {
-    switch (tok_type) {
-      case SECTION:
-        if (tok_section != nullptr) delete tok_section;
-        break;
-      case TAG:
-        if (tok_tag != nullptr) delete tok_tag;
-        break;
-      case WHILE:
-        if (tok_while != nullptr) delete tok_while;
-        break;
-      case IF:
-        if (tok_if != nullptr) delete tok_if;
-        break;
-      case FUNCTION:
-        if (tok_function != nullptr) delete tok_function;
-        break;
-      case CMD:
-        if (tok_cmd != nullptr) delete tok_cmd;
-        break;
-      case MACRO:
-        if (tok_macro != nullptr) delete tok_macro;
-        break;
-      case FUNCALL:
-        if (tok_funcall != nullptr) delete tok_funcall;
-        break;
-      case SYSCALL:
-        if (tok_syscall != nullptr) delete tok_syscall;
-        break;
-      case DATA:
-        if (tok_data != nullptr) delete tok_data;
-        break;
-    }
-    for (std::vector<con_token*>::reverse_iterator r_it = tokens.rbegin(); r_it != tokens.rend(); ++r_it) {
-      delete *r_it;
-    }
-  }
 };
 
 #endif // CONSTRUCT_TYPES_H_
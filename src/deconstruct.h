@@ -5,8 +5,12 @@
 #include <vector>
 #include "construct_types.h"
 
-std::vector<con_token*> delinearize_tokens(std::vector<con_token*> tokens);
+// Tokens are allocated in arena and stay owned by it
+con_token_list delinearize_tokens(const con_token_list& tokens, con_arena* arena);
 
-std::vector<con_token*> parse_construct(const std::string& code);
+// Parses code starting at line first_line. in_data is whether the code starts inside a .data or
+// .bss section, it is updated to the state at the end of code
+con_token_list parse_construct(con_strview code, con_arena* arena, bool* in_data = nullptr,
+                               const size_t& first_line = 1);
 
 #endif // DECONSTRUCT_H_
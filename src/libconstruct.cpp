@@ -0,0 +1,31 @@
+#include <string>
+#include <exception>
+#include "libconstruct.h"
+#include "construct_cache.h"
+#include "construct_compile.h"
+#include "construct_emitter.h"
+#include "construct_threads.h"
+
+int con_compile(con_strview code, const con_compile_options& options, std::string* output, std::string* error) {
+  con_cache cache(options.cache_dir);
+  if (!options.cache_dir.empty() && cache.open() != 0) {
+    *error = "Could not create cache directory \""+options.cache_dir+"\"";
+    return -1;
+  }
+  // Appended as it is lowered, nothing is left in output when compilation fails
+  const size_t output_size = output->size();
+  const unsigned jobs = options.jobs == 0 ? con_default_jobs() : options.jobs;
+  con_emitter emitter(1 << 12);
+  emitter.open_text(output);
+  try {
+    compile_code(code, options.bitwidth, options.optimize, jobs, options.cache_dir.empty() ? nullptr : &cache, &emitter);
+    emitter.close();
+  }
+  catch (const std::exception& e) {
+    emitter.close();
+    output->resize(output_size);
+    *error = e.what();
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef LIBCONSTRUCT_H_
+#define LIBCONSTRUCT_H_
+
+#include <string>
+#include "construct_types.h"
+
+// Embeddable construct compiler, construct code in and nasm out without files or processes.
+// Link with libconstruct.a or libconstruct.so.
+
+struct con_compile_options {
+  CON_BITWIDTH bitwidth = BIT64;
+  unsigned jobs = 1;     // threads lowering the top-level tokens of one call, 0 is one per core
+  std::string cache_dir; // lowered functions are cached here when set, as with construct -c
+  bool optimize = false; // run the peephole pass, as with construct -O
+};
+
+// Compiles code and appends the nasm to output. Returns 0, or -1 with the reason in error.
+// Calls share no state, they may run on several threads at once
+int con_compile(con_strview code, const con_compile_options& options, std::string* output, std::string* error);
+
+#endif // LIBCONSTRUCT_H_
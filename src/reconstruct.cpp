@@ -2,24 +2,37 @@
 #include <vector>
 #include <stdexcept>
 #include "reconstruct.h"
+#include "construct_emitter.h"
+#include "construct_context.h"
+#include "construct_regalloc.h"
+#include "construct_symtab.h"
+#include "construct_hash.h"
 #include "construct_types.h"
 
 using namespace std;
 
 #define min(a,b) ((a)<=(b) ? (a) : (b))
 
-int if_amnt = 0;
-int while_amnt = 0;
-CON_BITWIDTH bitwidth = BIT64;
-
 static CON_COMPARISON get_comparison_inverse(const CON_COMPARISON& condition);
 
-static std::string reg_to_str(const uint8_t& call_num, const CON_BITWIDTH& bitwidth);
-static uint8_t str_to_reg(const std::string& reg_name);
+static void apply_constructs(const con_token_list& tokens, con_token_list* output,
+                             con_context* ctx, const bool& top_level, con_arena* arena);
+static void apply_function(con_token* token, con_context* ctx, const bool& top_level, con_arena* arena);
+static void apply_if(con_token* token, con_context* ctx, con_arena* arena);
+static void apply_while(con_token* token, con_context* ctx, con_arena* arena);
+static void apply_funcall(con_token* token, con_context* ctx, con_token_list* output, con_arena* arena);
+static void apply_syscall(con_token* token, con_context* ctx, con_token_list* output, con_arena* arena);
+static con_token** find_tail_call(con_token_list& tokens);
+static void append_linear(const con_token_list& tokens, con_token_list* output, con_arena* arena);
+static void count_constructs(const con_token* token, int* if_amnt, int* while_amnt);
+static con_strview make_label(const con_context* ctx, const std::string& name, con_arena* arena);
+
+static con_strview reg_to_str(const uint8_t& call_num, const CON_BITWIDTH& bitwidth);
+static uint8_t str_to_reg(con_strview reg_name);
 
-static size_t find_macro_in_arg(const std::string& arg, const std::string& macro);
-static void apply_macro_to_token(con_token* token, const vector<con_macro*>& macros);
-static std::vector<con_token*> push_args(const std::vector<std::string>& args, const CON_BITWIDTH& bitwidth);
+static void apply_macro_to_token(con_token* token, con_context* ctx, con_arena* arena);
+static void push_args(const con_list<con_strview>& args, con_context* ctx, con_token_list* output,
+                      con_arena* arena);
 
 std::string comparison_to_string(const CON_COMPARISON& condition) {
   switch (condition) {
@@ -39,144 +52,88 @@ std::string comparison_to_string(const CON_COMPARISON& condition) {
   throw invalid_argument("Invalid comparison value: "+to_string(static_cast<int>(condition)));
 }
 
-void apply_whiles(std::vector<con_token*>& tokens) {
-  for (vector<con_token*>::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
-    apply_whiles((*it)->tokens);
-    if ((*it)->tok_type != WHILE) {
-      continue;
+std::vector<con_token_start> plan_tokens(con_token_list& tokens, con_context* globals, con_arena* arena) {
+  std::vector<con_token_start> starts;
+  starts.reserve(tokens.size());
+  bool auto_registers = false;
+  for (con_token_list::iterator it = tokens.begin(); it != tokens.end(); ++it) {
+    con_token_start start;
+    start.if_amnt = globals->if_amnt;
+    start.while_amnt = globals->while_amnt;
+    start.macro_amnt = globals->symbols.size();
+    start.macro_hash = globals->macro_hash;
+    starts.push_back(start);
+    if ((*it)->tok_type == MACRO) {
+      declare_global(&(*it)->tok_macro, globals, arena);
+    } else {
+      count_labels(*it, *globals, &globals->if_amnt, &globals->while_amnt);
+      auto_registers = auto_registers || ((*it)->tok_type == FUNCTION && declares_auto_register(*it));
     }
-    con_token* cmp_tok = new con_token(CMD);
-    cmp_tok->tok_cmd->command = "cmp";
-    cmp_tok->tok_cmd->arg1 = (*it)->tok_while->condition.arg1;
-    cmp_tok->tok_cmd->arg2 = (*it)->tok_while->condition.arg2;
-
-    string endtag_name = "endwhile" + to_string(while_amnt);
-    string starttag_name = "startwhile" + to_string(while_amnt);
-    ++while_amnt;
-
-    con_token* jmp_tok = new con_token(CMD);
-    jmp_tok->tok_cmd->command = "j" + comparison_to_string(get_comparison_inverse((*it)->tok_while->condition.op));
-    jmp_tok->tok_cmd->arg1 = endtag_name;
-
-    con_token* jmpbck_tok = new con_token(CMD);
-    jmpbck_tok->tok_cmd->command = "jmp";
-    jmpbck_tok->tok_cmd->arg1 = starttag_name;
-
-    con_token* endwhile_tok = new con_token(TAG);
-    endwhile_tok->tok_tag->name = endtag_name;
-
-    con_token* startwhile_tok = new con_token(TAG);
-    startwhile_tok->tok_tag->name = starttag_name;
-
-    // starttag, cmp, jmp endtag, ..., jmp starttag, endtag
-    (*it)->tokens.insert((*it)->tokens.begin(), jmp_tok);
-    (*it)->tokens.insert((*it)->tokens.begin(), cmp_tok);
-    (*it)->tokens.insert((*it)->tokens.begin(), startwhile_tok);
-    (*it)->tokens.push_back(jmpbck_tok);
-    (*it)->tokens.push_back(endwhile_tok);
   }
-}
-void apply_ifs(std::vector<con_token*>& tokens) {
-  for (vector<con_token*>::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
-    apply_ifs((*it)->tokens);
-    if ((*it)->tok_type != IF) {
-      continue;
-    }
-    con_token* cmp_tok = new con_token(CMD);
-    cmp_tok->tok_cmd->command = "cmp";
-    cmp_tok->tok_cmd->arg1 = (*it)->tok_if->condition.arg1;
-    cmp_tok->tok_cmd->arg2 = (*it)->tok_if->condition.arg2;
-
-    string tagname = "endif" + to_string(if_amnt);
-    ++if_amnt;
-
-    con_token* jmp_tok = new con_token(CMD);
-    jmp_tok->tok_cmd->command = "j" + comparison_to_string(get_comparison_inverse((*it)->tok_if->condition.op));
-    jmp_tok->tok_cmd->arg1 = tagname;
-
-    con_token* endif_tok = new con_token(TAG);
-    endif_tok->tok_tag->name = tagname;
-
-    // cmp, jmp tag, ..., tag
-    (*it)->tokens.insert((*it)->tokens.begin(), jmp_tok);
-    (*it)->tokens.insert((*it)->tokens.begin(), cmp_tok);
-    (*it)->tokens.push_back(endif_tok);
+  // Only the allocation of auto macros looks at the functions, which takes a walk over all of them
+  for (con_token_list::iterator it = tokens.begin(); auto_registers && it != tokens.end(); ++it) {
+    declare_function(*it, globals, nullptr); // the names live as long as the tokens
   }
+  return starts;
 }
-void apply_functions(std::vector<con_token*>& tokens) {
-  for (vector<con_token*>::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
-    if ((*it)->tok_type != FUNCTION) {
-      continue;
-    }
-    con_function* crntfunc = (*it)->tok_function;
-    if (crntfunc->name == "main") {
-      crntfunc->name = "_start";
-    }
-
-    con_token* tag_tok = new con_token(TAG);
-    tag_tok->tok_tag->name = crntfunc->name;
-    for (size_t j = 0; j < crntfunc->arguments.size(); ++j) {
-      con_token* arg_tok = new con_token(MACRO);
-      arg_tok->tok_macro->value = reg_to_str(j, crntfunc->arguments[j].length);
-      arg_tok->tok_macro->macro = crntfunc->arguments[j].name;
 
-      (*it)->tokens.insert((*it)->tokens.begin(), arg_tok);
-    }
-    (*it)->tokens.insert((*it)->tokens.begin(), tag_tok);
-    con_token* ret_tok = new con_token(CMD);
-    ret_tok->tok_cmd->command = "ret";
-    (*it)->tokens.push_back(ret_tok);
+void declare_global(con_macro* macro, con_context* globals, con_arena* arena) {
+  globals->counters.macros_resolved += globals->symbols.substitute(&macro->value, arena);
+  declare_auto_register(macro, nullptr, globals->bitwidth, arena); // throws for auto
+  globals->symbols.declare(macro);
+  globals->callee_saved_macros = globals->callee_saved_macros || names_callee_saved(macro->value);
+  ++globals->counters.macros_declared;
+  globals->macro_hash = con_hash64(macro->value, con_hash64(macro->macro, globals->macro_hash));
+}
+void declare_function(const con_token* function, con_context* globals, con_arena* arena) {
+  if (function->tok_type != FUNCTION) {
+    return;
+  }
+  const con_function_registers& entry = declare_function_registers(
+      function, globals->callee_saved_macros ? &globals->symbols : nullptr, &globals->functions, arena);
+  const uint64_t amnts[3] = {entry.clobbered, entry.calls.size(), entry.jumps.size()};
+  uint64_t hash = con_hash64(amnts, sizeof(amnts), con_hash64(function->tok_function.name, globals->function_hash));
+  for (size_t c = 0; c < entry.calls.size(); ++c) {
+    hash = con_hash64(entry.calls[c], hash);
   }
+  for (size_t j = 0; j < entry.jumps.size(); ++j) {
+    hash = con_hash64(entry.jumps[j], hash);
+  }
+  globals->function_hash = hash;
 }
-void apply_macros(std::vector<con_token*>& tokens, std::vector<con_macro*>& knownmacros) {
-  for (vector<con_token*>::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
-    if ((*it)->tok_type == MACRO) {
-      knownmacros.push_back((*it)->tok_macro);
-      continue;
-    }
-    apply_macro_to_token(*it, knownmacros);
-    if ((*it)->tok_type == IF || (*it)->tok_type == WHILE || (*it)->tok_type == FUNCTION) {
-      apply_macros((*it)->tokens, knownmacros);
-    }
+void count_labels(const con_token* token, const con_context& globals, int* if_amnt, int* while_amnt) {
+  if (token->tok_type != FUNCTION || !globals.local_labels) { // local labels don't use the counters
+    count_constructs(token, if_amnt, while_amnt);
   }
 }
-void apply_funcalls(std::vector<con_token*>& tokens) {
-  for (vector<con_token*>::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
-    apply_funcalls((*it)->tokens);
-    if ((*it)->tok_type != FUNCALL) {
-      continue;
-    }
-    vector<con_token*> arg_tokens = push_args((*it)->tok_funcall->arguments, bitwidth);
-    con_token* call_tok = new con_token(CMD);
-    call_tok->tok_cmd->command = "call";
-    call_tok->tok_cmd->arg1 = (*it)->tok_funcall->funcname;
-    arg_tokens.push_back(call_tok);
 
-    it = tokens.insert(it+1, arg_tokens.begin(), arg_tokens.end()) - 1;
+void reconstruct_token(con_token* token, const con_context& globals, const con_token_start& start,
+                       con_token_list* output, con_arena* arena, con_counters* counters) {
+  if (token->tok_type == MACRO) {
+    return;
   }
-}
-void apply_syscalls(std::vector<con_token*>& tokens) {
-  for (vector<con_token*>::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
-    apply_syscalls((*it)->tokens);
-    if ((*it)->tok_type != SYSCALL) {
-      continue;
-    }
-    vector<con_token*> arg_tokens = push_args((*it)->tok_syscall->arguments, bitwidth);
-    con_token* rax_token = new con_token(CMD);
-    rax_token->tok_cmd->command = "mov";
-    rax_token->tok_cmd->arg1 = "rax";
-    rax_token->tok_cmd->arg2 = to_string((*it)->tok_syscall->number);
-    arg_tokens.push_back(rax_token);
-    con_token* syscall_token = new con_token(CMD);
-    syscall_token->tok_cmd->command = "syscall";
-    arg_tokens.push_back(syscall_token);
-
-    it = tokens.insert(it+1, arg_tokens.begin(), arg_tokens.end()) - 1;
+  con_context ctx;
+  ctx.bitwidth = globals.bitwidth;
+  ctx.if_amnt = start.if_amnt;
+  ctx.while_amnt = start.while_amnt;
+  ctx.local_labels = globals.local_labels;
+  ctx.optimize = globals.optimize;
+  ctx.symbols.set_parent(&globals.symbols, start.macro_amnt);
+  ctx.global_functions = &globals.functions;
+
+  con_token_list single;
+  single.push_back(arena, token);
+  con_token_list lowered;
+  apply_constructs(single, &lowered, &ctx, true, arena);
+  set_indentation(lowered);
+  append_linear(lowered, output, arena);
+  if (counters != nullptr) {
+    counters->add(ctx.counters);
   }
 }
 
-void set_indentation(std::vector<con_token*>& tokens, int parent_indentation) {
-  for (vector<con_token*>::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
+void set_indentation(con_token_list& tokens, int parent_indentation) {
+  for (con_token_list::iterator it = tokens.begin(); it != tokens.end(); ++it ) {
     (*it)->indentation = parent_indentation;
     switch ((*it)->tok_type) {
     case WHILE:
@@ -186,10 +143,23 @@ void set_indentation(std::vector<con_token*>& tokens, int parent_indentation) {
       //     ...
       //     jmp startwhile0
       //   endwhile0:
+      // or rotated with -O, the guard and the start tag before the body:
+      //   cmp rsi, rdi
+      //   jg endwhile0
+      //   startwhile0:
+      //     ...
+      //     cmp rsi, rdi
+      //     jle startwhile0
+      //   endwhile0:
       assert_throw(tokens.size() >= 5, invalid_argument("while token has only "+to_string(tokens.size())+
                                                        " subtokens. The least possible number is 5!"));
       set_indentation((*it)->tokens, parent_indentation+1);
-      (*it)->tokens.front()->indentation = parent_indentation;
+      for (con_token_list::iterator sub_it = (*it)->tokens.begin(); sub_it != (*it)->tokens.end(); ++sub_it) {
+        (*sub_it)->indentation = parent_indentation;
+        if ((*sub_it)->tok_type == TAG) { // up to startwhile
+          break;
+        }
+      }
       (*it)->tokens.back()->indentation = parent_indentation;
       break;
     case IF:
@@ -211,51 +181,322 @@ void set_indentation(std::vector<con_token*>& tokens, int parent_indentation) {
   }
 }
 
-void linearize_tokens(std::vector<con_token*>& tokens) {
-  vector<con_token*>::iterator it = tokens.begin();
-  while (it != tokens.end()) {
-    if ((*it)->tok_type != IF && (*it)->tok_type != WHILE && (*it)->tok_type != FUNCTION) {
-      ++it;
-    } else {
-      it = tokens.insert(it+1, (*it)->tokens.begin(), (*it)->tokens.end()) - 1;
-      (*it)->tokens.clear(); // moved the pointers to tokens
-      delete *it;
-      it = tokens.erase(it);
-    }
-  }
+void linearize_tokens(con_token_list& tokens, con_arena* arena) {
+  con_token_list linear;
+  append_linear(tokens, &linear, arena);
+  tokens = linear;
 }
 
-std::string tokens_to_nasm(const std::vector<con_token*>& tokens) {
-  string output = "";
-  for (vector<con_token*>::const_iterator c_it = tokens.cbegin(); c_it != tokens.cend(); ++c_it ) {
+void tokens_to_nasm(const con_token_list& tokens, con_emitter* emitter) {
+  for (con_token_list::const_iterator c_it = tokens.cbegin(); c_it != tokens.cend(); ++c_it ) {
     if ((*c_it)->tok_type == WHILE || (*c_it)->tok_type == IF
         || (*c_it)->tok_type == FUNCTION || (*c_it)->tok_type == MACRO
         || (*c_it)->tok_type == FUNCALL || (*c_it)->tok_type == SYSCALL) {
       continue;
     }
-    output += string((*c_it)->indentation,'\t');
+    emitter->write('\t', (*c_it)->indentation);
     if ((*c_it)->tok_type == SECTION) {
-      output += "section " + (*c_it)->tok_section->name;
+      emitter->write("section ");
+      emitter->write((*c_it)->tok_section.name);
     } else if ((*c_it)->tok_type == TAG) {
-      output += (*c_it)->tok_tag->name + ":";
+      emitter->write((*c_it)->tok_tag.name);
+      emitter->write(':');
     } else if ((*c_it)->tok_type == CMD) {
-      output += (*c_it)->tok_cmd->command;
-      if (!(*c_it)->tok_cmd->arg1.empty()) {
-        output += " " + (*c_it)->tok_cmd->arg1;
+      emitter->write((*c_it)->tok_cmd.command);
+      if (!(*c_it)->tok_cmd.arg1.empty()) {
+        emitter->write(' ');
+        emitter->write((*c_it)->tok_cmd.arg1);
       }
-      if (!(*c_it)->tok_cmd->arg2.empty()) {
-        output += ", " + (*c_it)->tok_cmd->arg2;
+      if (!(*c_it)->tok_cmd.arg2.empty()) {
+        emitter->write(", ");
+        emitter->write((*c_it)->tok_cmd.arg2);
       }
     } else if ((*c_it)->tok_type == DATA) {
-      output += (*c_it)->tok_data->line;
+      emitter->write((*c_it)->tok_data.line);
     }
-    output += "\n";
+    emitter->write('\n');
   }
-  return output;
 }
 
 // ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
 
+// Single pre-order walk doing the work of the former apply_functions, apply_ifs, apply_whiles,
+// apply_funcalls, apply_syscalls and apply_macros passes. Every token, generated ones included,
+// is substituted with the macros visible at its position; functions, ifs and whiles open a scope.
+// The lowered tokens are appended to output in order, so the walk is linear in the output size.
+void apply_constructs(const con_token_list& tokens, con_token_list* output, con_context* ctx,
+                      const bool& top_level, con_arena* arena) {
+  output->reserve(arena, output->size()+tokens.size());
+  for (con_token_list::const_iterator c_it = tokens.cbegin(); c_it != tokens.cend(); ++c_it) {
+    con_token* token = *c_it;
+    output->push_back(arena, token);
+    switch (token->tok_type) {
+      case MACRO:
+        // Resolved once here, so substituting never has to expand a value again
+        ctx->counters.macros_resolved += ctx->symbols.substitute(&token->tok_macro.value, arena);
+        declare_auto_register(&token->tok_macro, ctx->auto_registers, ctx->bitwidth, arena);
+        ctx->symbols.declare(&token->tok_macro);
+        ++ctx->counters.macros_declared;
+        break;
+      case CMD:
+        apply_macro_to_token(token, ctx, arena);
+        break;
+      case FUNCTION:
+        apply_function(token, ctx, top_level, arena);
+        break;
+      case IF:
+        apply_if(token, ctx, arena);
+        break;
+      case WHILE:
+        apply_while(token, ctx, arena);
+        break;
+      case FUNCALL:
+      case SYSCALL: {
+        // The funcall/syscall token stays in place, its instructions are appended after it
+        uint32_t first_arg = output->size();
+        if (token->tok_type == FUNCALL) {
+          apply_funcall(token, ctx, output, arena);
+        } else {
+          apply_syscall(token, ctx, output, arena);
+        }
+        for (con_token_list::iterator it = output->begin()+first_arg; it != output->end(); ++it) {
+          apply_macro_to_token(*it, ctx, arena);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+void apply_function(con_token* token, con_context* ctx, const bool& top_level, con_arena* arena) {
+  con_token_list body = token->tokens;
+  token->tokens = con_token_list();
+  ctx->symbols.push_scope();
+  ++ctx->counters.functions;
+  if (!top_level) {
+    apply_constructs(body, &token->tokens, ctx, false, arena);
+    ctx->symbols.pop_scope();
+    return;
+  }
+  con_function* crntfunc = &token->tok_function;
+  if (crntfunc->name == "main") {
+    crntfunc->name = "_start";
+  }
+  if (ctx->local_labels) {
+    ctx->label_prefix = crntfunc->name;
+    ctx->if_amnt = 0;
+    ctx->while_amnt = 0;
+  }
+  vector<con_auto_register> auto_registers;
+  ctx->auto_registers = &auto_registers;
+
+  // funcname, arg macros (last argument first), ..., ret
+  token->tokens.reserve(arena, body.size()+crntfunc->arguments.size()+2);
+  con_token* tag_tok = arena->make<con_token>(TAG);
+  tag_tok->tok_tag.name = crntfunc->name;
+  token->tokens.push_back(arena, tag_tok);
+  for (size_t j = crntfunc->arguments.size(); j-- > 0; ) {
+    con_token* arg_tok = arena->make<con_token>(MACRO);
+    arg_tok->tok_macro.value = reg_to_str(j, crntfunc->arguments[j].length);
+    arg_tok->tok_macro.macro = crntfunc->arguments[j].name;
+    token->tokens.push_back(arena, arg_tok);
+    ctx->symbols.declare(&arg_tok->tok_macro);
+    ++ctx->counters.macros_declared;
+  }
+  apply_constructs(body, &token->tokens, ctx, false, arena);
+  ctx->symbols.pop_scope();
+  ctx->label_prefix = con_strview();
+  ctx->auto_registers = nullptr;
+  con_token* ret_tok = arena->make<con_token>(CMD);
+  ret_tok->tok_cmd.command = "ret";
+
+  // With -O a call the function ends with jumps instead, the callee returns for it. Not from
+  // _start, which nothing called
+  con_token** tail_call = ctx->optimize && crntfunc->name != "_start" ? find_tail_call(token->tokens) : nullptr;
+  if (tail_call != nullptr) {
+    ++ctx->counters.tail_calls;
+    if (tail_call >= token->tokens.begin() && tail_call < token->tokens.end()) {
+      // call f, ret becomes jmp f in place of the ret
+      ret_tok->tok_cmd = (*tail_call)->tok_cmd;
+      ret_tok->tok_cmd.command = "jmp";
+      token->tokens.erase(tail_call);
+    } else {
+      (*tail_call)->tok_cmd.command = "jmp"; // in an if, the ret stays for when it is not taken
+    }
+  }
+  token->tokens.push_back(arena, ret_tok);
+  // Last, so that the rets and tail calls are known
+  allocate_registers(token, auto_registers, ctx->global_functions, arena, &ctx->counters);
+}
+void apply_if(con_token* token, con_context* ctx, con_arena* arena) {
+  con_token* cmp_tok = arena->make<con_token>(CMD);
+  cmp_tok->tok_cmd.command = "cmp";
+  cmp_tok->tok_cmd.arg1 = token->tok_if.condition.arg1;
+  cmp_tok->tok_cmd.arg2 = token->tok_if.condition.arg2;
+  apply_macro_to_token(token, ctx, arena);
+  apply_macro_to_token(cmp_tok, ctx, arena);
+  ++ctx->counters.ifs;
+
+  con_token* jmp_tok = arena->make<con_token>(CMD);
+  jmp_tok->tok_cmd.command = con_strdup(arena, "j" + comparison_to_string(get_comparison_inverse(token->tok_if.condition.op)));
+
+  // cmp, jmp tag, ..., tag
+  con_token_list body = token->tokens;
+  token->tokens = con_token_list();
+  token->tokens.reserve(arena, body.size()+3);
+  token->tokens.push_back(arena, cmp_tok);
+  token->tokens.push_back(arena, jmp_tok);
+  ctx->symbols.push_scope();
+  apply_constructs(body, &token->tokens, ctx, false, arena);
+  ctx->symbols.pop_scope();
+
+  // Numbered after its body, nested ifs get the lower numbers
+  con_strview tagname = make_label(ctx, "endif" + to_string(ctx->if_amnt), arena);
+  ++ctx->if_amnt;
+  jmp_tok->tok_cmd.arg1 = tagname;
+  apply_macro_to_token(jmp_tok, ctx, arena);
+
+  con_token* endif_tok = arena->make<con_token>(TAG);
+  endif_tok->tok_tag.name = tagname;
+  endif_tok->tok_tag.generated = true;
+  token->tokens.push_back(arena, endif_tok);
+}
+void apply_while(con_token* token, con_context* ctx, con_arena* arena) {
+  con_token* cmp_tok = arena->make<con_token>(CMD);
+  cmp_tok->tok_cmd.command = "cmp";
+  cmp_tok->tok_cmd.arg1 = token->tok_while.condition.arg1;
+  cmp_tok->tok_cmd.arg2 = token->tok_while.condition.arg2;
+  apply_macro_to_token(token, ctx, arena);
+  apply_macro_to_token(cmp_tok, ctx, arena);
+  ++ctx->counters.whiles;
+
+  con_token* jmp_tok = arena->make<con_token>(CMD);
+  jmp_tok->tok_cmd.command = con_strdup(arena, "j" + comparison_to_string(get_comparison_inverse(token->tok_while.condition.op)));
+
+  con_token* startwhile_tok = arena->make<con_token>(TAG);
+
+  // starttag, cmp, jmp endtag, ..., jmp starttag, endtag
+  // Rotated with -O, every iteration then runs one branch: cmp, jmp endtag, starttag, ..., cmp, jmp starttag, endtag
+  con_token_list body = token->tokens;
+  token->tokens = con_token_list();
+  token->tokens.reserve(arena, body.size()+6);
+  if (ctx->optimize) {
+    token->tokens.push_back(arena, cmp_tok);
+    token->tokens.push_back(arena, jmp_tok);
+    token->tokens.push_back(arena, startwhile_tok);
+  } else {
+    token->tokens.push_back(arena, startwhile_tok);
+    token->tokens.push_back(arena, cmp_tok);
+    token->tokens.push_back(arena, jmp_tok);
+  }
+  ctx->symbols.push_scope();
+  apply_constructs(body, &token->tokens, ctx, false, arena);
+  ctx->symbols.pop_scope();
+
+  // Numbered after its body, nested whiles get the lower numbers
+  con_strview endtag_name = make_label(ctx, "endwhile" + to_string(ctx->while_amnt), arena);
+  con_strview starttag_name = make_label(ctx, "startwhile" + to_string(ctx->while_amnt), arena);
+  ++ctx->while_amnt;
+  startwhile_tok->tok_tag.name = starttag_name;
+  startwhile_tok->tok_tag.generated = true;
+  jmp_tok->tok_cmd.arg1 = endtag_name;
+  apply_macro_to_token(jmp_tok, ctx, arena);
+
+  con_token* jmpbck_tok = arena->make<con_token>(CMD);
+  jmpbck_tok->tok_cmd.command = "jmp";
+  jmpbck_tok->tok_cmd.arg1 = starttag_name;
+  apply_macro_to_token(jmpbck_tok, ctx, arena);
+  if (ctx->optimize) {
+    // The condition as substituted before the body, whose macros are out of scope again
+    token->tokens.push_back(arena, arena->make<con_token>(*cmp_tok));
+    jmpbck_tok->tok_cmd.command = con_strdup(arena, "j" + comparison_to_string(token->tok_while.condition.op));
+  }
+
+  con_token* endwhile_tok = arena->make<con_token>(TAG);
+  endwhile_tok->tok_tag.name = endtag_name;
+  endwhile_tok->tok_tag.generated = true;
+
+  token->tokens.push_back(arena, jmpbck_tok);
+  token->tokens.push_back(arena, endwhile_tok);
+}
+void apply_funcall(con_token* token, con_context* ctx, con_token_list* output, con_arena* arena) {
+  push_args(token->tok_funcall.arguments, ctx, output, arena);
+  ++ctx->counters.funcalls_expanded;
+  con_token* call_tok = arena->make<con_token>(CMD);
+  call_tok->tok_cmd.command = "call";
+  call_tok->tok_cmd.arg1 = token->tok_funcall.funcname;
+  output->push_back(arena, call_tok);
+}
+void apply_syscall(con_token* token, con_context* ctx, con_token_list* output, con_arena* arena) {
+  push_args(token->tok_syscall.arguments, ctx, output, arena);
+  ++ctx->counters.syscalls_expanded;
+  con_token* rax_token = arena->make<con_token>(CMD);
+  rax_token->tok_cmd.command = "mov";
+  rax_token->tok_cmd.arg1 = "rax";
+  rax_token->tok_cmd.arg2 = con_strdup(arena, to_string(token->tok_syscall.number));
+  output->push_back(arena, rax_token);
+  con_token* syscall_token = arena->make<con_token>(CMD);
+  syscall_token->tok_cmd.command = "syscall";
+  output->push_back(arena, syscall_token);
+}
+// The call of a funcall that is the last thing done before the function's ret: the last token, or
+// the last of the body of an if the function ends with, which falls through to the ret. nullptr if
+// there is none or its funcall pushed arguments, the callee's ret would leave them on the stack
+con_token** find_tail_call(con_token_list& tokens) {
+  con_token** last = tokens.end();
+  while (last != tokens.begin() && (*(last-1))->tok_type == MACRO) { // not written out
+    --last;
+  }
+  if (last == tokens.begin()) {
+    return nullptr;
+  }
+  --last;
+  if ((*last)->tok_type == IF) {
+    con_token_list body((*last)->tokens.begin(), (*last)->tokens.size()-1); // without the endif tag
+    return find_tail_call(body);
+  }
+  if ((*last)->tok_type != CMD || (*last)->tok_cmd.command != "call") {
+    return nullptr;
+  }
+  // Back to the funcall it was lowered from, past the instructions that set its arguments
+  for (con_token** it = last; it != tokens.begin();) {
+    --it;
+    if ((*it)->tok_type == FUNCALL) {
+      return (*it)->tok_funcall.arguments.size() <= 6 ? last : nullptr;
+    }
+    if ((*it)->tok_type != CMD || (*it)->tok_cmd.command == "call") {
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+void append_linear(const con_token_list& tokens, con_token_list* output, con_arena* arena) {
+  for (con_token_list::const_iterator c_it = tokens.cbegin(); c_it != tokens.cend(); ++c_it) {
+    if ((*c_it)->tok_type != IF && (*c_it)->tok_type != WHILE && (*c_it)->tok_type != FUNCTION) {
+      output->push_back(arena, *c_it);
+    } else {
+      append_linear((*c_it)->tokens, output, arena); // the parent token is owned by the arena, it is just dropped here
+    }
+  }
+}
+void count_constructs(const con_token* token, int* if_amnt, int* while_amnt) {
+  if (token->tok_type == IF) {
+    ++*if_amnt;
+  } else if (token->tok_type == WHILE) {
+    ++*while_amnt;
+  }
+  for (con_token_list::const_iterator c_it = token->tokens.cbegin(); c_it != token->tokens.cend(); ++c_it) {
+    count_constructs(*c_it, if_amnt, while_amnt);
+  }
+}
+con_strview make_label(const con_context* ctx, const std::string& name, con_arena* arena) {
+  if (ctx->label_prefix.empty()) {
+    return con_strdup(arena, name);
+  }
+  return con_strdup(arena, ctx->label_prefix + ("." + name));
+}
+
 CON_COMPARISON get_comparison_inverse(const CON_COMPARISON& condition) {
   switch (condition) {
     case E:
@@ -274,7 +515,7 @@ CON_COMPARISON get_comparison_inverse(const CON_COMPARISON& condition) {
   throw invalid_argument("Invalid comparison value: "+to_string(static_cast<int>(condition)));
 }
 
-std::string reg_to_str(const uint8_t& call_num, const CON_BITWIDTH& bitwidth) {
+con_strview reg_to_str(const uint8_t& call_num, const CON_BITWIDTH& bitwidth) {
   switch (bitwidth) {
     case BIT8:
       switch (call_num) {
@@ -346,91 +587,75 @@ std::string reg_to_str(const uint8_t& call_num, const CON_BITWIDTH& bitwidth) {
   }
   throw invalid_argument("Invalid bitwidth: "+to_string(static_cast<int>(bitwidth)));
 }
-uint8_t str_to_reg(const std::string& reg_name) {
-  if (reg_name=="dil" ||reg_name=="di" || reg_name=="edi" || reg_name=="rdi")
-    return 0;
-  if (reg_name=="sil" ||reg_name=="si" || reg_name=="esi" || reg_name=="rsi")
-    return 1;
-  if (reg_name=="dl" || reg_name=="dx" || reg_name=="edx" || reg_name=="rdx")
-    return 2;
-  if (reg_name=="cl" || reg_name=="cx" || reg_name=="ecx" || reg_name=="rcx")
-    return 3;
-  if (reg_name=="r8b" || reg_name=="r8w" || reg_name=="r8d" || reg_name=="r8")
-    return 4;
-  if (reg_name=="r9b" || reg_name=="r9w" || reg_name=="r9d" || reg_name=="r9")
-    return 5;
+uint8_t str_to_reg(con_strview reg_name) {
+  switch (reg_name.size) {
+    case 2: // di si dl dx cl cx r8 r9
+      switch (reg_name[0]) {
+        case 'd':
+          return reg_name[1] == 'i' ? 0 : (reg_name[1] == 'l' || reg_name[1] == 'x') ? 2 : 6;
+        case 's':
+          return reg_name[1] == 'i' ? 1 : 6;
+        case 'c':
+          return (reg_name[1] == 'l' || reg_name[1] == 'x') ? 3 : 6;
+        case 'r':
+          return reg_name[1] == '8' ? 4 : reg_name[1] == '9' ? 5 : 6;
+      }
+      return 6;
+    case 3: // dil sil [er]di [er]si [er]dx [er]cx r8[bwd] r9[bwd]
+      if (reg_name[0] == 'r' && (reg_name[1] == '8' || reg_name[1] == '9')) {
+        if (reg_name[2] != 'b' && reg_name[2] != 'w' && reg_name[2] != 'd')
+          return 6;
+        return reg_name[1] == '8' ? 4 : 5;
+      }
+      if (reg_name[2] == 'l') {
+        return reg_name == "dil" ? 0 : reg_name == "sil" ? 1 : 6;
+      }
+      if (reg_name[0] != 'e' && reg_name[0] != 'r') {
+        return 6;
+      }
+      switch (reg_name[1]) {
+        case 'd':
+          return reg_name[2] == 'i' ? 0 : reg_name[2] == 'x' ? 2 : 6;
+        case 's':
+          return reg_name[2] == 'i' ? 1 : 6;
+        case 'c':
+          return reg_name[2] == 'x' ? 3 : 6;
+      }
+      return 6;
+  }
   return 6;
 }
 
-size_t find_macro_in_arg(const std::string& arg, const std::string& macro) {
-  size_t pos = arg.find(macro);
-  if ((pos == 0 || (arg[pos-1]!='_' && !isalpha(arg[pos-1])))
-      && (pos+macro.size()-1 == arg.size()-1 || (arg[pos+macro.size()]!='_' && !isalpha(arg[pos+macro.size()])))) {
-    return pos;
-  }
-  return string::npos;
-}
-void apply_macro_to_token(con_token* token, const vector<con_macro*>& macros) {
-  if (token->tok_type != WHILE && token->tok_type != IF && token->tok_type != CMD) {
-    return;
-  }
-  // Unoptimal, but more clear imo
-  for (vector<con_macro*>::const_iterator c_it = macros.cbegin(); c_it != macros.cend(); ++c_it ) {
-    const string& macro = (*c_it)->macro;
-    const string& value = (*c_it)->value;
-    size_t pos;
-    switch (token->tok_type) {
-      case WHILE:
-        pos = find_macro_in_arg(token->tok_while->condition.arg1, macro);
-        while (pos != string::npos) {
-          token->tok_while->condition.arg1.replace(pos, macro.size(), value);
-          pos = find_macro_in_arg(token->tok_while->condition.arg1, macro);
-        }
-        pos = find_macro_in_arg(token->tok_while->condition.arg2, macro);
-        while (pos != string::npos) {
-          token->tok_while->condition.arg2.replace(pos, macro.size(), value);
-          pos = find_macro_in_arg(token->tok_while->condition.arg2, macro);
-        }
-        break;
-      case IF:
-        pos = find_macro_in_arg(token->tok_if->condition.arg1, macro);
-        while (pos != string::npos) {
-          token->tok_if->condition.arg1.replace(pos, macro.size(), value);
-          pos = find_macro_in_arg(token->tok_if->condition.arg1, macro);
-        }
-        pos = find_macro_in_arg(token->tok_if->condition.arg2, macro);
-        while (pos != string::npos) {
-          token->tok_if->condition.arg2.replace(pos, macro.size(), value);
-          pos = find_macro_in_arg(token->tok_if->condition.arg2, macro);
-        }
-        break;
-      case CMD:
-        pos = find_macro_in_arg(token->tok_cmd->arg1, macro);
-        while (pos != string::npos) {
-          token->tok_cmd->arg1.replace(pos, macro.size(), value);
-          pos = find_macro_in_arg(token->tok_cmd->arg1, macro);
-        }
-        pos = find_macro_in_arg(token->tok_cmd->arg2, macro);
-        while (pos != string::npos) {
-          token->tok_cmd->arg2.replace(pos, macro.size(), value);
-          pos = find_macro_in_arg(token->tok_cmd->arg2, macro);
-        }
-        break;
-      default:
-        break;
-    }
+void apply_macro_to_token(con_token* token, con_context* ctx, con_arena* arena) {
+  switch (token->tok_type) {
+    case WHILE:
+      ctx->counters.macros_resolved += ctx->symbols.substitute(&token->tok_while.condition.arg1, arena);
+      ctx->counters.macros_resolved += ctx->symbols.substitute(&token->tok_while.condition.arg2, arena);
+      break;
+    case IF:
+      ctx->counters.macros_resolved += ctx->symbols.substitute(&token->tok_if.condition.arg1, arena);
+      ctx->counters.macros_resolved += ctx->symbols.substitute(&token->tok_if.condition.arg2, arena);
+      break;
+    case CMD:
+      ctx->counters.macros_resolved += ctx->symbols.substitute(&token->tok_cmd.arg1, arena);
+      ctx->counters.macros_resolved += ctx->symbols.substitute(&token->tok_cmd.arg2, arena);
+      break;
+    default:
+      break;
   }
 }
-std::vector<con_token*> push_args(const std::vector<std::string>& args, const CON_BITWIDTH& bitwidth) {
-  vector<con_token*> arg_tokens;
+void push_args(const con_list<con_strview>& args, con_context* ctx, con_token_list* output,
+               con_arena* arena) {
+  const CON_BITWIDTH& bitwidth = ctx->bitwidth;
 
   // stack args;
   for (size_t i = 6; i < args.size() ; ++i) {
     size_t i_rev = args.size()+5 - i;
-    con_token* arg_tok = new con_token(CMD);
-    arg_tok->tok_cmd->command = "push"; // bitwidth
-    arg_tok->tok_cmd->arg1 = args[i_rev];
-    arg_tokens.push_back(arg_tok);
+    con_token* arg_tok = arena->make<con_token>(CMD);
+    arg_tok->tok_cmd.command = "push"; // bitwidth
+    arg_tok->tok_cmd.arg1 = args[i_rev];
+    output->push_back(arena, arg_tok);
+    ++ctx->counters.stack_args;
   }
 
   // register args;
@@ -453,10 +678,11 @@ std::vector<con_token*> push_args(const std::vector<std::string>& args, const CO
   for (size_t fr = 0; fr < 6; ++fr) {
     size_t fr_rev = 5 - fr; // reverse the order
     if (read_order[fr_rev] != 6) { // there is a regester first read i arg number fr, and will be deleted before
-      con_token* arg_tok = new con_token(CMD);
-      arg_tok->tok_cmd->command = "push";
-      arg_tok->tok_cmd->arg1 = reg_to_str(read_order[fr_rev], bitwidth);
-      arg_tokens.push_back(arg_tok);
+      con_token* arg_tok = arena->make<con_token>(CMD);
+      arg_tok->tok_cmd.command = "push";
+      arg_tok->tok_cmd.arg1 = reg_to_str(read_order[fr_rev], bitwidth);
+      output->push_back(arena, arg_tok);
+      ++ctx->counters.register_shuffles;
     }
   }
   // set each arg and track values places
@@ -467,38 +693,35 @@ std::vector<con_token*> push_args(const std::vector<std::string>& args, const CO
     }
   }
   for (size_t i = 0; i < reg_args_size; ++i) {
-    con_token* arg_tok = new con_token(CMD);
+    con_token* arg_tok = arena->make<con_token>(CMD);
     uint8_t wanted_reg = str_to_reg(args[i]);
     if (wanted_reg==6) {
-      arg_tok->tok_cmd->command = "mov";
-      arg_tok->tok_cmd->arg1 = reg_to_str(i, bitwidth);
-      arg_tok->tok_cmd->arg2 = args[i];
+      arg_tok->tok_cmd.command = "mov";
+      arg_tok->tok_cmd.arg1 = reg_to_str(i, bitwidth);
+      arg_tok->tok_cmd.arg2 = args[i];
       // if regi was read before, then current_val_place[i] is a previous register (correct)
       // if regi isn't read yet, then current_val_place[i] is stack (correct)
     } else {
       if (current_val_place[wanted_reg] == 6) {
-        arg_tok->tok_cmd->command = "pop";
-        arg_tok->tok_cmd->arg1 = reg_to_str(i, bitwidth);
+        arg_tok->tok_cmd.command = "pop";
+        arg_tok->tok_cmd.arg1 = reg_to_str(i, bitwidth);
         current_val_place[wanted_reg] = i; // wanted_reg moved from stack to regi
       } else {
         if (i != current_val_place[wanted_reg]) {
-          arg_tok->tok_cmd->command = "mov";
-          arg_tok->tok_cmd->arg1 = reg_to_str(i, bitwidth);
-          arg_tok->tok_cmd->arg2 = reg_to_str(current_val_place[wanted_reg], bitwidth);
+          arg_tok->tok_cmd.command = "mov";
+          arg_tok->tok_cmd.arg1 = reg_to_str(i, bitwidth);
+          arg_tok->tok_cmd.arg2 = reg_to_str(current_val_place[wanted_reg], bitwidth);
           // if regi was read before, then current_val_place[i] is a previous register (correct)
           // if regi isn't read yet, then current_val_place[i] is stack (correct)
           current_val_place[wanted_reg] = min(current_val_place[wanted_reg],i);
         } else {
-          arg_tok->tok_cmd->command = "nop";
+          arg_tok->tok_cmd.command = "nop";
         }
       }
     }
-    if (arg_tok->tok_cmd->command == "nop") {
-      delete arg_tok;
-      arg_tok = nullptr;
-    } else {
-      arg_tokens.push_back(arg_tok);
+    if (arg_tok->tok_cmd.command != "nop") {
+      output->push_back(arena, arg_tok);
+      ctx->counters.register_shuffles += wanted_reg != 6; // a pop or a mov between argument registers
     }
   }
-  return arg_tokens;
 }
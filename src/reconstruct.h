@@ -5,26 +5,39 @@
 #include <vector>
 #include "construct_types.h"
 
-extern CON_BITWIDTH bitwidth;
+class con_emitter;
+struct con_context;
+struct con_token_start;
+struct con_counters;
 
 std::string comparison_to_string(const CON_COMPARISON& condition);
 
-// The following functions transform the construct specific tokens to nasm ones,
-// the parent construct tokens remain, but are removed during linearization
-
-// Converts args to macros and adds tag with same name to child tokens
-void apply_whiles(std::vector<con_token*>& tokens);
-void apply_ifs(std::vector<con_token*>& tokens);
-void apply_functions(std::vector<con_token*>& tokens);
-void apply_macros(std::vector<con_token*>& tokens, std::vector<con_macro*>& macros);
-void apply_funcalls(std::vector<con_token*>& tokens);
-void apply_syscalls(std::vector<con_token*>& tokens);
-
-void set_indentation(std::vector<con_token*>& tokens, int parent_indentation = 0);
+// Serial pass over the top-level tokens that declares the top-level macros in globals, and the
+// functions when one of them has auto macros, and returns the start of every token. After it
+// reconstruct_token can lower the tokens in any order, also on several threads at once, and still
+// number labels and substitute macros as a serial walk would
+std::vector<con_token_start> plan_tokens(con_token_list& tokens, con_context* globals, con_arena* arena);
+
+// The parts of plan_tokens, for callers that keep the top-level tokens between compilations.
+// declare_global declares a top-level macro, declare_function what a top-level function does to the
+// registers (its names are copied to arena when given), count_labels adds the labels token numbers globally
+void declare_global(con_macro* macro, con_context* globals, con_arena* arena);
+void declare_function(const con_token* function, con_context* globals, con_arena* arena);
+void count_labels(const con_token* token, const con_context& globals, int* if_amnt, int* while_amnt);
+
+// Transforms one top-level token to nasm tokens in a single walk: functions, ifs, whiles, funcalls
+// and syscalls are expanded, macros are substituted, indentation is set and the result is linearized
+// (the parent construct tokens are removed) and appended to output. Top-level macros were already
+// handled by plan_tokens and give no output. New tokens and strings are allocated in arena.
+// What the lowering did is added to counters when given
+void reconstruct_token(con_token* token, const con_context& globals, const con_token_start& start,
+                       con_token_list* output, con_arena* arena, con_counters* counters = nullptr);
+
+void set_indentation(con_token_list& tokens, int parent_indentation = 0);
 
 // During linearization, the construct parent tokens are removed
-void linearize_tokens(std::vector<con_token*>& tokens);
+void linearize_tokens(con_token_list& tokens, con_arena* arena);
 
-std::string tokens_to_nasm(const std::vector<con_token*>& tokens);
+void tokens_to_nasm(const con_token_list& tokens, con_emitter* emitter);
 
 #endif // RECONSTRUCT_H_
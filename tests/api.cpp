@@ -0,0 +1,86 @@
+// Checks libconstruct against the examples: usage: api_test.exe example.con...
+// Every example is compiled in memory, also from several threads at once, and compared to its .asm.
+// Prints the time of one in-memory compilation of the first example.
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "../src/libconstruct.h"
+
+static std::string read_file(const std::string& path);
+
+int main(int argc, char** argv) {
+  std::vector<std::string> codes;
+  std::vector<std::string> expected;
+  for (int i = 1; i < argc; ++i) {
+    std::string path(argv[i]);
+    codes.push_back(read_file(path));
+    expected.push_back(read_file(path.substr(0, path.find_last_of('.'))+".asm"));
+  }
+  if (codes.empty()) {
+    std::cout << "usage: " << argv[0] << " example.con..." << std::endl;
+    return 1;
+  }
+
+  con_compile_options options;
+  int failures = 0;
+  std::vector<std::thread> threads;
+  std::vector<int> thread_failures(4, 0);
+  for (size_t t = 0; t < thread_failures.size(); ++t) {
+    threads.emplace_back([&, t]() {
+      for (int round = 0; round < 50; ++round) {
+        for (size_t i = 0; i < codes.size(); ++i) {
+          std::string output;
+          std::string error;
+          if (con_compile(con_strview(codes[i]), options, &output, &error) != 0 || output != expected[i]) {
+            ++thread_failures[t];
+          }
+        }
+      }
+    });
+  }
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+    failures += thread_failures[t];
+  }
+
+  std::string output = "kept";
+  std::string error;
+  if (con_compile("syscall nosuch()\n", options, &output, &error) == 0 || error.empty() || output != "kept") {
+    std::cout << "invalid code was not reported" << std::endl;
+    ++failures;
+  }
+
+  con_compile_options all_cores;
+  all_cores.jobs = 0;
+  output.clear();
+  if (con_compile(con_strview(codes[0]), all_cores, &output, &error) != 0 || output != expected[0]) {
+    std::cout << "compilation with one job per core differed from the example" << std::endl;
+    ++failures;
+  }
+
+  const int calls = 2000;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < calls; ++i) {
+    output.clear();
+    con_compile(con_strview(codes[0]), options, &output, &error);
+  }
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now()-start;
+  std::cout << "con_compile: " << elapsed.count()/calls << " us per call" << std::endl;
+
+  if (failures != 0) {
+    std::cout << failures << " compilation(s) differed from the examples" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+std::string read_file(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
@@ -0,0 +1,338 @@
+// Compile throughput benchmark over generated programs.
+// usage: bench.exe [-b baseline] [-r record] [-t max regression %] [-n runs]
+// Every stage of the pipeline is timed on its own (best of the runs) and reported in input lines
+// and megabytes per second with the peak RSS reached during it. scan is the line classification
+// parse does first, load maps a pre-parsed tree of the workload instead. With -b, a stage more than -t percent
+// (default 30) slower than the baseline fails the benchmark, unless it takes less than 20 ms,
+// which is too short to time reliably. -r writes the results as a baseline.
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "../src/construct_types.h"
+#include "../src/construct_ast.h"
+#include "../src/construct_compile.h"
+#include "../src/construct_context.h"
+#include "../src/construct_emitter.h"
+#include "../src/construct_scan.h"
+#include "../src/deconstruct.h"
+#include "../src/reconstruct.h"
+
+struct bench_workload {
+  std::string name;
+  std::string code;
+  size_t lines;
+};
+
+struct bench_result {
+  double lines_per_s;
+  double seconds;
+  long peak_rss_kb;
+};
+
+static std::string gen_nesting(const int& amnt);
+static std::string gen_macros(const int& amnt);
+static std::string gen_funcalls(const int& amnt);
+static std::string gen_data(const int& amnt);
+static std::map<std::string, bench_result> run_workload(const bench_workload& workload, const int& runs);
+static void reset_peak_rss();
+static long peak_rss_kb();
+static int read_baseline(const std::string& path, std::map<std::string, double>* baseline);
+
+int main(int argc, char** argv) {
+  std::string baseline_path;
+  std::string record_path;
+  double max_regression = 30;
+  int runs = 5;
+  for (int i = 1; i+1 < argc; i += 2) {
+    std::string flag(argv[i]);
+    if (flag == "-b") {
+      baseline_path = argv[i+1];
+    } else if (flag == "-r") {
+      record_path = argv[i+1];
+    } else if (flag == "-t") {
+      max_regression = atof(argv[i+1]);
+    } else if (flag == "-n") {
+      runs = atoi(argv[i+1]) > 0 ? atoi(argv[i+1]) : 1;
+    } else {
+      std::cout << "unknown flag " << flag << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<bench_workload> workloads;
+  workloads.push_back({"nesting", gen_nesting(3000), 0});
+  workloads.push_back({"macros", gen_macros(3000), 0});
+  workloads.push_back({"funcalls", gen_funcalls(3000), 0});
+  workloads.push_back({"data", gen_data(200000), 0});
+  for (std::vector<bench_workload>::iterator it = workloads.begin(); it != workloads.end(); ++it) {
+    it->lines = 0;
+    for (std::string::const_iterator c_it = it->code.cbegin(); c_it != it->code.cend(); ++c_it) {
+      it->lines += *c_it == '\n';
+    }
+  }
+
+  std::map<std::string, double> baseline;
+  if (!baseline_path.empty() && read_baseline(baseline_path, &baseline) != 0) {
+    std::cout << "Could not read baseline \"" << baseline_path << "\"" << std::endl;
+    return 1;
+  }
+
+  std::ostringstream record;
+  record << "# workload stage lines/s, written by bench.exe -r\n";
+  int regressions = 0;
+  printf("%-10s %-12s %14s %10s %12s %10s\n", "workload", "stage", "lines/s", "MB/s", "peak RSS", "baseline");
+  for (std::vector<bench_workload>::const_iterator w_it = workloads.cbegin(); w_it != workloads.cend(); ++w_it) {
+    std::map<std::string, bench_result> results = run_workload(*w_it, runs);
+    static const char* stages[] = {"scan", "parse", "delinearize", "load", "plan", "lower", "emit", "total"};
+    for (size_t s = 0; s < sizeof(stages)/sizeof(stages[0]); ++s) {
+      const std::string key = w_it->name+" "+stages[s];
+      const bench_result& result = results[stages[s]];
+      record << key << " " << static_cast<long long>(result.lines_per_s) << "\n";
+      std::string verdict = "-";
+      std::map<std::string, double>::const_iterator b_it = baseline.find(key);
+      if (b_it != baseline.cend()) {
+        const double change = (result.lines_per_s/b_it->second-1)*100;
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%+.0f%%", change);
+        verdict = buffer;
+        if (change < -max_regression && result.seconds >= 0.02) {
+          verdict += " REGRESSION";
+          ++regressions;
+        }
+      }
+      printf("%-10s %-12s %14.0f %10.0f %9.1f MB %10s\n", w_it->name.c_str(), stages[s], result.lines_per_s,
+             result.lines_per_s*w_it->code.size()/w_it->lines/1e6, result.peak_rss_kb/1024.0, verdict.c_str());
+    }
+  }
+
+  if (!record_path.empty()) {
+    std::ofstream file(record_path);
+    file << record.str();
+    if (!file) {
+      std::cout << "Could not write baseline \"" << record_path << "\"" << std::endl;
+      return 1;
+    }
+  }
+  if (regressions != 0) {
+    std::cout << regressions << " stage(s) more than " << max_regression << "% slower than the baseline"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// ----- ----- ----- ----- ----- ----- helper functions impl ----- ----- ----- ----- -----
+
+// Functions made of ifs and whiles nested 24 deep
+std::string gen_nesting(const int& amnt) {
+  std::ostringstream code;
+  code << "section .text\n";
+  for (int f = 0; f < amnt; ++f) {
+    code << "function nest" << f << "(a: dq, b: dq):\n";
+    std::string tabs = "\t";
+    for (int depth = 0; depth < 24; ++depth) {
+      code << tabs << (depth % 2 == 0 ? "if a l " : "while b ge ") << depth << ":\n";
+      tabs += '\t';
+      code << tabs << "inc a\n";
+    }
+    code << "\tret\n";
+  }
+  return code.str();
+}
+
+// Top-level macros and function scoped macros used by every command
+std::string gen_macros(const int& amnt) {
+  std::ostringstream code;
+  for (int m = 0; m < 500; ++m) {
+    code << "!global" << m << " " << m << "\n";
+  }
+  code << "section .text\n";
+  for (int f = 0; f < amnt; ++f) {
+    code << "function mac" << f << "(a: dq):\n";
+    for (int m = 0; m < 12; ++m) {
+      code << "\t!local" << m << " global" << (f+m) % 500 << "\n";
+      code << "\tmov a, local" << m << "\n";
+      code << "\tadd a, global" << (f*7+m) % 500 << "\n";
+    }
+  }
+  return code.str();
+}
+
+// Calls and syscalls with long argument lists, most of them passed on the stack
+std::string gen_funcalls(const int& amnt) {
+  std::ostringstream code;
+  code << "section .text\n";
+  code << "function callee(a: dq, b: dq, c: dq, d: dq, e: dq, f: dq):\n\tret\n";
+  for (int f = 0; f < amnt; ++f) {
+    code << "function caller" << f << "():\n";
+    for (int c = 0; c < 12; ++c) {
+      code << "\tcall callee(rsi, rdi, rdx, rcx, r8, r9, " << c << ", qword[x], rax, rbx, " << f << ", 7)\n";
+      code << "\tsyscall write(rdi, rsi, rdx)\n";
+    }
+  }
+  code << "section .data\nx dq 0\n";
+  return code.str();
+}
+
+// A huge data section after a small text section
+std::string gen_data(const int& amnt) {
+  std::ostringstream code;
+  code << "section .text\nfunction main():\n\tsyscall exit()\nsection .data\n";
+  for (int d = 0; d < amnt; ++d) {
+    code << "msg" << d << ": db \"message number " << d << "\", 10, 0\n";
+  }
+  return code.str();
+}
+
+std::map<std::string, bench_result> run_workload(const bench_workload& workload, const int& runs) {
+  typedef std::chrono::steady_clock clock;
+  std::map<std::string, double> best;
+  std::map<std::string, long> rss;
+
+  char ast_path[] = "/tmp/construct_bench_XXXXXX";
+  const int ast_fd = mkstemp(ast_path);
+  if (ast_fd < 0) return {};
+  close(ast_fd);
+  {
+    con_arena arena;
+    con_emitter emitter;
+    emitter.open(ast_path);
+    write_ast(parse_tree(con_strview(workload.code), &arena), workload.lines, &emitter);
+    if (emitter.close() != 0) {
+      unlink(ast_path);
+      return {};
+    }
+  }
+  for (int run = 0; run < runs; ++run) {
+    std::map<std::string, double> seconds;
+    con_arena arena;
+    clock::time_point start;
+    auto begin_stage = [&]() {
+      reset_peak_rss();
+      start = clock::now();
+    };
+    auto end_stage = [&](const std::string& stage) {
+      seconds[stage] = std::chrono::duration<double>(clock::now()-start).count();
+      rss[stage] = std::max(rss[stage], peak_rss_kb());
+    };
+
+    begin_stage();
+    size_t classified = 0;
+    con_line_info infos[64];
+    for (size_t pos = 0, amnt = 0; pos < workload.code.size(); classified += amnt) {
+      amnt = con_scan_lines(con_strview(workload.code), pos, infos, sizeof(infos)/sizeof(infos[0]));
+      pos = infos[amnt-1].end+1;
+    }
+    end_stage("scan");
+    if (classified == 0) return {};
+
+    begin_stage();
+    con_token_list tokens = parse_construct(con_strview(workload.code), &arena);
+    end_stage("parse");
+
+    begin_stage();
+    tokens.insert(&arena, tokens.begin(), make_global_start(&arena));
+    tokens = delinearize_tokens(tokens, &arena);
+    end_stage("delinearize");
+
+    begin_stage();
+    con_ast ast;
+    const int loaded = ast.open(ast_path);
+    end_stage("load");
+    if (loaded != 0 || ast.tokens().size() != tokens.size()) {
+      unlink(ast_path);
+      return {};
+    }
+
+    begin_stage();
+    con_context globals;
+    std::vector<con_token_start> starts = plan_tokens(tokens, &globals, &arena);
+    end_stage("plan");
+
+    // apply_* of every construct, set_indentation and linearization run in this one walk
+    begin_stage();
+    con_token_list nasm_tokens;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      reconstruct_token(tokens[i], globals, starts[i], &nasm_tokens, &arena);
+    }
+    end_stage("lower");
+
+    begin_stage();
+    std::string nasm;
+    con_emitter emitter;
+    emitter.open_text(&nasm);
+    tokens_to_nasm(nasm_tokens, &emitter);
+    emitter.close();
+    end_stage("emit");
+
+    begin_stage();
+    std::string total;
+    con_emitter total_emitter;
+    total_emitter.open_text(&total);
+    compile_code(con_strview(workload.code), BIT64, false, 1, nullptr, &total_emitter);
+    total_emitter.close();
+    end_stage("total");
+
+    for (std::map<std::string, double>::const_iterator it = seconds.cbegin(); it != seconds.cend(); ++it) {
+      if (run == 0 || it->second < best[it->first]) {
+        best[it->first] = it->second;
+      }
+    }
+  }
+  unlink(ast_path);
+
+  std::map<std::string, bench_result> results;
+  for (std::map<std::string, double>::const_iterator it = best.cbegin(); it != best.cend(); ++it) {
+    const double seconds = it->second > 1e-9 ? it->second : 1e-9;
+    results[it->first] = {workload.lines/seconds, seconds, rss[it->first]};
+  }
+  return results;
+}
+
+// Linux resets the peak RSS of a process (VmHWM) when 5 is written to clear_refs
+void reset_peak_rss() {
+  FILE* file = fopen("/proc/self/clear_refs", "w");
+  if (file != nullptr) {
+    fputs("5", file);
+    fclose(file);
+  }
+}
+long peak_rss_kb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return atol(line.c_str()+6);
+    }
+  }
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+int read_baseline(const std::string& path, std::map<std::string, double>* baseline) {
+  std::ifstream file(path);
+  if (!file) {
+    return -1;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    std::string workload;
+    std::string stage;
+    double lines_per_s;
+    if (fields >> workload >> stage >> lines_per_s) {
+      (*baseline)[workload+" "+stage] = lines_per_s;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# The examples/*.o goldens are written by construct's own ELF encoder, comparing --obj to them only
+# shows the encoder didn't change. This assembles the example NASM with nasm and compares the bytes
+# of every section with the goldens, so the encoder is checked against an assembler as well. Skipped
+# when nasm is not installed.
+# usage: nasm_check.sh examplesdir outdir
+set -e
+EDIR=$1
+ODIR=$2
+
+if ! command -v nasm >/dev/null 2>&1; then
+  echo "nasm not found, $EDIR/*.o are only compared with construct's own output"
+  exit 0
+fi
+mkdir -p "$ODIR/nasm"
+for name in factorial strchr strlwr; do
+  nasm -f elf64 "$EDIR/$name.asm" -o "$ODIR/nasm/$name.o"
+  for section in .text .data .rodata .bss; do
+    objcopy -O binary --only-section=$section "$EDIR/$name.o" "$ODIR/nasm/$name.construct$section"
+    objcopy -O binary --only-section=$section "$ODIR/nasm/$name.o" "$ODIR/nasm/$name.nasm$section"
+    if ! cmp -s "$ODIR/nasm/$name.construct$section" "$ODIR/nasm/$name.nasm$section"; then
+      echo "$EDIR/$name.o: $section differs from what nasm assembles"
+      exit 1
+    fi
+  done
+done
+echo "$EDIR/*.o match nasm"
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Compiles a 10^5 and a 10^6 line program made of funcalls, ifs and whiles and checks that
+# compile time grows linearly: 10x the input may take at most STRESS_MAX_RATIO times as long.
+# usage: stress.sh construct.exe outdir
+set -e
+PROG=$1
+ODIR=$2
+MAX_RATIO=${STRESS_MAX_RATIO:-20}
+
+gen() {
+  awk -v n="$1" 'BEGIN {
+    print "section .text"
+    print "function f(a: dq, b: dq, c: dq):"
+    print "\tret"
+    print "function main():"
+    print "\t!x rbx"
+    for (i = 0; i < n; ) {
+      if (i % 100 == 0) { print "\tif x ne " i ":"; ++i }
+      else if (i % 100 == 50) { print "\twhile x l " i ":"; ++i }
+      else if (i % 100 > 50) { print "\t\tcall f(rsi, rdi, x)"; ++i }
+      else if (i % 100 > 0) { print "\t\tsyscall write(rdi, x, 1)"; ++i }
+    }
+    print "\tsyscall exit()"
+    print "section .data"
+    print "x dq 0"
+  }'
+}
+
+now_ms() {
+  echo $(($(date +%s%N)/1000000))
+}
+
+gen 100000 > "$ODIR/stress_small.con"
+gen 1000000 > "$ODIR/stress_large.con"
+
+start=$(now_ms)
+"$PROG" -f elf64 -i "$ODIR/stress_small.con" -o "$ODIR/stress_small.asm"
+small=$(($(now_ms)-start))
+start=$(now_ms)
+"$PROG" -f elf64 -i "$ODIR/stress_large.con" -o "$ODIR/stress_large.asm"
+large=$(($(now_ms)-start))
+
+[ "$small" -gt 0 ] || small=1
+echo "10^5 lines: ${small} ms, 10^6 lines: ${large} ms, ratio $((large/small)) (max ${MAX_RATIO})"
+if [ $((large)) -gt $((small*MAX_RATIO)) ]; then
+  echo "Compile time does not scale linearly"
+  exit 1
+fi